@@ -10,6 +10,8 @@
  *  sysConfig.init(); is called after Serial.begin(); and it handles all WiFi, OTA, NAT, Time setting and Bluetooth configuration
  *  WPS is also supported via sysConfig
  *  sysConfig.run(); keeps things updated, provides for servicing of the OTA & Web server issues among others, it also handles the blinking of the status LED
+ *  sysConfig.startServices(); after init runs those services in a task on the other core instead, run() then returns at once
+ *  and changes posted from the web pages are read in loop() with sysConfig.nextChange(change);
  */
 
 #include "sysconfig32.h";
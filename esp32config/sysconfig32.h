@@ -19,6 +19,8 @@
 #include <ArduinoOTA.h>
 #include "FS.h"
 #include "SPIFFS.h"
+#include "esp_partition.h"
+#include <lwip/sockets.h>
 /* BLEDevice & BLEServer are mutually exclusive
 #include <BLEDevice.h>
 #include <BLEServer.h>
@@ -34,6 +36,8 @@
 #include "sys/time.h"
 #include "esp_sleep.h"
 #include "time.h"
+#include <atomic>
+#include <StreamString.h> // the text of /loop.txt
 
 
 #define ESP_WPS_MODE      WPS_TYPE_PBC
@@ -114,6 +118,14 @@ char NodeName[32];
 time_t regDate;
 long regID;
 long checksum;
+// the access point and lease of the last connection, so that the next one can skip the scan and DHCP
+alignas(time_t) alignas(long) uint8_t lastBSSID[6]; // aligned like the members above, so a version 0 file ends here
+byte lastChannel; // 0 when nothing is cached
+byte lastAP; // index into AccessPoints
+IPAddress lastIP;
+IPAddress lastGateway;
+IPAddress lastSubnet;
+IPAddress lastDNS;
 } dataframe;
 
 typedef struct {
@@ -148,6 +160,349 @@ typedef struct {
 #define SCAN_PERIOD 5000
 #define CONNECT_PERIOD 500
 
+/* the config schema describes every field of dataframe once, the form post, the json export and the factory defaults are all driven from it
+ * indexed fields such as the access points and timers are a single entry, the element index is appended to the name, e.g. SSID_0 - SSID_4
+*/
+enum t_field {t_text, t_byte, t_float, t_bool, t_time, t_offset, t_int, t_ip};// t_time is a clock time stored with the 86400 offset, t_offset is stored in minutes, t_int is a signed integer of the member's size
+enum j_section {j_none, j_wifi, j_data, j_mqtt, j_time, j_alarms};// the json array the field is reported in
+// the arrays of data.json in the order they are sent, sysInfo holds the live state of the device rather than config fields
+// data.json?sections=WiFi,time selects some of them, each is a bit of the selection mask in this order
+typedef struct {
+ const char *name;
+ j_section section;
+} tjsonsection;
+const tjsonsection jsonSections[]={{"WiFi",j_wifi},{"data",j_data},{"MQTT",j_mqtt},{"time",j_time},{"sysInfo",j_none},{"alarms",j_alarms}};
+#define JSON_SECTIONS (sizeof(jsonSections)/sizeof(tjsonsection))
+#define F_POST 1 // the field is accepted from the config form
+
+typedef struct {
+ const char *name; // form and json name
+ uint16_t offset; // position of the (first) element in dataframe
+ byte type;
+ byte size; // buffer size of text fields
+ byte count; // number of elements, 1 for plain fields
+ uint16_t stride; // distance between the elements of indexed fields
+ int32_t min; // range applied to posted values, ignored if min==max
+ int32_t max;
+ byte section;
+ byte flags;
+ const char *text; // default of text fields
+ int32_t value; // default of numeric fields
+} tfield;
+
+#define FIELD_SIZE(member) sizeof(((dataframe*)0)->member)
+#define TEXT(name, member, section, flags, text) {name, offsetof(dataframe, member), t_text, FIELD_SIZE(member), 1, 0, 0, 0, section, flags, text, 0}
+#define TEXTS(name, member, count, stride, section, flags) {name, offsetof(dataframe, member), t_text, FIELD_SIZE(member), count, stride, 0, 0, section, flags, "", 0}
+#define VALUE(name, member, type, min, max, section, flags, value) {name, offsetof(dataframe, member), type, FIELD_SIZE(member), 1, 0, min, max, section, flags, nullptr, value}
+#define VALUES(name, member, type, count, stride, section, flags, value) {name, offsetof(dataframe, member), type, FIELD_SIZE(member), count, stride, 0, 0, section, flags, nullptr, value}
+#define IP4(a, b, c, d) ((int32_t)((a)|((b)<<8)|((c)<<16)|((uint32_t)(d)<<24))) // the default of t_ip fields, in IPAddress byte order
+
+// the IPAddress members leave dataframe non-standard-layout, it has no bases or virtual members of its own so the offsets
+// are still those of a plain struct, and only the places that take them turn off -Winvalid-offsetof
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+// the order of the fields within a section is the order of the json array read by index.html
+constexpr tfield configSchema[] = {
+ TEXTS("SSID_", AccessPoints[0].WiFiname, 5, sizeof(WiFiParams), j_wifi, F_POST),
+ TEXTS("SSID_pass_", AccessPoints[0].WiFipassword, 5, sizeof(WiFiParams), j_none, F_POST),
+ TEXT("APname", APname, j_data, F_POST, "TRL_Device"),
+ TEXT("APpass", APpassword, j_data, F_POST, "12345678"),
+ VALUE("APchannel", APchannel, t_byte, 1, 13, j_data, F_POST, 11),
+ VALUE("APconfig", APconfig, t_byte, 0, 4, j_data, F_POST, 1), // softap is always available
+ TEXT("BLEname", BLEname, j_data, F_POST, "TRL_Device"),
+ TEXT("BLEpassword", BLEpassword, j_data, F_POST, "1111"),
+ VALUE("BLEconfig", BLEConfig, t_byte, 0, 4, j_data, F_POST, 1), // always on
+ TEXT("userName", userName, j_data, F_POST, "admin"),
+ TEXT("userPass", userPass, j_data, F_POST, "admin"),
+ VALUE("OTA", OTA, t_byte, 0, 3, j_data, F_POST, 0),
+ TEXT("OTApass", OTApass, j_data, F_POST, ""),
+ TEXT("MQTTserver", MQTTserver, j_mqtt, F_POST, ""),
+ VALUE("MQTTport", MQTTport, t_byte, 0, 0, j_mqtt, F_POST, 0),
+ TEXT("MQTTuser", MQTTuser, j_mqtt, F_POST, ""),
+ TEXT("MQTTpass", MQTTpass, j_mqtt, F_POST, ""),
+ TEXT("NTPserver", NTPserver, j_time, F_POST, "north-america.pool.ntp.org"),
+ VALUE("TZ", TZ, t_offset, 0, 0, j_time, F_POST, 120),
+ VALUE("DST", DST, t_offset, 0, 0, j_time, F_POST, 60),
+ VALUES("st_", timers[0].startTime, t_time, 32, sizeof(ttimer), j_alarms, F_POST, 86400),
+ VALUES("et_", timers[0].endTime, t_time, 32, sizeof(ttimer), j_alarms, F_POST, 86400),
+ VALUES("d_", timers[0].dow, t_byte, 32, sizeof(ttimer), j_alarms, F_POST, 0),
+ TEXT("fname", firstname, j_none, F_POST, ""),
+ TEXT("lname", lastname, j_none, F_POST, ""),
+ TEXT("email", userEmail, j_none, F_POST, ""),
+ TEXT("phone", phone, j_none, F_POST, ""),
+ TEXT("Node", NodeName, j_none, F_POST, ""),
+ VALUE("ConfigPage", ConfigPage, t_byte, 0, 0, j_none, 0, 1), // always available
+ VALUE("sensorConfig", sensorConfig, t_byte, 0, 0, j_none, 0, 2), // heating
+ VALUE("timerConfig", timerConfig, t_byte, 0, 0, j_none, 0, 2), // defaults to timer only mode
+ VALUE("setPoint", setPoint, t_float, 0, 0, j_none, 0, 0), // also used as setPoint for PID loops
+ VALUE("rangeValue", rangeValue, t_float, 0, 0, j_none, 0, 0),
+ VALUE("iceGuard", iceGuard, t_float, 0, 0, j_none, 0, 0), // used by heating and cooling to prevent icing, must be >0 to be active
+ VALUE("activeHigh", activeHigh, t_bool, 0, 0, j_none, 0, false), // heating activates when temperature drops below the lower trigger value
+ VALUE("PIDcontrolled", PIDcontrolled, t_bool, 0, 0, j_none, 0, true), // if running on a PID, the value used for setPoint is setPoint
+ VALUE("ip", ip, t_ip, 0, 0, j_none, 0, IP4(192,168,4,1)), // static address of the access point
+ VALUE("gateway", gateway, t_ip, 0, 0, j_none, 0, IP4(192,168,4,1)),
+ VALUE("subnet", subnet, t_ip, 0, 0, j_none, 0, IP4(255,255,255,0)),
+ VALUE("min_on", min_on, t_int, 0, 0, j_none, 0, 0),
+ VALUE("max_on", max_on, t_int, 0, 0, j_none, 0, 0),
+ VALUE("min_off", min_off, t_int, 0, 0, j_none, 0, 0),
+ VALUE("burncount", burncount, t_int, 0, 0, j_none, 0, 0),
+ VALUE("burntime", burntime, t_int, 0, 0, j_none, 0, 0),
+ TEXT("URL", URL, j_none, 0, ""),
+ VALUE("regDate", regDate, t_int, 0, 0, j_none, 0, 0),
+ VALUE("regID", regID, t_int, 0, 0, j_none, 0, 0),
+ VALUES("lastBSSID_", lastBSSID[0], t_byte, 6, 1, j_none, 0, 0), // the connection resumeWiFi() goes back to
+ VALUE("lastChannel", lastChannel, t_byte, 0, 0, j_none, 0, 0),
+ VALUE("lastAP", lastAP, t_byte, 0, 0, j_none, 0, 0),
+ VALUE("lastIP", lastIP, t_ip, 0, 0, j_none, 0, 0),
+ VALUE("lastGateway", lastGateway, t_ip, 0, 0, j_none, 0, 0),
+ VALUE("lastSubnet", lastSubnet, t_ip, 0, 0, j_none, 0, 0),
+ VALUE("lastDNS", lastDNS, t_ip, 0, 0, j_none, 0, 0)
+};
+// the bookkeeping of the saves themselves is not a change
+constexpr bool bookkeeping(const tfield &f){ return (f.offset==offsetof(dataframe, burncount))||(f.offset==offsetof(dataframe, burntime));}
+#pragma GCC diagnostic pop
+#define SCHEMA_FIELDS (sizeof(configSchema)/sizeof(configSchema[0]))
+
+/* posted names are resolved to their schema field through a perfect hash, FNV-1a over the name (less the element index) selects one of 128 slots
+ * the seed was searched for so that no two schema names share a slot, renaming or adding a field may need a new seed, the static_assert below reports it
+*/
+#define FIELD_SLOTS 128
+#define FIELD_SEED 2166510214u
+#define FIELD_SLOT(hash) ((hash)>>25) // the top bits, the low bits of FNV-1a mix poorly
+#define NO_FIELD 0xFF
+#define FNV_BASIS 2166136261u // the standard FNV-1a start value, used where a hash is stored and must not change with FIELD_SEED
+constexpr uint32_t fieldHash(const char *s, uint32_t h=FIELD_SEED){ return *s ? fieldHash(s+1, (h^(byte)*s)*16777619u) : h; }
+constexpr byte slotField(byte slot, byte i=0){
+ return i>=SCHEMA_FIELDS ? NO_FIELD : FIELD_SLOT(fieldHash(configSchema[i].name))==slot ? i : slotField(slot, i+1);
+}
+constexpr bool perfectHash(byte i=0){
+ return i>=SCHEMA_FIELDS || (slotField(FIELD_SLOT(fieldHash(configSchema[i].name)))==i && perfectHash(i+1));
+}
+static_assert(perfectHash(), "two schema names share a hash slot, search for a new FIELD_SEED");
+#define SLOTS8(s) slotField(s), slotField(s+1), slotField(s+2), slotField(s+3), slotField(s+4), slotField(s+5), slotField(s+6), slotField(s+7)
+constexpr byte fieldSlots[FIELD_SLOTS] = {SLOTS8(0), SLOTS8(8), SLOTS8(16), SLOTS8(24), SLOTS8(32), SLOTS8(40), SLOTS8(48), SLOTS8(56),
+ SLOTS8(64), SLOTS8(72), SLOTS8(80), SLOTS8(88), SLOTS8(96), SLOTS8(104), SLOTS8(112), SLOTS8(120)};
+
+// WebServer hands out the posted arguments by copy, this gives the form parser in place access to them
+class tWebServer : public WebServer{
+ public:
+  tWebServer(int port=80):WebServer(port){}
+  const String &argKey(int i){ return _currentArgs[i].key; }
+  const String &argValue(int i){ return _currentArgs[i].value; }
+  // takes over the connection of the current request, the server forgets it without closing it
+  WiFiClient detachClient(){ WiFiClient c=_currentClient; _currentClient=WiFiClient(); return c; }
+};
+
+/* writes a json response straight to the client, values are formatted into a chunk of JSON_CHUNK bytes that is sent each time it fills
+ * the commas between members are tracked per nesting level, so a document is built from begin/end and value calls without any String
+*/
+#define JSON_CHUNK 512
+#define JSON_DEPTH 8
+class tJSONWriter{
+ public:
+  tJSONWriter(WebServer &server):server(server){}
+  void begin(const char *type="text/x-json"); // sends the headers, the body follows in chunks
+  void end(); // sends the rest of the body and the final chunk
+  void beginObject(const char *name=nullptr); // the name is omitted for array elements and the document itself
+  void endObject();
+  void beginArray(const char *name=nullptr);
+  void endArray();
+  void value(int32_t v);
+  void value(uint32_t v);
+  void value(float v);
+  void value(bool v);
+  void value(const char *text, size_t size=0xFFFF); // at most size characters, escaped
+ private:
+  WebServer &server;
+  char chunk[JSON_CHUNK];
+  size_t length=0;
+  byte depth=0;
+  uint32_t members=0; // one bit per nesting level, set once the level has a member and needs a comma before the next
+  void next(); // the comma before a member
+  void key(const char *name); // the name of an object member
+  void digits(uint32_t v);
+  void string(const char *text, size_t size);
+  void put(char c);
+  void put(const char *text, size_t n);
+  void flush();
+};
+
+void tJSONWriter::begin(const char *type){
+ length=0;
+ depth=0;
+ members=0;
+ server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+ server.send(200, type, "");
+}
+void tJSONWriter::end(){
+ flush();
+ server.sendContent("");
+}
+void tJSONWriter::next(){
+ if (members & (1<<depth)){ put(',');}
+ members|=1<<depth;
+}
+void tJSONWriter::beginObject(const char *name){
+ next();
+ if (name){ key(name);}
+ put('{');
+ if (depth<JSON_DEPTH){ depth++;}
+ members&=~(1<<depth);
+}
+void tJSONWriter::endObject(){
+ if (depth){ depth--;}
+ put('}');
+}
+void tJSONWriter::beginArray(const char *name){
+ next();
+ if (name){ key(name);}
+ put('[');
+ if (depth<JSON_DEPTH){ depth++;}
+ members&=~(1<<depth);
+}
+void tJSONWriter::endArray(){
+ if (depth){ depth--;}
+ put(']');
+}
+void tJSONWriter::key(const char *name){
+ string(name, 0xFFFF);
+ put(':');
+}
+void tJSONWriter::value(uint32_t v){
+ next();
+ digits(v);
+}
+void tJSONWriter::value(int32_t v){
+ next();
+ if (v<0){ put('-');}
+ digits(v<0 ? 0-(uint32_t)v : (uint32_t)v);
+}
+void tJSONWriter::digits(uint32_t v){
+ char text[10];
+ byte n=0;
+ do { text[n++]='0'+v%10; v/=10;} while (v);
+ while (n){ put(text[--n]);}
+}
+void tJSONWriter::value(float v){
+ char text[24];
+ next();
+ put(text, snprintf(text, sizeof(text), "%f", v));
+}
+void tJSONWriter::value(bool v){
+ next();
+ if (v){ put("true",4);} else { put("false",5);}
+}
+void tJSONWriter::value(const char *text, size_t size){
+ next();
+ string(text, size);
+}
+void tJSONWriter::string(const char *text, size_t size){
+ static const char hex[]="0123456789abcdef";
+ put('"');
+ for (size_t i=0;(i<size)&&text[i];i++){
+  char c=text[i];
+  if ((c=='"')||(c=='\\')){ put('\\'); put(c);}
+  else if ((byte)c<0x20){ put("\\u00",4); put(hex[(byte)c>>4]); put(hex[c&15]);}
+  else { put(c);}
+ }
+ put('"');
+}
+void tJSONWriter::put(char c){
+ if (length==sizeof(chunk)){ flush();}
+ chunk[length++]=c;
+}
+void tJSONWriter::put(const char *text, size_t n){
+ while (n--){ put(*text++);}
+}
+void tJSONWriter::flush(){
+ if (length){ server.sendContent(chunk, length);}
+ length=0;
+}
+
+/* writes /metrics in the Prometheus text format straight to the client, lines are formatted into a chunk of METRICS_CHUNK bytes
+ * that is sent each time it fills, so a scrape builds no String and holds no more memory than the chunk
+*/
+#define METRICS_CHUNK 512
+class tMetricsWriter{
+ public:
+  tMetricsWriter(WebServer &server):server(server){}
+  void begin(); // sends the headers, the body follows in chunks
+  void end(); // sends the rest of the body and the final chunk
+  void family(const char *name, const char *type, const char *help); // the HELP and TYPE lines that come before the samples of a metric
+  void sample(const char *name, const char *labels, uint32_t v, const char *suffix=nullptr); // labels such as route="/", or nullptr
+  void sample(const char *name, const char *labels, int32_t v, const char *suffix=nullptr);
+  void sample(const char *name, const char *labels, float v, const char *suffix=nullptr);
+ private:
+  WebServer &server;
+  char chunk[METRICS_CHUNK];
+  size_t length=0;
+  void name(const char *name, const char *suffix, const char *labels);
+  void put(char c);
+  void put(const char *text);
+  void put(const char *text, size_t n);
+  void flush();
+};
+
+void tMetricsWriter::begin(){
+ length=0;
+ server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+ server.send(200, "text/plain; version=0.0.4", "");
+}
+void tMetricsWriter::end(){
+ flush();
+ server.sendContent("");
+}
+void tMetricsWriter::family(const char *name, const char *type, const char *help){
+ put("# HELP ");
+ put(name);
+ put(' ');
+ put(help);
+ put("\n# TYPE ");
+ put(name);
+ put(' ');
+ put(type);
+ put('\n');
+}
+void tMetricsWriter::sample(const char *name, const char *labels, uint32_t v, const char *suffix){
+ char text[12];
+ this->name(name, suffix, labels);
+ put(text, snprintf(text, sizeof(text), "%u\n", v));
+}
+void tMetricsWriter::sample(const char *name, const char *labels, int32_t v, const char *suffix){
+ char text[13];
+ this->name(name, suffix, labels);
+ put(text, snprintf(text, sizeof(text), "%d\n", (int)v));
+}
+void tMetricsWriter::sample(const char *name, const char *labels, float v, const char *suffix){
+ char text[24];
+ this->name(name, suffix, labels);
+ put(text, snprintf(text, sizeof(text), "%.6g\n", v)); // seconds of a job are often below a microsecond
+}
+void tMetricsWriter::name(const char *name, const char *suffix, const char *labels){
+ put(name);
+ if (suffix){ put(suffix);}
+ if (labels){
+  put('{');
+  put(labels);
+  put('}');
+ }
+ put(' ');
+}
+void tMetricsWriter::put(char c){
+ if (length==sizeof(chunk)){ flush();}
+ chunk[length++]=c;
+}
+void tMetricsWriter::put(const char *text){
+ while (*text){ put(*text++);}
+}
+void tMetricsWriter::put(const char *text, size_t n){
+ while (n--){ put(*text++);}
+}
+void tMetricsWriter::flush(){
+ if (length){ server.sendContent(chunk, length);}
+ length=0;
+}
+
 // global variables
 IPAddress ip(192,168,4,1);
 IPAddress gateway(192,168,4,1);
@@ -160,11 +515,350 @@ enum s_class {s_none, s_byte, s_int32_t, s_float, s_text};// used by the select
 enum eSensorClass {s_undefined, s_NTC, s_BMP, s_BME, s_ADC, s_Freq, s_PWM, s_Weight};
 
 typedef std::function<void(time_t trigger)> TTimerFunction;
+/* each job, and each pass of run() that runs one, is timed with the cycle counter into a histogram of power of two buckets
+ * p50 and p99 are the upper edge of the bucket they fall in so they are good to a factor of two, max and mean are exact
+ * the report is served at /loop.txt and printed for the serial command "stats", "stats reset" clears it, LOOP_STATS 0 compiles it out
+*/
+#ifndef LOOP_STATS
+#define LOOP_STATS 1
+#endif
+#define HISTOGRAM_BUCKETS 24 // bucket b counts times of 2^b to 2^(b+1)-1 cycles, the last one also everything longer
+#define SERIAL_PERIOD 100 // ms between reads of serial commands
+typedef struct {
+ uint32_t counts[HISTOGRAM_BUCKETS];
+ uint32_t samples;
+ uint32_t maxCycles;
+ uint64_t totalCycles;
+} thistogram;
+inline void recordCycles(thistogram &h, uint32_t cycles){
+ byte b=cycles ? 31-__builtin_clz(cycles) : 0;
+ h.counts[b<HISTOGRAM_BUCKETS ? b : HISTOGRAM_BUCKETS-1]++;
+ h.samples++;
+ h.totalCycles+=cycles;
+ if (cycles>h.maxCycles){ h.maxCycles=cycles;}
+}
+uint32_t histogramPercentile(const thistogram &h, uint32_t perMille){ // in cycles
+ uint32_t rank=((uint64_t)h.samples*perMille+999)/1000;
+ uint32_t seen=0;
+ for (byte b=0;b<HISTOGRAM_BUCKETS;b++){
+  seen+=h.counts[b];
+  if (seen&&(seen>=rank)){
+   uint32_t edge=b+1<HISTOGRAM_BUCKETS ? (2u<<b)-1 : h.maxCycles;
+   return edge<h.maxCycles ? edge : h.maxCycles;
+  }
+ }
+ return h.maxCycles;
+}
+void statsLine(Print &out, const char *name, const thistogram &h, uint32_t mhz){
+ out.printf("%-8s %9u %9.1f %9.1f %9.1f %9.1f\r\n", name, h.samples, h.samples ? (float)h.totalCycles/h.samples/mhz : 0.0f,
+  (float)histogramPercentile(h, 500)/mhz, (float)histogramPercentile(h, 990)/mhz, (float)h.maxCycles/mhz);
+}
+/* run() is driven by a table of jobs, each with a period and the millis() it is next due, a pass only calls the jobs that are due
+ * and returns the ms until the next deadline, while nothing is due a pass costs a single compare
+ * a job with a period of 0 runs once each time it is woken, the application can add its own jobs with schedule()
+*/
+typedef std::function<void()> TJobFunction;
+typedef struct {
+ TJobFunction job; // empty while the slot is free
+ const char *name; // for the timing report
+ uint32_t period; // ms from one run to the next, missed runs are skipped rather than caught up
+ uint32_t due; // millis() of the next run
+ bool armed; // false while a one-shot job waits to be woken
+#if LOOP_STATS
+ thistogram stats;
+#endif
+} tjob;
+#ifndef JOBS
+#define JOBS 12 // the system uses 7
+#endif
+#define NO_JOB -1
+#define JOB_IDLE 1000 // the longest run() reports when no job is armed
+#define WEB_PERIOD 1 // ms between polls of the web server
+#define OTA_PERIOD 20
+#define WIFI_PERIOD 1000 // ms between checks of the station link once it is up
+#define WIFI_STEP 100 // ms between steps of the station state machine while it scans and connects
+#define CONNECT_TIMEOUT 10000 // ms each access point is given to connect
+#define RESUME_TIMEOUT 3000 // ms the cached access point is given before a full scan
+#define WIFI_BACKOFF 10000 // ms before scanning again once every access point has failed, doubled each round up to WIFI_BACKOFF_MAX
+#define WIFI_BACKOFF_MAX 160000
+#define WIFI_CANDIDATES 8 // configured access points kept from a scan, an SSID served by several radios counts once per radio
+/* the station side of the WiFi, stepped by the WiFi job so that init() returns with the access point and web server up
+ * w_resume waits on the access point of the last connection, joined on its channel with its lease as a static address
+ * w_scan starts a scan, w_scanning waits for it and picks the configured access points it found, strongest first
+ * w_connect starts on the next of them, w_connecting waits for it, w_backoff waits to scan again when they all failed
+ */
+enum w_state {w_idle, w_resume, w_scan, w_scanning, w_connect, w_connecting, w_connected, w_backoff};
+typedef struct {
+ byte ap; // index into AccessPoints
+ int32_t RSSI;
+ int32_t channel;
+ uint8_t BSSID[6];
+} tcandidate;
 String HTML;
 char buffer[256];
 dataframe _data; // the data is contained in the private section as its not meant to be directly interatecd with by the main program
+dataframe _saved; // the config as it is in flash, saves only journal the fields that differ from it
+dataframe _published; // the config as the application has been told of it through the change queue
+
+// typed access to a schema field within the config data
+template <typename T> T &fieldRef(const tfield &f, byte index, dataframe &frame=_data){
+ return *reinterpret_cast<T*>(reinterpret_cast<byte*>(&frame)+f.offset+index*f.stride);
+}
 //dataframe _formdata; // the data contained herein is used to process the form data
 
+/* from_chars style scanners for form input, each converts the text at the start of [first,last) in place, without copies or substrings
+ * and returns the position after what it consumed, or nullptr if there is nothing to convert or the value overflows
+ * the caller compares the result with last to require that the whole field was consumed
+*/
+const char *scanUnsigned(const char *first, const char *last, uint32_t &value){
+ if ((first==last)||!isDigit(*first)){ return nullptr;}
+ uint32_t v=0;
+ for (;(first<last)&&isDigit(*first);first++){
+  byte d=*first-'0';
+  if (v>(0xFFFFFFFFu-d)/10){ return nullptr;}
+  v=v*10+d;
+ }
+ value=v;
+ return first;
+}
+const char *scanFloat(const char *first, const char *last, float &value){ // digits with an optional decimal point, either side may be empty but not both
+ float v=0;
+ float scale=1;
+ bool digits=false;
+ for (;(first<last)&&isDigit(*first);first++){ v=v*10+(*first-'0'); digits=true;}
+ if ((first<last)&&(*first=='.')){
+  for (first++;(first<last)&&isDigit(*first);first++){ scale/=10; v+=(*first-'0')*scale; digits=true;}
+ }
+ if (!digits){ return nullptr;}
+ value=v;
+ return first;
+}
+const char *scanTime(const char *first, const char *last, uint32_t &hours, uint32_t &minutes){ // hh:mm
+ first=scanUnsigned(first,last,hours);
+ if ((!first)||(first==last)||(*first!=':')){ return nullptr;}
+ return scanUnsigned(first+1,last,minutes);
+}
+const char *scanIP(const char *first, const char *last, IPAddress &ip){ // dotted quad, each part 0-255
+ uint32_t part[4];
+ for (byte i=0;i<4;i++){
+  if (i>0){
+   if ((first==last)||(*first!='.')){ return nullptr;}
+   first++;
+  }
+  first=scanUnsigned(first,last,part[i]);
+  if ((!first)||(part[i]>255)){ return nullptr;}
+ }
+ ip=IPAddress(part[0],part[1],part[2],part[3]);
+ return first;
+}
+
+/* config.bin is a header followed by one record per schema field, each record carries the field's name hash, type and element size, then the elements
+ * the file describes its own layout, so a config written by older firmware is upgraded field by field at boot: fields are matched by name,
+ * integers are widened or narrowed, text is cut to the new buffer and fields the file does not have keep their defaults
+ * version 0 is the raw dataframe written before the header was introduced, it is recognised by its size and read with the current offsets
+ * saves append a journal of the changed elements after the records, each entry has its own CRC so a save cut short by a power loss only loses itself
+ * once the journal passes CONFIG_JOURNAL_LIMIT, run() compacts it by writing a fresh file
+*/
+#define CONFIG_MAGIC 0x434C5254 // "TRLC" in file order
+#define CONFIG_VERSION 1 // layout of the file itself, not of the schema
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof" // see configSchema
+constexpr size_t CONFIG_LEGACY_SIZE=offsetof(dataframe, lastBSSID); // size of a version 0 file, the members from lastBSSID on came later
+#pragma GCC diagnostic pop
+#define CONFIG_JOURNAL_LIMIT 1024 // journal bytes that trigger a compaction, also the largest single save that is journaled
+#define NO_JOURNAL 0xFFFFFFFF // config.bin cannot be appended to, the next save writes a whole file
+#define COMMIT_DELAY 3000 // ms a save waits for further changes, so a user working through several tabs causes one write
+
+typedef struct {
+ uint32_t magic;
+ uint16_t version;
+ uint16_t records;
+ uint32_t schema; // fingerprint of the schema that wrote the file, the records are matched by position while it is unchanged
+ uint32_t length; // bytes of records following the header
+ uint32_t crc; // CRC32 of the records
+} tconfigheader;
+
+typedef struct {
+ uint32_t name; // FNV-1a of the field name
+ byte type;
+ byte count;
+ uint16_t size; // bytes per element
+} tconfigrecord;
+
+typedef struct {
+ uint32_t name; // FNV-1a of the field name
+ byte type;
+ byte index; // element of an indexed field
+ uint16_t size; // bytes of data following, then a CRC32 of the entry and its data
+} tjournalentry;
+
+// IPAddress holds a vtable pointer, only its four address bytes are stored
+constexpr uint16_t packedSize(const tfield &f){ return f.type==t_ip ? 4 : f.size; }
+constexpr uint16_t largerSize(uint16_t a, uint16_t b){ return a>b ? a : b; }
+constexpr uint16_t largestElement(byte i=0){ return i>=SCHEMA_FIELDS ? 0 : largerSize(packedSize(configSchema[i]), largestElement(i+1)); }
+constexpr uint32_t recordsSize(byte i=0){ return i>=SCHEMA_FIELDS ? 0 : sizeof(tconfigrecord)+configSchema[i].count*packedSize(configSchema[i])+recordsSize(i+1); }
+constexpr uint32_t schemaHash(byte i=0, uint32_t h=FNV_BASIS){
+ return i>=SCHEMA_FIELDS ? h : schemaHash(i+1, (h^fieldHash(configSchema[i].name, FNV_BASIS)^(configSchema[i].type<<24)^(configSchema[i].size<<8)^configSchema[i].count)*16777619u);
+}
+#define CONFIG_SIZE (sizeof(tconfigheader)+recordsSize())
+
+/* when the partition table has a data partition labelled "config" of at least two sectors, the config is kept there instead of SPIFFS
+ * each sector is a slot holding a complete image behind a sequence number and a CRC, saves erase and write the older slot
+ * and boot loads the valid slot with the highest sequence, so a power loss during a save leaves the previous config intact
+ * e.g. in partitions.csv: config, data, 0x99, , 0x2000,
+*/
+#define CONFIG_PARTITION "config"
+#define CONFIG_SLOT 4096 // one erasable flash sector per slot
+
+typedef struct {
+ uint32_t crc; // CRC32 of everything after it: the sequence and the config image
+ uint32_t sequence; // incremented by every save
+} tslotheader;
+static_assert(sizeof(tslotheader)+CONFIG_SIZE<=CONFIG_SLOT, "the config image no longer fits a flash slot");
+
+uint32_t crc32(const byte *data, size_t length, uint32_t crc=0){ // standard CRC32, a nibble at a time so the table stays small
+ static const uint32_t table[16]={0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+ crc=~crc;
+ while (length--){
+  crc=table[(crc^*data)&15]^(crc>>4);
+  crc=table[(crc^(*data>>4))&15]^(crc>>4);
+  data++;
+ }
+ return ~crc;
+}
+// the static files served from SPIFFS, the ETag of each is the CRC of its content taken when SPIFFS is mounted
+// so revalidating an unchanged file costs a 304 without opening it
+// a gzip copy (index.html.gz) is sent instead to browsers that accept it, its trailer holds the CRC of the content so a stale copy is ignored
+typedef struct {
+ const char *path;
+ const char *type;
+} tasset;
+enum a_asset {a_index, a_icon, a_notfound};
+const tasset assets[]={{"/index.html","text/html"},{"/favicon.ico","image/vnd"},{"/404.html","text/html"}};
+#define ASSETS (sizeof(assets)/sizeof(tasset))
+#define ASSET_PLAIN 1 // the copies of an asset found in SPIFFS
+#define ASSET_GZIP 2
+// small assets are kept in RAM once served, the least recently used ones are dropped to stay within the budget
+#ifndef ASSET_CACHE
+#define ASSET_CACHE 16384 // bytes of asset bodies kept in RAM
+#endif
+#ifndef ASSET_CACHE_FILE
+#define ASSET_CACHE_FILE 4096 // larger files are always streamed from SPIFFS
+#endif
+typedef struct {
+ byte *body; // nullptr while this copy is not cached
+ uint16_t size;
+ uint32_t used; // cacheClock when it was last served
+} tcacheentry;
+// files too large for the cache are sent from run() a send window at a time, so a slow client does not hold up the loop
+// the web server parses the request and runs the handler as before, then the connection is handed to a transfer slot
+#ifndef ASYNC_TRANSFERS
+#define ASYNC_TRANSFERS 4 // files being sent at once, a request beyond that is streamed while it waits
+#endif
+#ifndef ASYNC_BUDGET
+#define ASYNC_BUDGET 10 // ms run() may spend sending files each time it is called
+#endif
+#define ASYNC_BLOCK 1460 // bytes read from SPIFFS at a time
+#define ASYNC_TIMEOUT 10000 // ms a client may take nothing before the transfer is dropped
+typedef struct {
+ File file; // closed while the slot is free
+ WiFiClient client;
+ uint32_t lastMillis; // when the client last took data
+} ttransfer;
+/* startServices moves the web server, OTA and the LED into a task of their own on SERVICE_CORE, Arduino runs loop() on the other core
+ * from then on the services task owns _data, posted changes reach the application as tconfigchange items through a lock-free queue
+ * so loop() is never held up by a request and never reads a field while a post is writing it
+*/
+#ifndef SERVICE_CORE
+#define SERVICE_CORE 0
+#endif
+#ifndef SERVICE_STACK
+#define SERVICE_STACK 8192
+#endif
+#define SERVICE_PRIORITY 1
+#ifndef CHANGE_QUEUE
+#define CHANGE_QUEUE 16 // changes waiting for the application, a power of two, further changes wait in _data until there is room
+#endif
+typedef struct {
+ byte field; // position in configSchema
+ byte index; // element of an indexed field
+ byte value[largestElement()]; // the element in its stored form, as packElement writes it
+} tconfigchange;
+// each side only ever writes its own index, so a release store of the index after the item is all the two tasks need to agree
+template <typename T, uint32_t N> class tSPSCQueue{
+  static_assert((N&(N-1))==0, "the queue size must be a power of two");
+ public:
+  bool push(const T &item){ // producer only, false when full
+   uint32_t h=head.load(std::memory_order_relaxed);
+   if (h-tail.load(std::memory_order_acquire)==N){ return false;}
+   items[h&(N-1)]=item;
+   head.store(h+1, std::memory_order_release);
+   return true;
+  }
+  bool pop(T &item){ // consumer only, false when empty
+   uint32_t t=tail.load(std::memory_order_relaxed);
+   if (head.load(std::memory_order_acquire)==t){ return false;}
+   item=items[t&(N-1)];
+   tail.store(t+1, std::memory_order_release);
+   return true;
+  }
+  uint32_t size(){ return head.load(std::memory_order_acquire)-tail.load(std::memory_order_acquire);}
+ private:
+  T items[N];
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+};
+#define ASSET_MAX_AGE 31536000 // a year, for requests that name the version they want with ?v=
+// the web pages, each route names the method and the login it needs and the tSysConfig member that serves it
+// the table is kept sorted by uri so a request is matched with a binary search rather than a walk of every registered handler
+class tSysConfig;
+typedef void (tSysConfig::*troutehandler)();
+enum r_auth {r_open, r_user}; // r_user routes ask for the userName & userPass login
+typedef struct {
+ const char *uri;
+ HTTPMethod method; // HTTP_ANY accepts every method
+ r_auth auth;
+ troutehandler handler;
+} troute;
+typedef struct {
+ uint32_t hits;
+ uint32_t totalMicros;
+ uint32_t maxMicros;
+} troutestats;
+constexpr int uriCompare(const char *a, const char *b){ return (*a!=*b)||!*a ? (unsigned char)*a-(unsigned char)*b : uriCompare(a+1, b+1);}
+const char *methodName(HTTPMethod method){ // the token of a route method, for the Allow header of a 405
+ switch (method){
+  case HTTP_GET: return "GET";
+  case HTTP_HEAD: return "HEAD";
+  case HTTP_POST: return "POST";
+  case HTTP_PUT: return "PUT";
+  case HTTP_PATCH: return "PATCH";
+  case HTTP_DELETE: return "DELETE";
+  case HTTP_OPTIONS: return "OPTIONS";
+  default: return "";
+ }
+}
+
+// integers of any width, single bytes are unsigned as they hold byte and bool fields
+int64_t loadInt(const byte *p, byte size){
+ switch (size){
+  case 1: return *p;
+  case 2: { int16_t v; memcpy(&v,p,2); return v;}
+  case 4: { int32_t v; memcpy(&v,p,4); return v;}
+  case 8: { int64_t v; memcpy(&v,p,8); return v;}
+ }
+ return 0;
+}
+void storeInt(byte *p, byte size, int64_t v){
+ switch (size){
+  case 1: *p=v; break;
+  case 2: { int16_t x=v; memcpy(p,&x,2); break;}
+  case 4: { int32_t x=v; memcpy(p,&x,4); break;}
+  case 8: memcpy(p,&v,8); break;
+ }
+}
+
 class tSysConfig{
  private:
    // LED information for heartbeat LED
@@ -177,6 +871,20 @@ class tSysConfig{
   long lastConnectMillis;
  // network scanning info
   bool STAconnected=false;
+  uint32_t wifiReconnects=0; // times the station link came back after it was lost
+  w_state wifiState=w_idle;
+  uint32_t wifiStateMillis; // millis() when wifiState was entered
+  uint32_t wifiBackoff=WIFI_BACKOFF;
+  bool wifiEverConnected=false;
+  bool softAPup=false;
+  int wifiJob=NO_JOB;
+  tcandidate candidates[WIFI_CANDIDATES];
+  byte candidateCount=0;
+  byte candidate=0; // the one being tried
+  byte connectingAP=0; // index into AccessPoints of the attempt under way
+  bool cachedLease=false; // the station has the cached address set rather than asking DHCP
+  uint32_t connectStart=0; // millis() when the station started looking for a connection
+  uint32_t connectTime=0; // ms the last connection took
   int32_t n=-2;
   String ssid;
   uint8_t encryptionType;
@@ -196,6 +904,20 @@ class tSysConfig{
   s_class inSelect; // if we are in a select group we need to know the class so it processes the correct information
   bool inOptgroup;
   bool lightHTML;
+ // deferred saving of the config
+  bool commitPending=false;
+ // the scheduler behind run()
+  tjob jobs[JOBS];
+  uint32_t nextDue=0; // the earliest deadline of the armed jobs
+  int ledJob=NO_JOB;
+  int commitJob=NO_JOB;
+#if LOOP_STATS
+  thistogram runStats; // the passes of run() that ran a job
+  uint32_t idlePasses=0; // passes with nothing due, these are not timed
+  uint32_t statsOverhead=0; // cycles the timing adds to each job
+  char command[16]; // serial command being typed
+  byte commandLength=0;
+#endif
   public:
   int32_t configPin = 1;
   char *author;
@@ -205,6 +927,29 @@ class tSysConfig{
   int32_t major;
   int32_t minor;
   bool hasBluetooth=true;
+  bool configMigrated=false; // the last config read was written by older firmware and is saved again in the current layout
+  uint32_t journalBytes=NO_JOURNAL; // size of the journal behind the records of config.bin
+  const esp_partition_t *configPartition=nullptr; // the flash slots, nullptr when the config is kept in SPIFFS
+  bool fsMounted=false; // SPIFFS came up, the flash slots are read without it
+  byte configSlot=1; // the slot holding the current config, saves go to the other one
+  uint32_t slotSequence=0;
+  uint32_t commitDelay=COMMIT_DELAY; // debounce window of commitConfig
+  uint32_t burnsAvoided=0; // commits that found the config unchanged and wrote nothing, counted alongside burncount
+  uint32_t cacheHits=0; // assets served from RAM
+  uint32_t cacheMisses=0; // assets read from SPIFFS
+  bool asyncFiles=true; // large files are sent from run() rather than blocking the handler until the client has them
+  uint32_t asyncBudget=ASYNC_BUDGET;
+  uint32_t liveGeneration=0; // bumped whenever data.json changes without a config write, part of its ETag
+  uint32_t liveCRC=0; // the live state data.json last reported
+  uint32_t assetTags[ASSETS]; // CRC of the uncompressed content of each asset
+  byte assetFiles[ASSETS]; // ASSET_PLAIN and ASSET_GZIP of the copies present, 0 when the asset is missing
+  tcacheentry assetCache[ASSETS*2]={}; // the plain and the gzip copy of each asset
+  uint32_t cacheBytes=0;
+  ttransfer transfers[ASYNC_TRANSFERS];
+  uint32_t cacheClock=0;
+  TaskHandle_t serviceTask=nullptr; // nullptr while the services run from run()
+  bool changesPending=false; // _data holds posted values the application has not been sent
+  tSPSCQueue<tconfigchange, CHANGE_QUEUE> changes;
   // the sensor classes are for future use
   eSensorClass SensorClass=s_undefined;
   String SensorName;
@@ -213,7 +958,7 @@ class tSysConfig{
 // this is API to the Config system but the only routines that the user is required to utilize are tSysConfig(); & run();
 // if desired, the device name can be changed prior to calling init
  htmlproperties webobj;
- WebServer server;
+ tWebServer server;
  WiFiMulti multiWiFi;
  WiFiUDP udp; 
  /* this is meant to engage an automated Configuration mode that connects to a predefined WiFi and then calls some functions to get the logo, CSS, about, help and initConfig files 
@@ -221,23 +966,58 @@ class tSysConfig{
  * firstrun also exposes the AP with the default device name in the format of TRL-xxxxxx with the password of TRLinitialize
  */ 
  void initNTP(); // time system
- void initWiFi();
- void scanWiFi();
+ void initWiFi(); // brings up the access point and starts the station connecting, without waiting for it
+ void scanWiFi(); // looks for the configured access points again and connects to the strongest, in the background
  void initWebserver(); // sets up the network and servers
  bool readConfig();// reads from the Configuration file, also enters system defaults to complete initialization routines
  void initConfig();// reads the Configuration file, also responsiible for calling firstrun if the Config files do not exist
  bool writeConfig();// writes to the Configuration file
+ void assetsChanged(); // call after writing files to SPIFFS, works out the ETags again and empties the asset cache
+ void commitConfig();// requests a save, run() writes it once no further request has come in for commitDelay
+ bool flushConfig();// writes a requested save now, skipping the write if nothing changed
+ bool configChanged();// true when the config differs from the one in flash
  void updateConfig();// reinitialize the unit
  void OTAinit(); // Over the air update system management
  void blink(); 
  void init(); // startup code
- void run(); // called from the loop code to maintain periodic functions
+ uint32_t run(); // called from the loop code to maintain periodic functions, returns the ms until something is next due
+ uint32_t service(); // one pass of the periodic functions, from run() or the services task
+ void initJobs(); // schedules the periodic functions of the system
+ // jobs are added before startServices, after that the services task owns the table
+ int schedule(const char *name, TJobFunction job, uint32_t period, uint32_t delay=0); // the id of the job, NO_JOB when the table is full
+ void setPeriod(int id, uint32_t period);
+ void wake(int id, uint32_t delay=0); // the job next runs delay ms from now, a one-shot job is armed for that one run
+ void cancel(int id);
+ uint32_t runJobs(); // runs the jobs that are due, returns the ms until the next one
+ void OTAhandle();
+ void stepWiFi(); // one step of the station state machine, run by the WiFi job
+ void setWiFiState(w_state state);
+ uint32_t wifiPeriod(); // the pace of the WiFi job in the current state
+ void pickCandidates(int found); // the configured access points among the scan results, strongest first
+ bool resumeWiFi(); // joins the access point of the last connection directly, false when nothing is cached
+ void onConnected();
+ void getMetrics(); // /metrics, device health for Prometheus
+#if LOOP_STATS
+ void metricsSummary(tMetricsWriter &metrics, const char *name, const char *labels, const thistogram &h); // quantiles, sum and count in seconds
+#endif
+#if LOOP_STATS
+ bool serialCommands=true; // run() reads commands from Serial, clear it if the sketch reads Serial itself
+ void loopReport(Print &out); // the timing histograms as a text table
+ void clearStats();
+ void serialCommand();
+ void getLoopStats(); // /loop.txt
+#endif
+ bool startServices(); // optional, call after init to run the services in their own task, run() then returns at once
+ static void serviceLoop(void *config);
+ void publishChanges(); // queues the elements of _data that differ from _published
+ bool nextChange(tconfigchange &change){ return changes.pop(change);} // for loop() once the services task runs, false when nothing changed
+ void applyChange(const tconfigchange &change, dataframe &frame); // writes a change into the application's copy of the config
  // there are lots of web functions as this is a web based Configuration program
  // procedures to handle forms
- boolean isinteger(String str); 
- boolean isFloat(String str);
- boolean isTime(String str);
- boolean isIP(String str);
+ boolean isinteger(const String &str);
+ boolean isFloat(const String &str);
+ boolean isTime(const String &str);
+ boolean isIP(const String &str);
 
  // copy values from post function is overloaded and has default parameters, if min-max are equal, range is ignored otherwise range checking is used
  int32_t copyval(byte &var, char const *name, byte min=0, byte max=0);
@@ -247,13 +1027,38 @@ class tSysConfig{
  int32_t copyval(time_t &var, char const *name);
  int32_t copyval(bool &var, char const *name); // checkbox is unlike other fields, if its checked, it is included otherwise the field is not returned at all by the form post
  int32_t copyIP(IPAddress &var, char const *name);
+ // the conversions behind copyval, V is the posted value
+ int32_t setval(byte &var, const String &V, byte min=0, byte max=0);
+ int32_t setval(int32_t &var, const String &V, int32_t min=0, int32_t max=0);
+ int32_t setval(float &var, const String &V, float min=0, float max=0);
+ int32_t setval(char* var, const String &V, int32_t size, int32_t min=0);
+ int32_t setval(time_t &var, const String &V);
+ // schema driven processing of the config data
+ void defaultConfig(); // loads the factory defaults of every field
+ void packConfig(byte *image); // builds the config.bin image of CONFIG_SIZE bytes
+ uint16_t packElement(const tfield &f, byte index, byte *value, dataframe &frame=_data); // the stored form of one element
+ bool loadConfig(const byte *image, size_t size); // validates a config.bin image and loads it, migrating older layouts and replaying the journal
+ bool saveConfig(); // writes a whole config.bin, replacing the journal
+ bool appendConfig(); // journals the elements that differ from the saved config, false if a whole file has to be written instead
+ bool readSlots(); // loads the newest valid flash slot
+ bool writeSlot(); // saves the config into the older flash slot
+ const tfield *recordField(uint32_t name, byte hint); // the field a stored name hash belongs to, hint is the field it should be while the schema is unchanged
+ void migrateField(const tfield &f, byte index, const byte *value, byte type, uint16_t size); // copies one stored element into the field, converting it to the field's type and size
+ const tfield *findField(const char *name, byte &index); // resolves a posted name such as SSID_3 to its field and element, nullptr if it is not in the schema
+ void postField(const tfield &f, byte index, const String &V);
+ void postConfig(); // copies every posted field of the config form in one pass over the posted arguments
+ uint32_t jsonSelection(); // the mask of the sections named by the sections argument, all of them when there is none
+ bool jsonUnchanged(); // sends the ETag of data.json and a 304 if the browser already holds that version
+ void jsonSysInfo(tJSONWriter &json);
+ void jsonSection(tJSONWriter &json, const char *key, byte section); // adds one json array of config values
+ void jsonValue(tJSONWriter &json, const tfield &f, byte index);
 
  // form creation support
  void framehead();// to provide the header for all frame pages
  bool form(htmlproperties obj);// all forms are post request only
  bool form(); // if the buttoncaption is not included, then the standard send button is created
- void tab(char* tag);
- void fieldset(char* tag); // use to create groupboxes on the form
+ void tab(char const *tag);
+ void fieldset(char const *tag); // use to create groupboxes on the form
  void fieldset();
  void label(htmlproperties obj);
  bool edit(htmlproperties obj, char* data, int32_t size);
@@ -276,11 +1081,11 @@ class tSysConfig{
  bool optiongroup(char const *name); //groups a value list
  bool optiongroup(); //terminates the group
 
- bool option(bool data, char *name);
- bool option(byte data, char *name);
- bool option(int32_t data, char *name);
- bool option(float data, char *name);
- bool option(char* data, char *name);
+ bool option(bool data, char const *name);
+ bool option(byte data, char const *name);
+ bool option(int32_t data, char const *name);
+ bool option(float data, char const *name);
+ bool option(char* data, char const *name);
  bool checkbox(htmlproperties obj, bool &data);
  bool checkbox(htmlproperties obj, int32_t &data);
  bool checkbox(htmlproperties obj, char* data, int32_t size);
@@ -305,16 +1110,43 @@ class tSysConfig{
  void drawGraph();// draws the actual image 
  void getIcon();
  void indexPage(void);
+ void hashAssets(); // works out the ETags of the assets
+ void sendAsset(a_asset asset, int code=200); // streams an asset or answers 304 when the browser already has it
+ bool cacheAsset(tcacheentry &c, File &dataFile); // reads a small asset into the cache, false when it is streamed instead
+ void clearCache();
+ bool sendAsync(File &dataFile, const char *type, int code, bool gzip); // sends the headers and leaves the body to run(), false when no slot is free
+ void runTransfers(); // sends what the clients of the transfers will take, within asyncBudget
+ void endTransfer(ttransfer &t);
+ void dropAssets(); // forgets the cached assets and their ETags while SPIFFS is being replaced
  
+ bool webAuth(); // used by restricted Configuration pages
+ void dispatch(); // serves a request from the route table
  void handleNotFound();
  // to support a Configuration application, we have the JSON data exchanges, there are no individual pages in the JSON processing
  void getJSON();// format bytes
 };
 
+constexpr troute routes[]={
+ {"/", HTTP_ANY, r_open, &tSysConfig::indexPage},
+ {"/data.json", HTTP_GET, r_open, &tSysConfig::getJSON},
+ {"/favicon.ico", HTTP_ANY, r_open, &tSysConfig::getIcon},
+ {"/index", HTTP_ANY, r_open, &tSysConfig::indexPage},
+ {"/index.htm", HTTP_ANY, r_open, &tSysConfig::indexPage},
+ {"/index.html", HTTP_ANY, r_open, &tSysConfig::indexPage},
+#if LOOP_STATS
+ {"/loop.txt", HTTP_GET, r_user, &tSysConfig::getLoopStats},
+#endif
+ {"/metrics", HTTP_GET, r_open, &tSysConfig::getMetrics}
+};
+#define ROUTES (sizeof(routes)/sizeof(troute))
+constexpr bool routesSorted(size_t i){ return (i+1>=ROUTES)||((uriCompare(routes[i].uri, routes[i+1].uri)<0)&&routesSorted(i+1));}
+static_assert(routesSorted(0), "routes must be sorted by uri");
+troutestats routeStats[ROUTES]; // requests served and time taken by each route
+
 void tSysConfig::blink() {
  int32_t t=SLOW_BLINK;
 if (blinkstate>3) {t=FAST_BLINK;}
- if (currentMillis - lastBlinkMillis > t)
+ if (currentMillis - lastBlinkMillis >= t)
  {
  LEDstate++;
  if (LEDstate>31){LEDstate=0;}
@@ -333,41 +1165,311 @@ if (blinkstate>3) {t=FAST_BLINK;}
 }
 
 bool tSysConfig::readConfig(){
-// read the parameters from flash
- Serial.println("Opening SPIFFS /config.bin");
- File ConfigFile = SPIFFS.open("/config.bin", "r");
- if (!ConfigFile) {
- Serial.println("Failed to open Config file, attempting to load manufacturer's configuration");
- ConfigFile = SPIFFS.open("/defaults.bin", "r");
- if (!ConfigFile) {Serial.println("No manufacturers config file"); return false;}
- }
-size_t size = ConfigFile.size();
- if (size != sizeof(_data)) {
- Serial.println("Config file size is invalid");
- Serial.print(size);
- Serial.println(":file size");
- ConfigFile.close();
- return false;
+// read the parameters from flash, the manufacturer's configuration is used when there is no valid config file
+ if (configPartition && readSlots()){
+  if (_data.OTA==3){_data.OTA=4;}// ensures OTA is off at reboot
+  return true;
+ }
+ if (!fsMounted){ return false;}
+ // a compaction that was cut short leaves its complete copy in config.tmp
+ const char *files[]={"/config.bin","/config.tmp","/defaults.bin"};
+ for (byte i=0;i<3;i++){
+  Serial.print("Opening SPIFFS ");
+  Serial.println(files[i]);
+  File ConfigFile = SPIFFS.open(files[i], "r");
+  if (!ConfigFile) { Serial.println("Failed to open Config file"); continue;}
+  size_t size = ConfigFile.size();
+  byte *image=(byte*)malloc(size);
+  if (!image){ ConfigFile.close(); return false;}
+  bool valid=ConfigFile.read(image, size)==size;
+  ConfigFile.close();
+  valid=valid && loadConfig(image, size);
+  free(image);
+  if (valid){
+   if ((i>0)||configMigrated){ journalBytes=NO_JOURNAL;}
+   if (configPartition){ configMigrated=true;} // moves into the flash slots
+   if (_data.OTA==3){_data.OTA=4;}// ensures OTA is off at reboot
+   return true;
+  }
+  Serial.println("Config file is invalid");
+  Serial.print(size);
+  Serial.println(":file size");
  }
- ConfigFile.read((byte*) &_data, sizeof(_data));
- ConfigFile.close();
- if (_data.OTA==3){_data.OTA=4;}// ensures OTA is off at reboot
- return true;
+ return false;
 }  
 bool tSysConfig::writeConfig() {
- File configFile = SPIFFS.open("/config.bin", "w");
+ ++_data.burncount;
+ _data.burntime=time(nullptr);
+ if (configPartition){ return writeSlot();}
+ if ((journalBytes!=NO_JOURNAL)&&appendConfig()){ return true;}
+ return saveConfig();
+}
+
+bool tSysConfig::readSlots() {
+ byte *image=(byte*)malloc(CONFIG_SLOT);
+ if (!image) {return false;}
+ tslotheader slot[2];
+ for (byte i=0;i<2;i++){
+  if (esp_partition_read(configPartition, i*CONFIG_SLOT, &slot[i], sizeof(tslotheader))!=ESP_OK){ slot[i].sequence=0;}
+ }
+ // the newer slot is tried first, the other one is the fallback when it did not pass its CRC
+ byte first=(slot[1].sequence>slot[0].sequence) ? 1 : 0;
+ for (byte k=0;k<2;k++){
+  byte i=first^k;
+  tconfigheader header;
+  if (esp_partition_read(configPartition, i*CONFIG_SLOT, image, CONFIG_SLOT)!=ESP_OK){ continue;}
+  memcpy(&slot[i], image, sizeof(tslotheader));
+  memcpy(&header, image+sizeof(tslotheader), sizeof(header));
+  if ((header.magic!=CONFIG_MAGIC)||(header.length>CONFIG_SLOT-sizeof(tslotheader)-sizeof(header))){ continue;}
+  size_t length=sizeof(header)+header.length;
+  if (crc32(image+4, 4+length)!=slot[i].crc){ continue;}
+  if (loadConfig(image+sizeof(tslotheader), length)){
+   configSlot=i;
+   slotSequence=slot[i].sequence;
+   free(image);
+   return true;
+  }
+ }
+ free(image);
+ return false;
+}
+
+bool tSysConfig::writeSlot() {
+ byte *image=(byte*)malloc(sizeof(tslotheader)+CONFIG_SIZE);
+ if (!image) {return false;}
+ tslotheader slot={0, slotSequence+1};
+ packConfig(image+sizeof(tslotheader));
+ memcpy(image+4, &slot.sequence, 4);
+ slot.crc=crc32(image+4, 4+CONFIG_SIZE);
+ memcpy(image, &slot.crc, 4);
+ byte target=configSlot^1;
+ bool written=(esp_partition_erase_range(configPartition, target*CONFIG_SLOT, CONFIG_SLOT)==ESP_OK)&&
+  (esp_partition_write(configPartition, target*CONFIG_SLOT, image, sizeof(tslotheader)+CONFIG_SIZE)==ESP_OK);
+ free(image);
+ if (!written) {
+  Serial.println("Failed to write config slot");
+  return false;
+ }
+ configSlot=target;
+ slotSequence=slot.sequence;
+ _saved=_data;
+ Serial.print("config slot written ");
+ Serial.println(target);
+ return true;
+}
+
+void tSysConfig::commitConfig() {
+ liveGeneration++; // the posted values are served before the write that moves burncount
+ commitPending=true;
+ changesPending=true;
+ wake(commitJob, commitDelay); // a later request moves the write back again
+}
+
+bool tSysConfig::flushConfig() {
+ commitPending=false;
+ liveGeneration++; // burnsAvoided is reported in sysInfo
+ if (!configChanged()){
+  burnsAvoided++;
+  Serial.print("Config unchanged, writes avoided:");
+  Serial.println(burnsAvoided);
+  return true;
+ }
+ return writeConfig();
+}
+
+bool tSysConfig::configChanged() {
+ byte value[largestElement()];
+ byte saved[largestElement()];
+ for (byte i=0;i<SCHEMA_FIELDS;i++){
+  const tfield &f=configSchema[i];
+  if (bookkeeping(f)){ continue;}
+  for (byte n=0;n<f.count;n++){
+   uint16_t size=packElement(f, n, value);
+   packElement(f, n, saved, _saved);
+   if (memcmp(value, saved, size)!=0){ return true;}
+  }
+ }
+ return false;
+}
+
+bool tSysConfig::saveConfig() {
+ byte *image=(byte*)malloc(CONFIG_SIZE);
+ if (!image) {return false;}
+ // the new file is completed under another name so a power loss never leaves a partial config.bin
+ File configFile = SPIFFS.open("/config.tmp", "w");
  if (!configFile) {
  Serial.println("Failed to open config file for writing");
+ free(image);
  return false;
  }
- ++_data.burncount;
- _data.burntime=time(nullptr);
- configFile.write((byte*) &_data, sizeof(_data));
+ packConfig(image);
+ bool written=configFile.write(image, CONFIG_SIZE)==CONFIG_SIZE;
  configFile.close();
- SPIFFS.end();
- SPIFFS.begin();
+ free(image);
+ if (!written) {return false;}
+ SPIFFS.remove("/config.bin");
+ SPIFFS.rename("/config.tmp", "/config.bin");
+ _saved=_data;
+ journalBytes=0;
  Serial.println("config.bin written");
- return readConfig();
+ return true;
+}
+
+bool tSysConfig::appendConfig() {
+ byte *journal=(byte*)malloc(CONFIG_JOURNAL_LIMIT);
+ if (!journal) {return false;}
+ byte value[largestElement()];
+ byte saved[largestElement()];
+ size_t length=0;
+ for (byte i=0;i<SCHEMA_FIELDS;i++){
+  const tfield &f=configSchema[i];
+  for (byte n=0;n<f.count;n++){
+   uint16_t size=packElement(f, n, value);
+   packElement(f, n, saved, _saved);
+   if (memcmp(value, saved, size)==0){ continue;}
+   if (length+sizeof(tjournalentry)+size+4>CONFIG_JOURNAL_LIMIT){ free(journal); return false;}
+   tjournalentry entry={fieldHash(f.name, FNV_BASIS), f.type, n, size};
+   byte *start=journal+length;
+   memcpy(journal+length, &entry, sizeof(entry));
+   length+=sizeof(entry);
+   memcpy(journal+length, value, size);
+   length+=size;
+   uint32_t crc=crc32(start, sizeof(entry)+size);
+   memcpy(journal+length, &crc, 4);
+   length+=4;
+  }
+ }
+ File configFile = SPIFFS.open("/config.bin", "a");
+ bool written=configFile && (configFile.write(journal, length)==length);
+ if (configFile) {configFile.close();}
+ free(journal);
+ if (!written) {return false;}
+ _saved=_data;
+ journalBytes+=length;
+ Serial.print("config.bin journaled ");
+ Serial.println(length);
+ return true;
+}
+
+uint16_t tSysConfig::packElement(const tfield &f, byte index, byte *value, dataframe &frame){
+ if (f.type==t_ip){
+  uint32_t address=fieldRef<IPAddress>(f, index, frame);
+  memcpy(value, &address, 4);
+  return 4;
+ }
+ memcpy(value, &fieldRef<byte>(f, index, frame), f.size);
+ return f.size;
+}
+
+void tSysConfig::packConfig(byte *image){
+ tconfigheader header={CONFIG_MAGIC, CONFIG_VERSION, SCHEMA_FIELDS, schemaHash(), recordsSize(), 0};
+ byte *p=image+sizeof(header);
+ for (byte i=0;i<SCHEMA_FIELDS;i++){
+  const tfield &f=configSchema[i];
+  tconfigrecord record={fieldHash(f.name, FNV_BASIS), f.type, f.count, packedSize(f)};
+  memcpy(p, &record, sizeof(record));
+  p+=sizeof(record);
+  for (byte n=0;n<f.count;n++){ p+=packElement(f, n, p);}
+ }
+ header.crc=crc32(image+sizeof(header), header.length);
+ memcpy(image, &header, sizeof(header));
+ _data.checksum=header.crc;
+}
+
+const tfield *tSysConfig::recordField(uint32_t name, byte hint){
+ if ((hint<SCHEMA_FIELDS)&&(fieldHash(configSchema[hint].name, FNV_BASIS)==name)){ return &configSchema[hint];}
+ for (byte i=0;i<SCHEMA_FIELDS;i++){
+  if (fieldHash(configSchema[i].name, FNV_BASIS)==name){ return &configSchema[i];}
+ }
+ return nullptr;
+}
+
+bool tSysConfig::loadConfig(const byte *image, size_t size){
+ tconfigheader header;
+ if (size>=sizeof(header)){ memcpy(&header, image, sizeof(header));}
+ if ((size>=sizeof(header))&&(header.magic==CONFIG_MAGIC)){
+  if ((header.version!=CONFIG_VERSION)||(header.length>size-sizeof(header))){ return false;}
+  const byte *p=image+sizeof(header);
+  const byte *end=p+header.length;
+  if (crc32(p, header.length)!=header.crc){ return false;}
+  configMigrated=header.schema!=schemaHash();
+  if (configMigrated){ Serial.println("Config written by an older schema, migrating");}
+  defaultConfig();
+  for (uint16_t r=0;r<header.records;r++){
+   tconfigrecord record;
+   if ((size_t)(end-p)<sizeof(record)){ return false;}
+   memcpy(&record, p, sizeof(record));
+   p+=sizeof(record);
+   if ((size_t)(end-p)<(size_t)record.count*record.size){ return false;}
+   // while the schema is unchanged record r is field r, otherwise the field is found by name
+   const tfield *f=recordField(record.name, r);
+   if (f){
+    for (byte n=0;(n<f->count)&&(n<record.count);n++){ migrateField(*f, n, p+n*record.size, record.type, record.size);}
+   }
+   p+=record.count*record.size;
+  }
+  // the journal is replayed up to the first entry that fails its CRC, that and anything after it was cut short
+  end=image+size;
+  journalBytes=0;
+  while ((size_t)(end-p)>=sizeof(tjournalentry)+4){
+   tjournalentry entry;
+   memcpy(&entry, p, sizeof(entry));
+   uint32_t crc;
+   if ((size_t)(end-p)<sizeof(entry)+entry.size+4){ break;}
+   memcpy(&crc, p+sizeof(entry)+entry.size, 4);
+   if (crc32(p, sizeof(entry)+entry.size)!=crc){ break;}
+   const tfield *f=recordField(entry.name, NO_FIELD);
+   if (f && (entry.index<f->count)){ migrateField(*f, entry.index, p+sizeof(entry), entry.type, entry.size);}
+   p+=sizeof(entry)+entry.size+4;
+   journalBytes+=sizeof(entry)+entry.size+4;
+  }
+  if (p!=end){
+   Serial.println("Config journal is incomplete");
+   journalBytes=NO_JOURNAL; // appending after the damaged entry would hide the new entries, the next save rewrites the file
+  }
+  _data.checksum=header.crc;
+  _saved=_data;
+  return true;
+ }
+ if (size==CONFIG_LEGACY_SIZE){ // version 0, a raw copy of dataframe
+  Serial.println("Config written before versioning, migrating");
+  configMigrated=true;
+  defaultConfig();
+  for (byte i=0;i<SCHEMA_FIELDS;i++){
+   const tfield &f=configSchema[i];
+   for (byte n=0;n<f.count;n++){ migrateField(f, n, image+f.offset+n*f.stride, f.type, f.size);}
+  }
+  journalBytes=NO_JOURNAL;
+  _saved=_data;
+  return true;
+ }
+ return false;
+}
+
+void tSysConfig::migrateField(const tfield &f, byte index, const byte *value, byte type, uint16_t size){
+ byte *field=&fieldRef<byte>(f,index);
+ switch (f.type){
+  case t_text: {
+   if (type!=t_text){ return;}
+   size_t length=strnlen((const char*)value, size);
+   if (length>=f.size){ length=f.size-1;}
+   memcpy(field, value, length);
+   field[length]=0;
+   break;
+  }
+  case t_float:
+   if ((type==t_float)&&(size==f.size)){ memcpy(field, value, size);}
+   break;
+  case t_ip:
+   if (type!=t_ip){ return;}
+   if (size==4){ uint32_t address; memcpy(&address, value, 4); fieldRef<IPAddress>(f,index)=IPAddress(address);}
+   // a version 0 image holds the whole object, its vtable pointer belongs to the firmware that wrote it and is not copied
+   else { fieldRef<IPAddress>(f,index)=IPAddress((uint32_t)*reinterpret_cast<const IPAddress*>(value));}
+   break;
+  default: // the integer types convert between widths
+   if ((type==t_text)||(type==t_float)||(type==t_ip)||(size>8)){ return;}
+   storeInt(field, f.size, loadInt(value, size));
+ }
 }
 
 void tSysConfig::updateConfig() {
@@ -375,12 +1477,14 @@ void tSysConfig::updateConfig() {
 }
 
 void tSysConfig::OTAinit(){ 
- ArduinoOTA.onStart([]() {
+ ArduinoOTA.onStart([&]() {
  String type;
  if (ArduinoOTA.getCommand() == U_FLASH)
   type = "sketch";
- else // U_SPIFFS
+ else { // U_SPIFFS
   type = "filesystem";
+  dropAssets(); // nothing cached or revalidated from the files being replaced
+ }
  // NOTE: if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
  Serial.println("Start updating " + type);
  });
@@ -403,87 +1507,36 @@ void tSysConfig::OTAinit(){
 }
  
 void tSysConfig::initConfig() {
- if(!SPIFFS.begin())
- {
- Serial.println("SPIFFS Initialization...failed");
- } else { 
+ configPartition=esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CONFIG_PARTITION);
+ if (configPartition && (configPartition->size<2*CONFIG_SLOT)){ configPartition=nullptr;}
+ fsMounted=SPIFFS.begin();
+ if (!fsMounted){ Serial.println("SPIFFS Initialization...failed");}
+ else { hashAssets();}
+ // the slots are read whether or not SPIFFS came up, only the file fallbacks need it
  readConfig();
  Serial.print("Last Config:");
  Serial.println(_data.burntime);
  Serial.print("Burn count:");
  Serial.println(_data.burncount);
- }
+ if (configMigrated){ writeConfig();} // upgrade the file in place so the next boot reads it directly
  if (_data.burncount == 0) {
  Serial.print("Init failure: ");
  // initialize the flash memory
- strlcpy(_data.AccessPoints[0].WiFiname,"DEFAULT",32);
- strlcpy(_data.AccessPoints[0].WiFipassword,"DEFAULT",32);
- strlcpy(_data.APname,"TRL_Device",32);
- strlcpy(_data.APpassword,"12345678",32);
+ defaultConfig();
 // Set a static ip address for the Access point mode
 // This can be used to directly connect to it instead of having to have a local network
  _data.ip = ip;
  _data.gateway = gateway;
  _data.subnet = subnet;
- _data.APchannel = APchannel;
-  strlcpy(_data.BLEname,"TRL_Device",32);
- strlcpy(_data.BLEpassword,"1111",32);
- strlcpy(_data.userName,"admin",32);
- strlcpy(_data.userPass,"admin",32);
- _data.ConfigPage=1;// always available
- _data.BLEConfig=1; // always on
- _data.APconfig=1; // softap is always available
- _data.sensorConfig=2; // heating
- _data.timerConfig=2; //defaults to timer only mode
- strlcpy(_data.NTPserver,"north-america.pool.ntp.org",128);
- 
- _data.TZ=120; // defaults to GMT
- _data.DST=60;
- _data.setPoint=0; // also used as setPoint for PID loops
- _data.rangeValue=0;
- _data.iceGuard=0; //used by heating and cooling to prevent icing, must be >0 to be active
- _data.activeHigh=false; // heating activates when temperature drops below the lower trigger value
- _data.PIDcontrolled=true; // if running on a PID, the value used for setPoint is setPoint*/
- // initialize the timers to zero hours on zero days
-  for ( byte i = 0; i < 5; i++ ) {
-  _data.timers[i].startTime=86400;
-  _data.timers[i].endTime=86400;
- }
  Serial.println("Default parameters loaded");
  } 
 }
 void tSysConfig::initWiFi(){
- byte retries = 0;
  WiFi.mode(WIFI_AP_STA);
  WiFi.disconnect();
- // scan for available networks
- scanWiFi();
- for ( byte i = 0; i < 5; i++ ) {
- multiWiFi.addAP(_data.AccessPoints[i].WiFiname, _data.AccessPoints[i].WiFipassword);
- }
+ WiFi.setAutoReconnect(false); // stepWiFi() finds the strongest access point again instead
  WiFi.beginSmartConfig();
 
- // WiFi.begin(_data.AccessPoints[0].WiFiname, _data.AccessPoints[0].WiFipassword); 
- // wait for connection here
- while ((multiWiFi.run() != WL_CONNECTED) && (retries<30)) {
- delay(500);
- Serial.print(".");
- ++retries;
- }
- if (WiFi.status() == WL_CONNECTED){
- STAconnected=true;
- Serial.println("");
- Serial.println(F("WiFi connected"));
- Serial.println(F("IP address: "));
- Serial.println(WiFi.localIP());
- /*Serial.println(F("Starting Time UDP"));
- udp.begin(localPort);
- Serial.print(F("Local port: "));
- Serial.println(udp.localPort());*/
- }
- else{
- Serial.println(F("WiFi failed to connect"));
- }
  WiFi.softAPConfig(_data.ip,_data.gateway,_data.subnet);
  // check if wifi is connected and what the AP rules are
  // Turn on local Access point
@@ -502,7 +1555,7 @@ void tSysConfig::initWiFi(){
    // give DNS servers to AP side
   /* dhcps_set_dns(0, WiFi.dnsIP(0));
    dhcps_set_dns(1, WiFi.dnsIP(1));*/
-   WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel);
+   softAPup=WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel);
   /* err_t ret = ip_napt_init(NAPT, NAPT_PORT);
    if (ret == ERR_OK) {
     ret = ip_napt_enable_no(SOFTAP_IF, 1);
@@ -513,8 +1566,12 @@ void tSysConfig::initWiFi(){
  }
  case 4: {}// mesh mode
  }
-if (WiFi.status() != WL_CONNECTED){ 
-  WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel); 
+ bool configured=false;
+ for ( byte i = 0; i < 5; i++ ) { configured|=_data.AccessPoints[i].WiFiname[0]!=0;}
+ if (!configured){ setWiFiState(w_idle);}
+ else if (!resumeWiFi()){ scanWiFi();}
+if (!softAPup&&!configured){ // nothing to connect to, the AP is the only way in
+  softAPup=WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel); 
   Serial.println(F("WiFi AP started"));} 
   Serial.println(_data.APname);
   Serial.println(_data.APpassword);
@@ -526,17 +1583,43 @@ void tSysConfig::initNTP() {
 }
 
 void tSysConfig::initWebserver() {
- server.on("/", [&]{ indexPage(); });
- server.on("/index", [&]{ indexPage(); });
- server.on("/index.htm", [&]{ indexPage(); });
- server.on("/index.html", [&]{ indexPage(); });
-
- server.on("/favicon.ico", [&] { getIcon();} );
- server.on("/data.json", [&]{ getJSON();} );
+ // every request falls through to the route table, see routes
+ const char *headers[]={"If-None-Match", "Accept-Encoding"}; // the web server only keeps the request headers it is asked for, data.json and the assets revalidate
+ server.collectHeaders(headers, 2);
  
- server.onNotFound([&](){ handleNotFound(); });
+ server.onNotFound([&](){ dispatch(); });
  server.begin();
- Serial.println('server startup');
+ Serial.println("server startup");
+}
+
+void tSysConfig::dispatch(){
+ const String &uri=server.uri();
+ int lo=0;
+ int hi=ROUTES-1;
+ while (lo<=hi){
+  int mid=(lo+hi)/2;
+  int c=strcmp(uri.c_str(), routes[mid].uri);
+  if (c<0){ hi=mid-1;}
+  else if (c>0){ lo=mid+1;}
+  else {
+   const troute &r=routes[mid];
+   if ((r.method!=HTTP_ANY)&&(r.method!=server.method())){
+    // the path exists, so the client is told the method it takes rather than that there is nothing here
+    server.sendHeader("Allow", methodName(r.method));
+    return server.send(405);
+   }
+   if ((r.auth==r_user)&&!webAuth()){ return server.requestAuthentication();}
+   troutestats &s=routeStats[mid];
+   uint32_t start=micros();
+   (this->*r.handler)();
+   uint32_t t=micros()-start;
+   s.hits++;
+   s.totalMicros+=t;
+   if (t>s.maxMicros){ s.maxMicros=t;}
+   return;
+  }
+ }
+ handleNotFound();
 }
 
 
@@ -556,13 +1639,69 @@ void tSysConfig::init() {
  Serial.print(" @ ");
  Serial.println(__TIME__);
   initConfig();
+ liveGeneration=esp_random(); // a browser holding data.json from before a restart must not match
  initWiFi();
  initWebserver();
  initNTP();
  OTAinit(); // OTA update services 
+ initJobs();
+}
+
+uint32_t tSysConfig::run() {
+ if (serviceTask){ return JOB_IDLE;}
+ return service();
 }
 
-void tSysConfig::run() {
+bool tSysConfig::startServices() {
+ if (serviceTask){ return true;}
+ _published=_data; // the application starts out with the config as init left it
+ return xTaskCreatePinnedToCore(serviceLoop, "sysConfig", SERVICE_STACK, this, SERVICE_PRIORITY, &serviceTask, SERVICE_CORE)==pdPASS;
+}
+
+void tSysConfig::serviceLoop(void *config) {
+ tSysConfig *sys=(tSysConfig*)config;
+ for (;;){
+  uint32_t wait=sys->service();
+  vTaskDelay(wait>portTICK_PERIOD_MS ? wait/portTICK_PERIOD_MS : 1); // at least a tick, so the idle task of this core can feed the task watchdog
+ }
+}
+
+void tSysConfig::publishChanges() {
+ tconfigchange change;
+ byte published[largestElement()];
+ for (byte i=0;i<SCHEMA_FIELDS;i++){
+  const tfield &f=configSchema[i];
+  if (bookkeeping(f)){ continue;}
+  for (byte n=0;n<f.count;n++){
+   uint16_t size=packElement(f, n, change.value);
+   packElement(f, n, published, _published);
+   if (memcmp(change.value, published, size)==0){ continue;}
+   change.field=i;
+   change.index=n;
+   if (!changes.push(change)){ return;} // the queue is full, the rest is sent once loop() has caught up
+   applyChange(change, _published);
+  }
+ }
+ changesPending=false;
+}
+
+void tSysConfig::applyChange(const tconfigchange &change, dataframe &frame) {
+ const tfield &f=configSchema[change.field];
+ if (f.type==t_ip){
+  uint32_t address;
+  memcpy(&address, change.value, 4);
+  fieldRef<IPAddress>(f, change.index, frame)=IPAddress(address);
+  return;
+ }
+ memcpy(&fieldRef<byte>(f, change.index, frame), change.value, f.size);
+}
+
+uint32_t tSysConfig::service() {
+ if (serviceTask&&changesPending){ publishChanges();}
+ return runJobs();
+}
+
+void tSysConfig::OTAhandle() {
  // as there is no stop or end function in ArduinoOTA, this hack is used to stop it functioning
  // there is no provision for on demand update in the code yet
  // noob value is to activate OTA
@@ -572,35 +1711,369 @@ void tSysConfig::run() {
  case 4:break; // totally stopped
  default: ArduinoOTA.handle();
  }
- server.handleClient();
-// MDNS.update(); ///////////////////////////////////////////////////////////////////////////////////////
- currentMillis = millis(); 
- blink(); 
 }
 
-void tSysConfig::scanWiFi(){/*
- bool isConnected=WiFi.status() == WL_CONNECTED;
- int32_t retries=0;
- WiFi.mode(WIFI_AP_STA);
- WiFi.disconnect();
- // scan for available networks
- n = WiFi.scanNetworks(); 
- for (int32_t i = 0; i < n; i++)
- {
- WiFi.getNetworkInfo(i, ssid, encryptionType, RSSI, BSSID, channel, isHidden);
- Serial.printf("%d: %s, Ch:%d (%ddBm) %s %s\r\n", i + 1, ssid.c_str(), channel, RSSI, encryptionType == ENC_TYPE_NONE ? "open" : "", isHidden ? "hidden" : "");
- }
- if (isConnected){ 
- WiFi.begin(_data.AccessPoints[0].WiFiname, _data.AccessPoints[0].WiFipassword); 
- // wait for connection here
- while ((WiFi.status() != WL_CONNECTED) && (retries<10)) {
- delay(1500);
- Serial.print(".");
- ++retries;
- } 
- }*/
+void tSysConfig::setWiFiState(w_state state) {
+ if ((state==w_resume)||((state==w_scan)&&(wifiState!=w_resume))){ connectStart=millis();} // a scan after a failed resume is the same attempt
+ wifiState=state;
+ wifiStateMillis=millis();
+ setPeriod(wifiJob, wifiPeriod());
+}
+
+uint32_t tSysConfig::wifiPeriod() {
+ switch (wifiState){
+ case w_idle:
+ case w_connected: return WIFI_PERIOD;
+ case w_backoff: return wifiBackoff;
+ default: return WIFI_STEP;
+ }
+}
+
+void tSysConfig::stepWiFi() {
+ wl_status_t status=WiFi.status();
+ switch (wifiState){
+ case w_idle: // no access point is configured
+  if (status==WL_CONNECTED){ onConnected();} // unless SmartConfig has since found one
+  break;
+ case w_resume:
+  if (status==WL_CONNECTED){ onConnected(); break;}
+  if ((status!=WL_CONNECT_FAILED)&&(status!=WL_NO_SSID_AVAIL)&&(millis()-wifiStateMillis<RESUME_TIMEOUT)){ break;}
+  Serial.println(F("WiFi cached access point did not answer"));
+  WiFi.disconnect();
+  setWiFiState(w_scan);
+  break;
+ case w_scan:
+  WiFi.scanNetworks(true);
+  setWiFiState(w_scanning);
+  break;
+ case w_scanning: {
+  int found=WiFi.scanComplete();
+  if (found==WIFI_SCAN_RUNNING){ break;}
+  pickCandidates(found);
+  WiFi.scanDelete();
+  candidate=0;
+  if (candidateCount){ setWiFiState(w_connect); break;}
+  Serial.println(F("WiFi found no configured network"));
+  setWiFiState(w_backoff);
+  break;
+ }
+ case w_connect: {
+  tcandidate &c=candidates[candidate];
+  STAconnected=false;
+  if (cachedLease){ // the access point may hand out a different address, so DHCP is asked again
+   WiFi.config(IPAddress(), IPAddress(), IPAddress());
+   cachedLease=false;
+  }
+  connectingAP=c.ap;
+  Serial.printf("WiFi connecting to %s, Ch:%d (%ddBm)\n", _data.AccessPoints[c.ap].WiFiname, c.channel, c.RSSI);
+  WiFi.begin(_data.AccessPoints[c.ap].WiFiname, _data.AccessPoints[c.ap].WiFipassword, c.channel, c.BSSID);
+  setWiFiState(w_connecting);
+  break;
+ }
+ case w_connecting:
+  if (status==WL_CONNECTED){ onConnected(); break;}
+  if ((status!=WL_CONNECT_FAILED)&&(status!=WL_NO_SSID_AVAIL)&&(millis()-wifiStateMillis<CONNECT_TIMEOUT)){ break;}
+  Serial.printf("WiFi failed to connect to %s\n", _data.AccessPoints[candidates[candidate].ap].WiFiname);
+  WiFi.disconnect();
+  if (++candidate<candidateCount){ setWiFiState(w_connect); break;}
+  if (!softAPup){ // with APconfig 0 the access point is only wanted once the station has failed
+   softAPup=WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel);
+   Serial.println(F("WiFi AP started"));
+  }
+  setWiFiState(w_backoff);
+  break;
+ case w_connected:
+  if (status==WL_CONNECTED){ break;}
+  STAconnected=false;
+  Serial.println(F("WiFi connection lost"));
+  if (!resumeWiFi()){ setWiFiState(w_scan);}
+  break;
+ case w_backoff:
+  if (status==WL_CONNECTED){ onConnected(); break;} // SmartConfig may have connected meanwhile
+  wifiBackoff=wifiBackoff<WIFI_BACKOFF_MAX/2 ? wifiBackoff*2 : WIFI_BACKOFF_MAX;
+  setWiFiState(w_scan);
+  break;
+ }
+}
+
+void tSysConfig::pickCandidates(int found) {
+ candidateCount=0;
+ for (int i=0;i<found;i++){
+  WiFi.getNetworkInfo(i, ssid, encryptionType, RSSI, BSSID, channel, isHidden);
+  Serial.printf("%d: %s, Ch:%d (%ddBm) %s %s\r\n", i + 1, ssid.c_str(), channel, RSSI, encryptionType == WIFI_AUTH_OPEN ? "open" : "", isHidden ? "hidden" : "");
+  for (byte ap=0;ap<5;ap++){
+   if (!_data.AccessPoints[ap].WiFiname[0]||(ssid!=_data.AccessPoints[ap].WiFiname)){ continue;}
+   // insertion by signal strength, the weakest falls off the end when the list is full
+   byte at=candidateCount;
+   while ((at>0)&&(candidates[at-1].RSSI<RSSI)){ at--;}
+   if (at>=WIFI_CANDIDATES){ break;}
+   if (candidateCount<WIFI_CANDIDATES){ candidateCount++;}
+   memmove(&candidates[at+1], &candidates[at], (candidateCount-1-at)*sizeof(tcandidate));
+   candidates[at]={ap, RSSI, channel};
+   memcpy(candidates[at].BSSID, BSSID, 6);
+   break;
+  }
+ }
+}
+
+bool tSysConfig::resumeWiFi() {
+ byte ap=_data.lastAP;
+ if (!_data.lastChannel||(ap>=5)||!_data.AccessPoints[ap].WiFiname[0]||!(uint32_t)_data.lastIP){ return false;}
+ Serial.printf("WiFi resuming %s, Ch:%d\n", _data.AccessPoints[ap].WiFiname, _data.lastChannel);
+ // the router keeps the lease for this MAC, so it is safe to take it again without asking
+ WiFi.config(_data.lastIP, _data.lastGateway, _data.lastSubnet, _data.lastDNS);
+ cachedLease=true;
+ connectingAP=ap;
+ WiFi.begin(_data.AccessPoints[ap].WiFiname, _data.AccessPoints[ap].WiFipassword, _data.lastChannel, _data.lastBSSID);
+ setWiFiState(w_resume);
+ return true;
+}
+
+void tSysConfig::onConnected() {
+ if (wifiEverConnected){ wifiReconnects++;}
+ wifiEverConnected=true;
+ STAconnected=true;
+ wifiBackoff=WIFI_BACKOFF;
+ connectTime=millis()-connectStart;
+ Serial.printf("WiFi connected in %u ms\n", connectTime);
+ Serial.println(F("IP address: "));
+ Serial.println(WiFi.localIP());
+ // the next connection goes straight back to this access point, the config is only written when it has changed
+ byte channel=WiFi.channel();
+ if (memcmp(_data.lastBSSID, WiFi.BSSID(), 6)||(_data.lastChannel!=channel)||(_data.lastAP!=connectingAP)
+  ||((uint32_t)_data.lastIP!=(uint32_t)WiFi.localIP())||((uint32_t)_data.lastGateway!=(uint32_t)WiFi.gatewayIP())
+  ||((uint32_t)_data.lastSubnet!=(uint32_t)WiFi.subnetMask())||((uint32_t)_data.lastDNS!=(uint32_t)WiFi.dnsIP(0))){
+  memcpy(_data.lastBSSID, WiFi.BSSID(), 6);
+  _data.lastChannel=channel;
+  _data.lastAP=connectingAP;
+  _data.lastIP=WiFi.localIP();
+  _data.lastGateway=WiFi.gatewayIP();
+  _data.lastSubnet=WiFi.subnetMask();
+  _data.lastDNS=WiFi.dnsIP(0);
+  commitConfig();
+ }
+ setWiFiState(w_connected);
+}
+
+
+#if LOOP_STATS
+void tSysConfig::metricsSummary(tMetricsWriter &metrics, const char *name, const char *labels, const thistogram &h) {
+ char quantile[48];
+ float scale=1e-6f/ESP.getCpuFreqMHz(); // cycles to seconds
+ snprintf(quantile, sizeof(quantile), "%s%squantile=\"0.5\"", labels ? labels : "", labels ? "," : "");
+ metrics.sample(name, quantile, histogramPercentile(h, 500)*scale);
+ snprintf(quantile, sizeof(quantile), "%s%squantile=\"0.99\"", labels ? labels : "", labels ? "," : "");
+ metrics.sample(name, quantile, histogramPercentile(h, 990)*scale);
+ metrics.sample(name, labels, h.totalCycles*scale, "_sum");
+ metrics.sample(name, labels, h.samples, "_count");
+}
+#endif
+
+void tSysConfig::getMetrics() {
+ tMetricsWriter metrics(server);
+ char labels[48];
+ uint32_t heap=ESP.getFreeHeap();
+ metrics.begin();
+ metrics.family("esp_uptime_seconds", "counter", "Time since boot.");
+ metrics.sample("esp_uptime_seconds", nullptr, (uint32_t)(esp_timer_get_time()/1000000));
+ metrics.family("esp_heap_free_bytes", "gauge", "Free heap.");
+ metrics.sample("esp_heap_free_bytes", nullptr, heap);
+ metrics.family("esp_heap_max_block_bytes", "gauge", "Largest block that can be allocated.");
+ metrics.sample("esp_heap_max_block_bytes", nullptr, (uint32_t)ESP.getMaxAllocHeap());
+ metrics.family("esp_heap_fragmentation_percent", "gauge", "Share of the free heap that is not in the largest block.");
+ metrics.sample("esp_heap_fragmentation_percent", nullptr, (uint32_t)(heap ? 100-(uint32_t)((uint64_t)ESP.getMaxAllocHeap()*100/heap) : 0));
+ metrics.family("esp_config_writes_total", "counter", "Config saves written to flash.");
+ metrics.sample("esp_config_writes_total", nullptr, (uint32_t)_data.burncount);
+ metrics.family("esp_config_writes_avoided_total", "counter", "Config saves skipped because nothing had changed.");
+ metrics.sample("esp_config_writes_avoided_total", nullptr, burnsAvoided);
+ metrics.family("esp_wifi_connected", "gauge", "1 while the station is connected to an access point.");
+ metrics.sample("esp_wifi_connected", nullptr, (uint32_t)STAconnected);
+ if (STAconnected){
+  metrics.family("esp_wifi_rssi_dbm", "gauge", "Signal strength of the access point the station is connected to.");
+  metrics.sample("esp_wifi_rssi_dbm", nullptr, (int32_t)WiFi.RSSI());
+ }
+ metrics.family("esp_wifi_reconnects_total", "counter", "Times the station link came back after it was lost.");
+ metrics.sample("esp_wifi_reconnects_total", nullptr, wifiReconnects);
+ metrics.family("esp_wifi_connect_seconds", "gauge", "Time the last connection took, from the first attempt to the address.");
+ metrics.sample("esp_wifi_connect_seconds", nullptr, connectTime*1e-3f);
+ metrics.family("esp_http_request_duration_seconds", "summary", "Time taken to serve each route.");
+ for (byte i=0;i<ROUTES;i++){
+  snprintf(labels, sizeof(labels), "route=\"%s\"", routes[i].uri);
+  metrics.sample("esp_http_request_duration_seconds", labels, routeStats[i].totalMicros*1e-6f, "_sum");
+  metrics.sample("esp_http_request_duration_seconds", labels, routeStats[i].hits, "_count");
+ }
+ metrics.family("esp_http_request_duration_max_seconds", "gauge", "Longest time taken to serve each route.");
+ for (byte i=0;i<ROUTES;i++){
+  snprintf(labels, sizeof(labels), "route=\"%s\"", routes[i].uri);
+  metrics.sample("esp_http_request_duration_max_seconds", labels, routeStats[i].maxMicros*1e-6f);
+ }
+#if LOOP_STATS
+ metrics.family("esp_loop_pass_duration_seconds", "summary", "Passes of run() that ran a job.");
+ metricsSummary(metrics, "esp_loop_pass_duration_seconds", nullptr, runStats);
+ metrics.family("esp_loop_pass_duration_max_seconds", "gauge", "Longest pass of run().");
+ metrics.sample("esp_loop_pass_duration_max_seconds", nullptr, (float)runStats.maxCycles/ESP.getCpuFreqMHz()*1e-6f);
+ metrics.family("esp_loop_idle_passes_total", "counter", "Passes of run() that found nothing due.");
+ metrics.sample("esp_loop_idle_passes_total", nullptr, idlePasses);
+ metrics.family("esp_job_duration_seconds", "summary", "Time taken by each scheduled job.");
+ for (byte i=0;i<JOBS;i++){
+  if (!jobs[i].job){ continue;}
+  snprintf(labels, sizeof(labels), "job=\"%s\"", jobs[i].name ? jobs[i].name : "job");
+  metricsSummary(metrics, "esp_job_duration_seconds", labels, jobs[i].stats);
+ }
+ metrics.family("esp_job_duration_max_seconds", "gauge", "Longest time taken by each scheduled job.");
+ for (byte i=0;i<JOBS;i++){
+  if (!jobs[i].job){ continue;}
+  snprintf(labels, sizeof(labels), "job=\"%s\"", jobs[i].name ? jobs[i].name : "job");
+  metrics.sample("esp_job_duration_max_seconds", labels, (float)jobs[i].stats.maxCycles/ESP.getCpuFreqMHz()*1e-6f);
+ }
+#endif
+ metrics.end();
+}
+
+void tSysConfig::initJobs() {
+ schedule("web", [this](){ server.handleClient();}, WEB_PERIOD);
+ schedule("files", [this](){ runTransfers();}, WEB_PERIOD);
+ schedule("OTA", [this](){ OTAhandle();}, OTA_PERIOD);
+ // MDNS needs no polling on the ESP32
+ wifiJob=schedule("WiFi", [this](){ stepWiFi();}, wifiPeriod()); // the pace of the state initWiFi() left it in, without entering it again
+ ledJob=schedule("LED", [this](){ blink(); setPeriod(ledJob, blinkstate>3 ? FAST_BLINK : SLOW_BLINK);}, SLOW_BLINK);
+ commitJob=schedule("config", [this](){
+  if (commitPending){ flushConfig();}
+  if ((journalBytes!=NO_JOURNAL)&&(journalBytes>CONFIG_JOURNAL_LIMIT)){ saveConfig();} // compact the config journal
+ }, 0);
+ if (commitPending){ wake(commitJob, commitDelay);} // a commit made before the jobs existed, the WPS connect in initWiFi() among them
+#if LOOP_STATS
+ schedule("serial", [this](){ if (serialCommands){ serialCommand();}}, SERIAL_PERIOD);
+ clearStats();
+#endif
+}
+
+int tSysConfig::schedule(const char *name, TJobFunction job, uint32_t period, uint32_t delay) {
+ for (int i=0;i<JOBS;i++){
+  tjob &j=jobs[i];
+  if (j.job){ continue;}
+  j=tjob();
+  j.job=job;
+  j.name=name;
+  j.period=period;
+  j.armed=false;
+  if (period){ wake(i, delay);}
+  return i;
+ }
+ return NO_JOB;
 }
 
+void tSysConfig::setPeriod(int id, uint32_t period) {
+ if ((id<0)||(id>=JOBS)){ return;}
+ jobs[id].period=period;
+ if (period){ wake(id, period);} // the new period counts from now
+}
+
+void tSysConfig::wake(int id, uint32_t delay) {
+ if ((id<0)||(id>=JOBS)||!jobs[id].job){ return;}
+ tjob &j=jobs[id];
+ j.due=millis()+delay;
+ j.armed=true;
+ if ((int32_t)(j.due-nextDue)<0){ nextDue=j.due;}
+}
+
+#if LOOP_STATS
+void tSysConfig::clearStats() {
+ for (byte i=0;i<JOBS;i++){ memset(&jobs[i].stats, 0, sizeof(thistogram));}
+ memset(&runStats, 0, sizeof(runStats));
+ idlePasses=0;
+ // timing a job costs two reads of the cycle counter and a record, measured here on a scratch histogram
+ thistogram scratch={};
+ uint32_t start=ESP.getCycleCount();
+ for (byte i=0;i<16;i++){
+  uint32_t t=ESP.getCycleCount();
+  recordCycles(scratch, ESP.getCycleCount()-t);
+ }
+ statsOverhead=(ESP.getCycleCount()-start)/16;
+}
+
+void tSysConfig::loopReport(Print &out) {
+ uint32_t mhz=ESP.getCpuFreqMHz();
+ uint32_t samples=runStats.samples;
+ for (byte i=0;i<JOBS;i++){ samples+=jobs[i].stats.samples;}
+ out.printf("%u MHz, %u idle passes, timing costs %u cycles a job, %.2f%% of the time in run()\r\n", mhz, idlePasses, statsOverhead,
+  runStats.totalCycles ? 100.0f*statsOverhead*samples/runStats.totalCycles : 0.0f);
+ out.printf("%-8s %9s %9s %9s %9s %9s\r\n", "stage", "samples", "mean us", "p50 us", "p99 us", "max us");
+ statsLine(out, "run", runStats, mhz);
+ for (byte i=0;i<JOBS;i++){
+  if (jobs[i].job){ statsLine(out, jobs[i].name ? jobs[i].name : "job", jobs[i].stats, mhz);}
+ }
+}
+
+void tSysConfig::serialCommand() {
+ while (Serial.available()){
+  char c=Serial.read();
+  if ((c!='\r')&&(c!='\n')){
+   if (commandLength<sizeof(command)-1){ command[commandLength++]=c;}
+   continue;
+  }
+  command[commandLength]=0;
+  if (strcmp(command, "stats")==0){ loopReport(Serial);}
+  else if (strcmp(command, "stats reset")==0){ clearStats(); Serial.println("stats cleared");}
+  commandLength=0;
+ }
+}
+
+void tSysConfig::getLoopStats() {
+ StreamString text;
+ loopReport(text);
+ server.send(200, "text/plain", text);
+}
+#endif
+
+void tSysConfig::cancel(int id) {
+ if ((id>=0)&&(id<JOBS)){ jobs[id]=tjob();}
+}
+
+uint32_t tSysConfig::runJobs() {
+ uint32_t now=millis();
+ if ((int32_t)(nextDue-now)>0){
+#if LOOP_STATS
+  idlePasses++;
+#endif
+  return nextDue-now;
+ }
+#if LOOP_STATS
+ uint32_t passStart=ESP.getCycleCount();
+#endif
+ currentMillis=now;
+ for (byte i=0;i<JOBS;i++){
+  tjob &j=jobs[i];
+  if (!j.armed||((int32_t)(j.due-now)>0)){ continue;}
+  // the deadline moves before the call, so a job may wake or reschedule itself
+  j.armed=j.period>0;
+  j.due=now+j.period;
+#if LOOP_STATS
+  uint32_t start=ESP.getCycleCount();
+  j.job();
+  recordCycles(j.stats, ESP.getCycleCount()-start);
+#else
+  j.job();
+#endif
+ }
+ // jobs that ran may have woken others, so the next deadline is found once they have all run
+ now=millis();
+ nextDue=now+JOB_IDLE;
+ for (byte i=0;i<JOBS;i++){
+  if (jobs[i].armed&&((int32_t)(jobs[i].due-nextDue)<0)){ nextDue=jobs[i].due;}
+ }
+#if LOOP_STATS
+ recordCycles(runStats, ESP.getCycleCount()-passStart);
+#endif
+ return (int32_t)(nextDue-now)>0 ? nextDue-now : 0;
+}
+
+void tSysConfig::scanWiFi(){
+ setWiFiState(w_scan);
+ stepWiFi(); // the scan starts now, the WiFi job collects it
+}
+
+
 // format bytes
 String tSysConfig::formatbytes(size_t bytes) {
  if (bytes < 1024) {
@@ -614,76 +2087,78 @@ String tSysConfig::formatbytes(size_t bytes) {
  }
 }
 
-boolean tSysConfig::isinteger(String str){ // check the input is an integer
- for(byte i=0;i<str.length();i++){
-  if(!isDigit(str.charAt(i))) {
-  return false;
-  }
- }
- return true;
-} 
-boolean tSysConfig::isFloat(String str){ // check that the input is a floating point number
- String s;
- String x;
- int32_t pos = str.indexOf(".");
- if (pos==-1){ Serial.println("simple integer"); return isinteger(str); } else {
- s=str.substring(0,pos);
- x=str.substring(pos+1);
- if (isinteger(s)){return isinteger(x);} 
- }
- return false;
-} 
-boolean tSysConfig::isTime(String str){ // check that the input is a floating point number
- String s;
- String x;
- int32_t pos = str.indexOf(":");
- if (pos==-1){ Serial.println("simple integer"); return false; } else {
- s=str.substring(0,pos);
- x=str.substring(pos+1);
- if (isinteger(s)){return isinteger(x);} 
- }
- return false;
-} 
-boolean tSysConfig::isIP(String str){// check that the input is an IP4 class address string
- String a; // 4 substrings to define the 4 quadrants of an IP string
- String b;
- String c;
- String d;
- // check for the . character, there needs to be 3 to be a valid ip4 address
- int32_t pos = str.indexOf(".");
- if (pos==-1){ return false;}
- a=str.substring(0,pos);
- int32_t pos2 = str.indexOf(".", pos);
- if (pos2==-1){ return false;}
- b=str.substring(pos+1,pos2);
- pos = str.indexOf(".", pos2);
- if (pos==-1){ return false;}
- c=str.substring(pos2+1,pos);
- d=str.substring(pos+1);
- // check is the substrings are numeric, if not then its not a valid ip
- if (!isinteger(a)){ return false;}
- if (!isinteger(b)){ return false;}
- if (!isinteger(c)){ return false;}
- if (!isinteger(d)){ return false;}
- if (a.toInt()>255){ return false;}
- if (b.toInt()>255){ return false;}
- if (c.toInt()>255){ return false;}
- if (d.toInt()>255){ return false;}
- return true;
+boolean tSysConfig::isinteger(const String &str){ // check the input is an integer
+ uint32_t v=0;
+ const char *last=str.c_str()+str.length();
+ return scanUnsigned(str.c_str(),last,v)==last;
+}
+boolean tSysConfig::isFloat(const String &str){ // check that the input is a floating point number
+ float v;
+ const char *last=str.c_str()+str.length();
+ return scanFloat(str.c_str(),last,v)==last;
+}
+boolean tSysConfig::isTime(const String &str){ // check that the input is a time of day
+ uint32_t h=0,m=0;
+ const char *last=str.c_str()+str.length();
+ return scanTime(str.c_str(),last,h,m)==last;
+}
+boolean tSysConfig::isIP(const String &str){// check that the input is an IP4 class address string
+ IPAddress ip;
+ const char *last=str.c_str()+str.length();
+ return scanIP(str.c_str(),last,ip)==last;
 }
  // copy values from post function is overloaded and has default parameters, if min-max are equal, range is ignored otherwise range checking is used
 
 int32_t tSysConfig::copyval(byte &var, char const *name, byte min, byte max){
- String V;
- error = 0;
+ if (server.hasArg(name)) { return setval(var, server.arg(name), min, max); }
+ errorcount++;
+ error = NotFound;
+ return NotFound;
+}
+
+int32_t tSysConfig::copyval(int32_t &var, char const *name, int32_t min, int32_t max){
+ if (server.hasArg(name)) { return setval(var, server.arg(name), min, max); }
+ errorcount++;
+ error = NotFound;
+ return NotFound;
+}
+
+int32_t tSysConfig::copyval(float &var, char const *name, float min, float max){
+ if (server.hasArg(name)) { return setval(var, server.arg(name), min, max); }
+ errorcount++;
+ error = NotFound;
+ return NotFound;
+}
+
+int32_t tSysConfig::copyval(time_t &var, char const *name){
  if (server.hasArg(name)) {
- V=server.arg(name);
- if ((V.length()<1)|(!isinteger(V))){
+  const String &V=server.arg(name);
+  Serial.print(name);
+  Serial.print(" ");
+  Serial.println(V);
+  return setval(var, V);
+ }
+ errorcount++;
+ error = NotFound;
+ return NotFound;
+}
+
+int32_t tSysConfig::copyval(char* var, char const *name, int32_t size, int32_t min){
+ if (server.hasArg(name)) { return setval(var, server.arg(name), size, min); }
+ errorcount++;
+ return NotFound;
+}
+
+int32_t tSysConfig::setval(byte &var, const String &V, byte min, byte max){
+ error = 0;
+ uint32_t v=0;
+ const char *last=V.c_str()+V.length();
+ if ((scanUnsigned(V.c_str(),last,v)!=last)||(v>255)){
  errorcount++;
  error=NaN;
  return NaN;
  }
- var=(byte)V.toInt();
+ var=v;
  if(max!=min){
  if ((var<=max)&&(var>=min)){
   error = OK;
@@ -693,25 +2168,19 @@ int32_t tSysConfig::copyval(byte &var, char const *name, byte min, byte max){
   error = Range;
   return Range;
  }
- return OK; } 
- else{
- errorcount++;
- error = NotFound;
- return NotFound;
- }
+ return OK;
 }
 
-int32_t tSysConfig::copyval(int32_t &var, char const *name, int32_t min, int32_t max){
- String V;
+int32_t tSysConfig::setval(int32_t &var, const String &V, int32_t min, int32_t max){
  error = 0;
- if (server.hasArg(name)) {
- V=server.arg(name);
- if ((V.length()<1)|(!isinteger(V))){
+ uint32_t v=0;
+ const char *last=V.c_str()+V.length();
+ if ((scanUnsigned(V.c_str(),last,v)!=last)||(v>0x7FFFFFFF)){
  errorcount++;
  error=NaN;
  return NaN;
  }
- var=V.toInt();
+ var=v;
  if(max!=min){
  if ((var<=max)&&(var>=min)){
   error = OK;
@@ -722,24 +2191,18 @@ int32_t tSysConfig::copyval(int32_t &var, char const *name, int32_t min, int32_t
   return Range;
  }
  return OK;
- } 
- else{
- errorcount++;
- error = NotFound;
- return NotFound;
- }
 }
-int32_t tSysConfig::copyval(float &var, char const *name, float min, float max){
- String V;
+
+int32_t tSysConfig::setval(float &var, const String &V, float min, float max){
  error = 0;
- if (server.hasArg(name)) {
- V=server.arg(name);
- if ((V.length()<1)|(!isFloat(V))){
+ float v=0;
+ const char *last=V.c_str()+V.length();
+ if (scanFloat(V.c_str(),last,v)!=last){
  errorcount++;
  error=NaN;
  return NaN;
  }
- var=V.toFloat();
+ var=v;
  if(max!=min){
  if ((var<=max)&&(var>=min)){
   error = OK;
@@ -750,85 +2213,53 @@ int32_t tSysConfig::copyval(float &var, char const *name, float min, float max){
   return Range;
  }
  return OK;
- } 
- else{
- errorcount++;
- error = NotFound;
- return NotFound;
- }
 }
 
-int32_t tSysConfig::copyval(time_t &var, char const *name){
- String V;
- String H;
- String M;
+int32_t tSysConfig::setval(time_t &var, const String &V){
+ uint32_t h=0,m=0;
+ const char *last=V.c_str()+V.length();
  error = 0;
-
- time_t t;
- 
-if (server.hasArg(name)) {
- V=server.arg(name);
- if (!V.length()) {
-  error = InvalidTime;
-  return error;
- }
-  Serial.print(name);
-  Serial.print(" ");
-  Serial.println(V);
-  
-  int pos = V.indexOf(":");
-  if (pos==-1){ error=InvalidTime; return error; } else {
-  H=V.substring(0,pos);
-  M=V.substring(pos+1);
-
-  if (!isinteger(H) || !isinteger(M)){ error=InvalidTime; return error; }
- }
-  var=(H.toInt()*60)+(M.toInt())+86400;
- } 
- else{
- errorcount++;
- error = NotFound;
- return NotFound;
- }/**/
+ if (scanTime(V.c_str(),last,h,m)!=last){ error=InvalidTime; return error; }
+ var=(h*60)+m+86400;
+ return OK;
 }
 
-int32_t tSysConfig::copyval(char* var, char const *name, int32_t size, int32_t min){
- ///char buf[128]=""; 
- String V;
+int32_t tSysConfig::setval(char* var, const String &V, int32_t size, int32_t min){
  int32_t bytes=0;
- if (server.hasArg(name)) {
-  V=server.arg(name);
-  if (min>0){if (V.length()<min){
-    errorcount++;
-    error = RangeLow;
-    return RangeLow;}
-  }
-  if ((V.length()+1)<=size){
-  bytes=V.length()+1;} else {bytes=size;}
-  bytes=strlcpy(var,V.c_str(), bytes); 
-  if (bytes<V.length()){
-    errorcount++;
-  }
-  return bytes; } 
-  else{
-  errorcount++;
-  return NotFound;
- }
+ if (min>0){if ((int32_t)V.length()<min){
+   errorcount++;
+   error = RangeLow;
+   return RangeLow;}
+ }
+ if ((int32_t)V.length()+1<=size){
+ bytes=V.length()+1;} else {bytes=size;}
+ bytes=strlcpy(var,V.c_str(), bytes);
+ if (bytes<(int32_t)V.length()){
+   errorcount++;
+ }
+ return bytes;
+}
+
+int32_t tSysConfig::copyval(bool &var, char const *name){
+ // an unchecked checkbox is not posted at all, so a missing field is a valid false rather than an error
+ error = OK;
+ var=server.hasArg(name);
+ return OK;
 }
 
 int32_t tSysConfig::copyIP(IPAddress &var, char const *name){
- String V;
  error = 0;
  if (server.hasArg(name)) {
- V=server.arg(name);
- if ((V.length()<1)|(!isTime(V))){
- errorcount++;
- error=NaN;
- return NaN;
- }
- if ( var.fromString(V) ){
+ const String &V=server.arg(name);
+ IPAddress ip;
+ const char *last=V.c_str()+V.length();
+ if (scanIP(V.c_str(),last,ip)==last){
+ var=ip;
  return OK;
- } 
+ }
+ errorcount++;
+ error = BadAddress;
+ return BadAddress;
  }
  else {
  errorcount++;
@@ -837,17 +2268,84 @@ int32_t tSysConfig::copyIP(IPAddress &var, char const *name){
  }
 }
 
+void tSysConfig::defaultConfig(){
+ for (byte i=0;i<SCHEMA_FIELDS;i++){
+  const tfield &f=configSchema[i];
+  for (byte n=0;n<f.count;n++){
+   switch (f.type){
+    case t_text: strlcpy(&fieldRef<char>(f,n), f.text, f.size); break;
+    case t_byte: fieldRef<byte>(f,n)=f.value; break;
+    case t_float: fieldRef<float>(f,n)=f.value; break;
+    case t_bool: fieldRef<bool>(f,n)=f.value; break;
+    case t_time:
+    case t_offset: fieldRef<time_t>(f,n)=f.value; break;
+    case t_int: storeInt(&fieldRef<byte>(f,n), f.size, f.value); break;
+    case t_ip: fieldRef<IPAddress>(f,n)=IPAddress((uint32_t)f.value); break;
+   }
+  }
+ }
+}
+const tfield *tSysConfig::findField(const char *name, byte &index){
+ size_t len=strlen(name);
+ size_t digits=len;
+ // an element index is a trailing number after the underscore that ends the field name
+ while ((digits>0)&&isdigit(name[digits-1])){ digits--;}
+ index=0;
+ if ((digits==len)||(digits==0)||(name[digits-1]!='_')||(len-digits>3)){ digits=len;} else { index=atoi(name+digits);}
+ uint32_t hash=FIELD_SEED;
+ for (size_t i=0;i<digits;i++){ hash=(hash^(byte)name[i])*16777619u;}
+ byte i=fieldSlots[FIELD_SLOT(hash)];
+ if (i==NO_FIELD){ return nullptr;}
+ const tfield &f=configSchema[i];
+ if ((strncmp(f.name,name,digits)!=0)||(f.name[digits]!=0)){ return nullptr;}
+ // plain fields carry no index and indexed fields always do
+ if ((f.count>1)!=(digits<len)||(index>=f.count)){ return nullptr;}
+ return &f;
+}
+
+void tSysConfig::postField(const tfield &f, byte index, const String &V){
+ switch (f.type){
+  case t_text: error=setval(&fieldRef<char>(f,index), V, f.size); break;
+  case t_byte: error=setval(fieldRef<byte>(f,index), V, (byte)f.min, (byte)f.max); break;
+  case t_float: error=setval(fieldRef<float>(f,index), V, (float)f.min, (float)f.max); break;
+  case t_bool: fieldRef<bool>(f,index)=true; error=OK; break;
+  case t_time: error=setval(fieldRef<time_t>(f,index), V); break;
+  case t_offset: // offsets are posted as a time of day but stored in minutes
+   error=setval(fieldRef<time_t>(f,index), V);
+   if (error==OK){ fieldRef<time_t>(f,index)-=86400;}
+   break;
+ }
+}
+
+void tSysConfig::postConfig(){
+ // an unchecked checkbox is not posted at all, so posted bools start out false
+ for (byte i=0;i<SCHEMA_FIELDS;i++){
+  const tfield &f=configSchema[i];
+  if ((f.flags & F_POST)&&(f.type==t_bool)){
+   for (byte n=0;n<f.count;n++){ fieldRef<bool>(f,n)=false;}
+  }
+ }
+ int count=server.args();
+ for (int i=0;i<count;i++){
+  byte index;
+  const tfield *f=findField(server.argKey(i).c_str(), index);
+  if (f && (f->flags & F_POST)){ postField(*f, index, server.argValue(i));}
+ }
+}
+
 // form creation support
 bool tSysConfig::form(htmlproperties obj){
  if (inForm){form();} // ensures all previous forms are closed before we create another, nested forms are not allowed
  sprintf(buffer, "<form label=\"%s\" name=\"%s\" method=\"post\" autocomplete=\"on\">",obj.css.c_str(), obj.name.c_str());
  HTML+=buffer;
+ return true;
  }
 bool tSysConfig::form(){
  // need to figure out how to autoinclude a submit button
  HTML+=F("<button class=\"w3-button w3-block w3-section w3-blue w3-ripple w3-padding\">Save</button></form>");
+ return true;
  }
-void tSysConfig::fieldset(char* tag){
+void tSysConfig::fieldset(char const *tag){
  // use to create groupboxes on the form
  if (inFieldset){ fieldset();}
  inFieldset=true;
@@ -860,7 +2358,7 @@ void tSysConfig::fieldset(){
   HTML+=F("</fieldset>");
  }
  }
-void tSysConfig::tab(char* tag){ 
+void tSysConfig::tab(char const *tag){ 
  sprintf(buffer, "<button onclick=\"openTab('%s')\">Updates</button>",tag);
  HTML+=buffer;
 }
@@ -871,6 +2369,7 @@ bool tSysConfig::edit(htmlproperties obj, char* data, int32_t size){
  }
  sprintf(buffer,"<input type=\"text\" name=\"%s\" label=\"%s\" value=\"%s\" placeholder=\"%s\" size=\"%d\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(),size, (obj.required)?" REQUIRED ":"");
  HTML+=buffer;
+ return true;
 }
 bool tSysConfig::edit(htmlproperties obj, byte &data, byte min, byte max){
  if ( server.method() == HTTP_POST ){
@@ -883,6 +2382,7 @@ bool tSysConfig::edit(htmlproperties obj, byte &data, byte min, byte max){
  sprintf(buffer,"<input type=\"number\" name=\"%s\" label=\"%s\" value=\"%d\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(), (obj.required)?" REQUIRED ":"");  
  }
  HTML+=buffer;
+ return true;
  }
 bool tSysConfig::edit(htmlproperties obj, int32_t &data, int32_t min, int32_t max){
  if ( server.method() == HTTP_POST ){
@@ -895,6 +2395,7 @@ bool tSysConfig::edit(htmlproperties obj, int32_t &data, int32_t min, int32_t ma
  sprintf(buffer,"<input type=\"number\" name=\"%s\" label=\"%s\" value=\"%d\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(), (obj.required)?" REQUIRED ":"");  
  }
  HTML+=buffer;
+ return true;
  }
 bool tSysConfig::edit(htmlproperties obj, float &data, float min, float max){
  if ( server.method() == HTTP_POST ){
@@ -907,6 +2408,7 @@ bool tSysConfig::edit(htmlproperties obj, float &data, float min, float max){
  sprintf(buffer,"<input type=\"number\" name=\"%s\" label=\"%s\" value=\"%f\" placeholder=\"%s\" min=\"%f\" max=\"%f\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(),min, max, (obj.required)?" REQUIRED ":"");  
  }
  HTML+=buffer;
+ return true;
  }
 
 bool tSysConfig::password(htmlproperties obj, char* data, int32_t size, int32_t min, int32_t max){
@@ -926,6 +2428,7 @@ bool tSysConfig::password(htmlproperties obj, char* data, int32_t size, int32_t
  HTML+=buffer;
  sprintf(buffer,"<input type=\"password\" name=\"%s_verify\" value=\"%s\" placeholder=\"verify password\" %s>",obj.name.c_str(),data, (obj.required)?" REQUIRED ":"");
  HTML+=buffer;
+ return true;
 }
 bool tSysConfig::text(htmlproperties obj, char* data, int32_t size, int32_t min, int32_t max){
  if ( server.method() == HTTP_POST ){
@@ -934,6 +2437,7 @@ bool tSysConfig::text(htmlproperties obj, char* data, int32_t size, int32_t min,
  }
  sprintf(buffer,"<textarea name=\"%s\"value=\"%s\" placeholder=\"%s\" size=\"%d\" %s></textarea>",obj.name.c_str(),data,obj.placeholder.c_str(),size, (obj.required)?" REQUIRED ":"");
  HTML+=buffer;
+ return true;
  }
 bool tSysConfig::editemail(htmlproperties obj, char* data, int32_t size){
  if ( server.method() == HTTP_POST ){
@@ -942,6 +2446,7 @@ bool tSysConfig::editemail(htmlproperties obj, char* data, int32_t size){
 }
  sprintf(buffer,"<input type=\"email\" name=\"%s\" label=\"%s\" value=\"%s\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(),(obj.required)?" REQUIRED ":"");
  HTML+=buffer;
+ return true;
 }
 bool tSysConfig::editurl(htmlproperties obj, char* data, int32_t size){
  if ( server.method() == HTTP_POST ){
@@ -950,6 +2455,7 @@ bool tSysConfig::editurl(htmlproperties obj, char* data, int32_t size){
 }
  sprintf(buffer,"<input type=\"url\" name=\"%s\" label=\"%s\" value=\"%s\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(), (obj.required)?" REQUIRED ":"");
  HTML+=buffer;
+ return true;
 } 
 bool tSysConfig::edittel(htmlproperties obj, char* data, int32_t size){
  if ( server.method() == HTTP_POST ){
@@ -958,6 +2464,7 @@ bool tSysConfig::edittel(htmlproperties obj, char* data, int32_t size){
  }
  sprintf(buffer,"<input type=\"tel\" name=\"%s\" label=\"%s\" value=\"%s\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(), (obj.required)?" REQUIRED ":"");
  HTML+=buffer;
+ return true;
 }
 bool tSysConfig::edit(htmlproperties obj, time_t &data){
  if ( server.method() == HTTP_POST ){
@@ -969,6 +2476,7 @@ bool tSysConfig::edit(htmlproperties obj, time_t &data){
  //atime.Minute=14;
  sprintf(buffer,"<input type=\"time\" name=\"%s\" label=\"%s\" Value=\"%02d:%02d\" %s>",obj.name.c_str(),obj.label.c_str(),0,0,(obj.required)?" REQUIRED ":"");
  HTML+=buffer;
+ return true;
 }
 /*  our select methods require some Javascript magic, the <select> element does not normally carry the value but this is carried here to 
  *  enable our Javascript code to pick it up and set the selected parameter on the correct option value
@@ -1022,6 +2530,7 @@ bool tSysConfig::selectList(htmlproperties obj,char* data, int32_t size){
 bool tSysConfig::selectList(){
  optiongroup();// ensures option groups are closed
  HTML+=F("</select>"); 
+ return true;
  }
 void tSysConfig::label(htmlproperties obj){
  if (obj.label.length()>0){ 
@@ -1034,27 +2543,33 @@ bool tSysConfig::optiongroup(char const *name){
  inOptgroup=true;
  sprintf(buffer,"<optgroup label=\"%s\">",name); 
  HTML+=buffer; 
+ return true;
  }
 bool tSysConfig::optiongroup(){
  if (inOptgroup){
  inOptgroup=false;
  HTML+=F("</optgroup>");} 
+ return true;
  }
-bool tSysConfig::option(char *data, char *name){
+bool tSysConfig::option(char *data, char const *name){
  sprintf(buffer,"<option value=\"%s\" >%s</option>",data,name); 
  HTML+=buffer; 
+ return true;
  }
-bool tSysConfig::option(float data, char *name){
+bool tSysConfig::option(float data, char const *name){
  sprintf(buffer,"<option value=\"%f\" >%s</option>",data,name); 
  HTML+=buffer; 
+ return true;
  }
-bool tSysConfig::option(int32_t data, char *name){
+bool tSysConfig::option(int32_t data, char const *name){
  sprintf(buffer,"<option value=\"%d\" >%s</option>",data,name); 
  HTML+=buffer; 
+ return true;
  }
- bool tSysConfig::option(byte data, char *name){
+ bool tSysConfig::option(byte data, char const *name){
  sprintf(buffer,"<option value=\"%d\" >%s</option>",data,name); 
  HTML+=buffer; 
+ return true;
  }
 bool tSysConfig::checkbox(htmlproperties obj, bool &data){
  if ( server.method() == HTTP_POST ){
@@ -1063,6 +2578,7 @@ bool tSysConfig::checkbox(htmlproperties obj, bool &data){
  }
  sprintf(buffer,"<input type=\"checkbox\" name=\"%s\" value=\"%d\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
  HTML+=buffer;  
+ return true;
  }
 bool tSysConfig::checkbox(htmlproperties obj, int32_t &data){
  if ( server.method() == HTTP_POST ){
@@ -1071,14 +2587,16 @@ bool tSysConfig::checkbox(htmlproperties obj, int32_t &data){
  }
  sprintf(buffer,"<input type=\"checkbox\" name=\"%s\" value=\"%d\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
  HTML+=buffer;  
+ return true;
  }
 bool tSysConfig::checkbox(htmlproperties obj, char* data, int32_t size){
  if ( server.method() == HTTP_POST ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str(),size);
  }
- sprintf(buffer,"<input type=\"checkbox\" name=\"%s\" value=\"%d\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
+ sprintf(buffer,"<input type=\"checkbox\" name=\"%s\" value=\"%s\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
  HTML+=buffer;  
+ return true;
  }
 bool tSysConfig::radio(htmlproperties obj, int32_t &data){
  if ( server.method() == HTTP_POST ){
@@ -1087,6 +2605,7 @@ bool tSysConfig::radio(htmlproperties obj, int32_t &data){
  }
  sprintf(buffer,"<input type=\"radio\" name=\"%s\" value=\"%d\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
  HTML+=buffer;  
+ return true;
  }
 bool tSysConfig::radio(htmlproperties obj, char *data, int32_t size){
  if ( server.method() == HTTP_POST ){
@@ -1095,34 +2614,35 @@ bool tSysConfig::radio(htmlproperties obj, char *data, int32_t size){
  }
  sprintf(buffer,"<input type=\"radio\" name=\"%s\" value=\"%s\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
  HTML+=buffer;  
+ return true;
  }
  // additional html elements of significant use to us
 void tSysConfig::meter(htmlproperties obj, int32_t value, int32_t min, int32_t max){
  // name is not required as this item does not return information
  if (obj.label.length()>0){
- sprintf(buffer,"<meter id=\"%s\" label=\"%s\" value=\"%d\" max=\"%d\"> %d% </meter>",obj.name.c_str(), obj.label.c_str(), value, min, max );} else {
- sprintf(buffer,"<meter id=\"%s\" value=\"%d\" max=\"%d\"> %d% </meter>",obj.name.c_str(), value, min, max );} 
+ sprintf(buffer,"<meter id=\"%s\" label=\"%s\" value=\"%d\" max=\"%d\"> %d%% </meter>",obj.name.c_str(), obj.label.c_str(), value, min, max );} else {
+ sprintf(buffer,"<meter id=\"%s\" value=\"%d\" max=\"%d\"> %d%% </meter>",obj.name.c_str(), value, min, max );} 
  HTML+=buffer; 
  }
 void tSysConfig::meter(htmlproperties obj, float value, float min, float max){
  // name is not required as this item does not return information
  if (obj.label.length()>0){
- sprintf(buffer,"<meter id=\"%s\" label=\"%s\" value=\"%f\" max=\"%f\"> %f% </meter>",obj.name.c_str(), obj.label.c_str(),value, min, max );} else {
- sprintf(buffer,"<meter id=\"%s\" value=\"%f\" max=\"%f\"> %f% </meter>", obj.name.c_str(), value, min, max );}
+ sprintf(buffer,"<meter id=\"%s\" label=\"%s\" value=\"%f\" max=\"%f\"> %f%% </meter>",obj.name.c_str(), obj.label.c_str(),value, min, max );} else {
+ sprintf(buffer,"<meter id=\"%s\" value=\"%f\" max=\"%f\"> %f%% </meter>", obj.name.c_str(), value, min, max );}
  HTML+=buffer; 
  }
 void tSysConfig::progress(htmlproperties obj, int32_t value, int32_t min, int32_t max){
  // name is not required as this item does not return information
  if (obj.label.length()>0){
- sprintf(buffer,"<progress id=\"%s\" label=\"%s\"value=\"%d\" max=\"%d\"> %d% </progress>",obj.name.c_str(), obj.label.c_str(),value, min, max );} else {
- sprintf(buffer,"<progress id=\"%s\" value=\"%d\" max=\"%d\"> %d% </progress>", obj.name.c_str(), value, min, max );}
+ sprintf(buffer,"<progress id=\"%s\" label=\"%s\"value=\"%d\" max=\"%d\"> %d%% </progress>",obj.name.c_str(), obj.label.c_str(),value, min, max );} else {
+ sprintf(buffer,"<progress id=\"%s\" value=\"%d\" max=\"%d\"> %d%% </progress>", obj.name.c_str(), value, min, max );}
  HTML+=buffer; 
  }
 void tSysConfig::progress(htmlproperties obj, float value, float min, float max){
  // name is not required as this item does not return information
  if (obj.label.length()>0){
- sprintf(buffer,"<progress id=\"%s\" label=\"%s\" value=\"%f\" max=\"%f\"> %f% </progress>",obj.name.c_str(), obj.label.c_str(), value, min, max );} else {
- sprintf(buffer,"<progress id=\"%s\" value=\"%f\" max=\"%f\"> %f% </progress>",obj.name.c_str(), value, min, max );}
+ sprintf(buffer,"<progress id=\"%s\" label=\"%s\" value=\"%f\" max=\"%f\"> %f%% </progress>",obj.name.c_str(), obj.label.c_str(), value, min, max );} else {
+ sprintf(buffer,"<progress id=\"%s\" value=\"%f\" max=\"%f\"> %f%% </progress>",obj.name.c_str(), value, min, max );}
  HTML+=buffer; 
  }
 void tSysConfig::details(htmlproperties obj){
@@ -1136,165 +2656,265 @@ void tSysConfig::indexPage(void) {
  if ( server.method() == HTTP_POST ){
   Serial.println("post data");
   // POST functionality here, includes error handling
-  //WiFi
-   error=copyval(_data.AccessPoints[0].WiFiname ,"SSID_0",32);
-   error=copyval(_data.AccessPoints[1].WiFiname ,"SSID_1",32);
-   error=copyval(_data.AccessPoints[2].WiFiname ,"SSID_2",32);
-   error=copyval(_data.AccessPoints[3].WiFiname ,"SSID_3",32);
-   error=copyval(_data.AccessPoints[4].WiFiname ,"SSID_4",32);
-   error=copyval(_data.AccessPoints[0].WiFipassword ,"SSID_pass_0",32);
-   error=copyval(_data.AccessPoints[1].WiFipassword ,"SSID_pass_1",32);
-   error=copyval(_data.AccessPoints[2].WiFipassword ,"SSID_pass_2",32);
-   error=copyval(_data.AccessPoints[3].WiFipassword ,"SSID_pass_3",32);
-   error=copyval(_data.AccessPoints[4].WiFipassword ,"SSID_pass_4",32);
-  //AP
-   error=copyval(_data.APname ,"APname",32);
-   error=copyval(_data.APpassword ,"APpassword",32);
-   error=copyval(_data.APchannel,"APchannel",1,13 );
-   error=copyval(_data.APconfig ,"APconfig",0,4);
-  //BLE 
-   error=copyval(_data.BLEname ,"BLEname",32);
-   error=copyval(_data.BLEpassword ,"BLEpassword",32);
-   error=copyval(_data.BLEConfig ,"BLEconfig",0,4);
-  //NTP 
-   error=copyval(_data.NTPserver ,"NTPserver",128);
-   error=copyval(_data.TZ ,"TZ");
-   _data.TZ=_data.TZ-86400;
-   error=copyval(_data.DST ,"DST");
-   _data.DST=_data.DST-86400;
-  //OTA
-   error=copyval(_data.OTA ,"OTA",0,3);
-   error=copyval(_data.OTApass ,"OTApass",32);
-  //ACL
-   error=copyval(_data.userName ,"userName",32);
-   error=copyval(_data.userPass ,"userPass",32);
-  //USER info
-   error=copyval(_data.firstname ,"fname",32);
-   error=copyval(_data.lastname ,"lname",32);
-   error=copyval(_data.userEmail ,"email",128);
-   error=copyval(_data.phone ,"phone",32);
-   error=copyval(_data.NodeName ,"Node",32);
-   // MQTT
-   error=copyval(_data.MQTTserver ,"MQTTserver",128);
-   error=copyval(_data.MQTTport ,"MQTTport");
-   error=copyval(_data.MQTTuser ,"MQTTuser",32);
-   error=copyval(_data.MQTTpass ,"MQTTpass",32);
-
-   // copy the time variables start time, stop time and day of week
- for ( byte i = 0; i < 32; i++ ) {
-  sprintf(buffer,"st_%d",i);
-   error=copyval(_data.timers[i].startTime,buffer);
-  sprintf(buffer,"et_%d",i);
-   error=copyval(_data.timers[i].endTime,buffer);
-  sprintf(buffer,"d_%d",i);
-   error=copyval(_data.timers[i].dow,buffer);  
-   }
-   writeConfig();
+   postConfig();
+   commitConfig();
   }  
-  File dataFile = SPIFFS.open("/index.html", "r"); 
- if (dataFile.size()<=0) {Serial.println("bad file size");
- }
- if (server.streamFile(dataFile, "text/html") != dataFile.size()) {Serial.println(F("index.html streaming error"));
- }
- dataFile.close(); 
+ sendAsset(a_index);
 }
 
 void tSysConfig::getIcon(){
   Serial.println("getIcon");
- File dataFile = SPIFFS.open("/favicon.ico", "r"); 
- if (dataFile.size()<=0) {Serial.println("icon bad file size");
+ sendAsset(a_icon);
+}
+
+void tSysConfig::hashAssets(){
+ byte block[128];
+ for (byte i=0;i<ASSETS;i++){
+  assetTags[i]=0;
+  assetFiles[i]=0;
+  String path=assets[i].path;
+  if (SPIFFS.exists(path)){
+   File dataFile = SPIFFS.open(path, "r");
+   size_t n;
+   while ((n=dataFile.read(block, sizeof(block)))>0){ assetTags[i]=crc32(block, n, assetTags[i]);}
+   dataFile.close();
+   assetFiles[i]=ASSET_PLAIN;
+  }
+  path+=".gz";
+  if (!SPIFFS.exists(path)){ continue;}
+  // the gzip trailer is the CRC32 and size of the uncompressed content, the same CRC as the plain copy
+  File dataFile = SPIFFS.open(path, "r");
+  uint32_t crc=0;
+  if ((dataFile.size()>=18)&&dataFile.seek(dataFile.size()-8)&&(dataFile.read(block, 4)==4)){ crc=block[0]|(block[1]<<8)|((uint32_t)block[2]<<16)|((uint32_t)block[3]<<24);}
+  dataFile.close();
+  if (!assetFiles[i]){ assetTags[i]=crc;}
+  else if (crc!=assetTags[i]){ Serial.print(path); Serial.println(F(" is out of date, ignored")); continue;}
+  assetFiles[i]|=ASSET_GZIP;
+ }
+}
+void tSysConfig::sendAsset(a_asset asset, int code){
+ const tasset &a=assets[asset];
+ // the gzip copy goes to browsers that accept it, and to all of them when it is the only copy
+ bool gzip=(assetFiles[asset]&ASSET_GZIP)&&(!(assetFiles[asset]&ASSET_PLAIN)||(server.header("Accept-Encoding").indexOf("gzip")>=0));
+ String path=a.path;
+ if (gzip){ path+=".gz";}
+ if (assetFiles[asset]&&(code==200)){
+  char version[9];
+  snprintf(version, sizeof(version), "%08x", assetTags[asset]);
+  String tag="\"" + String(version) + (gzip ? "-gz\"" : "\""); // each encoding is its own representation
+  server.sendHeader("ETag", tag);
+  if (assetFiles[asset]&ASSET_GZIP){ server.sendHeader("Vary", "Accept-Encoding");}
+  // a request naming the current version can keep it, anything else is revalidated on each use
+  if (server.arg("v")==version){ server.sendHeader("Cache-Control", "max-age=" + String(ASSET_MAX_AGE) + ", immutable");}
+  else { server.sendHeader("Cache-Control", "no-cache");}
+  if (server.header("If-None-Match")==tag){
+   server.send(304);
+   return;
+  }
+ }
+ tcacheentry &c=assetCache[asset*2+gzip];
+ if (c.body){ cacheHits++;}
+ else {
+  cacheMisses++;
+  File dataFile = SPIFFS.open(path, "r"); 
+  if (dataFile.size()<=0) {Serial.print(path); Serial.println(F(" bad file size"));
+  }
+  if (!assetFiles[asset]||!cacheAsset(c, dataFile)){
+   if (asyncFiles&&assetFiles[asset]&&sendAsync(dataFile, a.type, code, gzip)){ return;}
+   // the web server adds Content-Encoding: gzip itself for a file named .gz
+   if (server.streamFile(dataFile, a.type, code) != dataFile.size()) {Serial.print(path); Serial.println(F(" streaming error"));
+   }
+   dataFile.close(); 
+   return;
+  }
+  dataFile.close(); 
  }
- if (server.streamFile(dataFile, "image/vnd") != dataFile.size()) {Serial.println(F("icon streaming error"));
+ c.used=++cacheClock;
+ if (gzip){ server.sendHeader("Content-Encoding", "gzip");}
+ server.setContentLength(c.size);
+ server.send(code, a.type, "");
+ server.sendContent((const char *)c.body, c.size);
+}
+bool tSysConfig::cacheAsset(tcacheentry &c, File &dataFile){
+ size_t size=dataFile.size();
+ if (!size||(size>ASSET_CACHE_FILE)||(size>ASSET_CACHE)){ return false;}
+ while (cacheBytes+size>ASSET_CACHE){
+  // drop the least recently served copy
+  tcacheentry *oldest=nullptr;
+  for (byte i=0;i<ASSETS*2;i++){
+   if (assetCache[i].body&&(!oldest||(assetCache[i].used<oldest->used))){ oldest=&assetCache[i];}
+  }
+  free(oldest->body);
+  oldest->body=nullptr;
+  cacheBytes-=oldest->size;
+ }
+ c.body=(byte *)malloc(size);
+ if (!c.body){ return false;}
+ if (dataFile.read(c.body, size)!=size){
+  free(c.body);
+  c.body=nullptr;
+  dataFile.seek(0);
+  return false;
+ }
+ c.size=size;
+ cacheBytes+=size;
+ return true;
+}
+void tSysConfig::clearCache(){
+ for (byte i=0;i<ASSETS*2;i++){
+  free(assetCache[i].body);
+  assetCache[i].body=nullptr;
+ }
+ cacheBytes=0;
+}
+bool tSysConfig::sendAsync(File &dataFile, const char *type, int code, bool gzip){
+ ttransfer *t=nullptr;
+ for (byte i=0;i<ASYNC_TRANSFERS;i++){
+  if (!transfers[i].file){ t=&transfers[i]; break;}
+ }
+ if (!t){ return false;}
+ if (gzip){ server.sendHeader("Content-Encoding", "gzip");}
+ server.setContentLength(dataFile.size());
+ server.send(code, type, "");
+ t->client=server.detachClient();
+ t->file=dataFile;
+ dataFile=File(); // the slot owns the file now
+ t->lastMillis=millis();
+ return true;
+}
+void tSysConfig::runTransfers(){
+ byte block[ASYNC_BLOCK];
+ uint32_t start=millis();
+ bool sending=true;
+ // each transfer gets a block in turn until none can send more or the time is used up
+ while (sending&&(millis()-start<asyncBudget)){
+  sending=false;
+  for (byte i=0;i<ASYNC_TRANSFERS;i++){
+   ttransfer &t=transfers[i];
+   if (!t.file){ continue;}
+   if (!t.client.connected()||(millis()-t.lastMillis>ASYNC_TIMEOUT)){ endTransfer(t); continue;}
+   size_t n=t.file.read(block, sizeof(block));
+   if (!n){ endTransfer(t); continue;} // the file is shorter than it was
+   // a send that does not wait, whatever the socket does not take is read again next time
+   int sent=lwip_send(t.client.fd(), block, n, MSG_DONTWAIT);
+   if (sent<0){
+    if ((errno!=EAGAIN)&&(errno!=EWOULDBLOCK)){ endTransfer(t); continue;}
+    sent=0;
+   }
+   if ((size_t)sent<n){ t.file.seek(t.file.position()-(n-sent));}
+   if (!sent){ continue;}
+   t.lastMillis=millis();
+   sending=true;
+   if (t.file.position()>=t.file.size()){ endTransfer(t);}
+  }
+ }
+}
+void tSysConfig::endTransfer(ttransfer &t){
+ t.file.close();
+ t.file=File();
+ t.client=WiFiClient(); // dropping the last reference closes the connection once the data already queued has gone
+}
+void tSysConfig::dropAssets(){
+ for (byte i=0;i<ASYNC_TRANSFERS;i++){
+  if (transfers[i].file){ endTransfer(transfers[i]);}
  }
- dataFile.close(); 
+ clearCache();
+ memset(assetFiles, 0, sizeof(assetFiles));
+}
+void tSysConfig::assetsChanged(){
+ clearCache();
+ hashAssets();
 }
 
 void tSysConfig::getJSON(){
- // needs a buffer
    Serial.println("getJson");
-char* json ="{\"WiFi\":[\"%s\",\"%s\",\"%s\",\"%s\",\"%s\"],\"data\":[\"%s\",\"%s\",%d,%d,\"%s\",\"%s\",%d,\"%s\",\"%s\",%d,\"%s\"],\"MQTT\":[\"%s\",%d,\"%s\",\"%s\"],\"time\":[\"%s\",%d,%d],\"sysInfo\":[%d,\"%s\",%d,%d,%d,\"%s\",\"%s\",%d,%d,%d,\"%s\",\"%s\"],\"alarms\":[%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d]}";
-
-char jsonbuf[sizeof(_data)+sizeof(json)+4];
-
- sprintf(jsonbuf, json,
- // SSID for up to 5 networks
-   _data.AccessPoints[0].WiFiname, 
-   _data.AccessPoints[1].WiFiname, 
-   _data.AccessPoints[2].WiFiname, 
-   _data.AccessPoints[3].WiFiname, 
-   _data.AccessPoints[4].WiFiname,
-   // access point settings 
-   _data.APname, 
-   _data.APpassword,
-   _data.APchannel,
-   _data.APconfig, 
-   // bluetooth settings
-   _data.BLEname, 
-   _data.BLEpassword,
-   _data.BLEConfig,
-   // configuration login
-   _data.userName, 
-   _data.userPass,
-   // over the air updating
-   _data.OTA,      
-   _data.OTApass,
-   _data.MQTTserver,
-   _data.MQTTport,
-   _data.MQTTuser,
-   _data.MQTTpass,
-   // NTP settings
-   _data.NTPserver, 
-   _data.TZ,
-   _data.DST, // need to add current time to the data sent
-   
-   ESP.getChipRevision(),
-   ESP.getSdkVersion(),
-   ESP.getCpuFreqMHz(),
-   ESP.getFlashChipSpeed(),
-   ESP.getFlashChipSize(),
-   (ideMode == FM_QIO ? "QIO" : ideMode == FM_QOUT ? "QOUT" : ideMode == FM_DIO ? "DIO" : ideMode == FM_DOUT ? "DOUT" : "UNKNOWN"),
-   WiFi.SSID().c_str(), // wifi config info
-   (uint32_t)WiFi.localIP(),
-   (uint32_t)WiFi.gatewayIP(),
-   (uint32_t)WiFi.softAPIP(),  
-   __DATE__,__TIME__, // date & time this code was compiled
-
-  // time parameters 32 start times, 32 end times and 32 dow values
-   _data.timers[0].startTime-86400, _data.timers[1].startTime-86400, _data.timers[2].startTime-86400, _data.timers[3].startTime-86400,
-   _data.timers[4].startTime-86400, _data.timers[5].startTime-86400, _data.timers[6].startTime-86400, _data.timers[7].startTime-86400,
-   _data.timers[8].startTime-86400, _data.timers[9].startTime-86400, _data.timers[10].startTime-86400, _data.timers[11].startTime-86400,
-   _data.timers[12].startTime-86400, _data.timers[13].startTime-86400, _data.timers[14].startTime-86400, _data.timers[15].startTime-86400,
-   _data.timers[16].startTime-86400, _data.timers[17].startTime-86400, _data.timers[18].startTime-86400, _data.timers[19].startTime-86400,
-   _data.timers[20].startTime-86400, _data.timers[21].startTime-86400, _data.timers[22].startTime-86400, _data.timers[23].startTime-86400,
-   _data.timers[24].startTime-86400, _data.timers[25].startTime-86400, _data.timers[26].startTime-86400, _data.timers[27].startTime-86400,
-   _data.timers[28].startTime-86400, _data.timers[29].startTime-86400, _data.timers[30].startTime-86400, _data.timers[31].startTime-86400,
-   
-   _data.timers[0].endTime-86400, _data.timers[1].endTime-86400, _data.timers[2].endTime-86400, _data.timers[3].endTime-86400,
-   _data.timers[4].endTime-86400, _data.timers[5].endTime-86400, _data.timers[6].endTime-86400, _data.timers[7].endTime-86400,
-   _data.timers[8].endTime-86400, _data.timers[9].endTime-86400, _data.timers[10].endTime-86400, _data.timers[11].endTime-86400,
-   _data.timers[12].endTime-86400, _data.timers[13].endTime-86400, _data.timers[14].endTime-86400, _data.timers[15].endTime-86400,
-   _data.timers[16].endTime-86400, _data.timers[17].endTime-86400, _data.timers[18].endTime-86400, _data.timers[19].endTime-86400,
-   _data.timers[20].endTime-86400, _data.timers[21].endTime-86400, _data.timers[22].endTime-86400, _data.timers[23].endTime-86400,
-   _data.timers[24].endTime-86400, _data.timers[25].endTime-86400, _data.timers[26].endTime-86400, _data.timers[27].endTime-86400,
-   _data.timers[28].endTime-86400, _data.timers[29].endTime-86400, _data.timers[30].endTime-86400, _data.timers[31].endTime-86400,
-   
-   _data.timers[0].dow, _data.timers[1].dow, _data.timers[2].dow, _data.timers[3].dow,
-   _data.timers[4].dow, _data.timers[5].dow, _data.timers[6].dow, _data.timers[7].dow,
-   _data.timers[8].dow, _data.timers[9].dow, _data.timers[10].dow, _data.timers[11].dow,
-   _data.timers[12].dow, _data.timers[13].dow, _data.timers[14].dow, _data.timers[15].dow,
-   _data.timers[16].dow, _data.timers[17].dow, _data.timers[18].dow, _data.timers[19].dow,
-   _data.timers[20].dow, _data.timers[21].dow, _data.timers[22].dow, _data.timers[23].dow,
-   _data.timers[24].dow, _data.timers[25].dow, _data.timers[26].dow, _data.timers[27].dow,
-   _data.timers[28].dow, _data.timers[29].dow, _data.timers[30].dow, _data.timers[31].dow
-);
- /*  Serial.println(WiFi.SSID().c_str()); // wifi config info
-   Serial.println(WiFi.localIP());
-   Serial.println(WiFi.gatewayIP());
-   Serial.println(WiFi.softAPIP());*/
-   
- server.send(200, "text/x-json", jsonbuf);
+ if (jsonUnchanged()){ return;}
+ uint32_t selection=jsonSelection();
+ tJSONWriter json(server);
+ json.begin();
+ json.beginObject();
+ for (byte i=0;i<JSON_SECTIONS;i++){
+  if (!(selection&(1<<i))){ continue;}
+  if (jsonSections[i].section==j_none){ jsonSysInfo(json);}
+  else { jsonSection(json, jsonSections[i].name, jsonSections[i].section);}
+ }
+ json.endObject();
+ json.end();
  server.client().stop();
 }
+uint32_t tSysConfig::jsonSelection(){
+ const String &V=server.arg("sections");
+ if (!V.length()){ return (1<<JSON_SECTIONS)-1;}
+ uint32_t selection=0;
+ const char *p=V.c_str();
+ while (*p){
+  size_t n=strcspn(p, ",");
+  for (byte i=0;i<JSON_SECTIONS;i++){
+   if ((strlen(jsonSections[i].name)==n)&&!strncmp(jsonSections[i].name, p, n)){ selection|=1<<i;}
+  }
+  p+=n;
+  if (*p){ p++;}
+ }
+ return selection;
+}
+bool tSysConfig::jsonUnchanged(){
+ // the live values of sysInfo are checked here, so the ETag moves with them without watching them from run()
+ String SSID=WiFi.SSID();
+ uint32_t ip[3]={(uint32_t)WiFi.localIP(), (uint32_t)WiFi.gatewayIP(), (uint32_t)WiFi.softAPIP()};
+ uint32_t crc=crc32((const byte *)SSID.c_str(), SSID.length());
+ crc=crc32((const byte *)ip, sizeof(ip), crc);
+ if (crc!=liveCRC){ liveCRC=crc; liveGeneration++;}
+ snprintf(buffer, sizeof(buffer), "\"%x-%x\"", (uint16_t)_data.burncount, liveGeneration);
+ server.sendHeader("ETag", buffer);
+ server.sendHeader("Cache-Control", "no-cache"); // the browser revalidates every time, which costs a 304 while nothing changed
+ if (server.header("If-None-Match")!=buffer){ return false;}
+ server.send(304);
+ return true;
+}
+void tSysConfig::jsonSysInfo(tJSONWriter &json){
+ json.beginArray("sysInfo");
+ json.value((uint32_t)ESP.getChipRevision());
+ json.value(ESP.getSdkVersion());
+ json.value((uint32_t)ESP.getCpuFreqMHz());
+ json.value((uint32_t)ESP.getFlashChipSpeed());
+ json.value((uint32_t)ESP.getFlashChipSize());
+ json.value(ideMode == FM_QIO ? "QIO" : ideMode == FM_QOUT ? "QOUT" : ideMode == FM_DIO ? "DIO" : ideMode == FM_DOUT ? "DOUT" : "UNKNOWN");
+ json.value(WiFi.SSID().c_str()); // wifi config info
+ json.value((uint32_t)WiFi.localIP());
+ json.value((uint32_t)WiFi.gatewayIP());
+ json.value((uint32_t)WiFi.softAPIP());
+ json.value(__DATE__); // date & time this code was compiled
+ json.value(__TIME__);
+ json.value((int32_t)_data.burncount); // config writes
+ json.value((int32_t)_data.burntime);
+ json.value(burnsAvoided);
+ json.value(cacheHits); // the asset cache
+ json.value(cacheMisses);
+ json.value(cacheBytes);
+ json.endArray();
+}
+void tSysConfig::jsonSection(tJSONWriter &json, const char *key, byte section){
+ // the values of a section are written in schema order as a json array
+ json.beginArray(key);
+ for (byte i=0;i<SCHEMA_FIELDS;i++){
+  const tfield &f=configSchema[i];
+  if (f.section!=section){continue;}
+  for (byte n=0;n<f.count;n++){ jsonValue(json,f,n);}
+ }
+ json.endArray();
+}
+void tSysConfig::jsonValue(tJSONWriter &json, const tfield &f, byte index){
+ switch (f.type){
+  case t_text: json.value(&fieldRef<char>(f,index), f.size); break;
+  case t_byte: json.value((uint32_t)fieldRef<byte>(f,index)); break;
+  case t_float: json.value(fieldRef<float>(f,index)); break;
+  case t_bool: json.value(fieldRef<bool>(f,index)); break;
+  case t_time: json.value((int32_t)(fieldRef<time_t>(f,index)-86400)); break;
+  case t_offset: json.value((int32_t)fieldRef<time_t>(f,index)); break;
+  case t_int: json.value((int32_t)loadInt(&fieldRef<byte>(f,index), f.size)); break;
+  case t_ip: json.value(fieldRef<IPAddress>(f,index).toString().c_str()); break;
+ }
+}
 void tSysConfig::getCharts(){
  HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
  HTML=F("<meta http-equiv=\"Cache-Control\" content=\"no-cache, no-store, must-revalidate\"><meta http-equiv=\"Pragma\" content=\"no-cache\"><meta http-equiv=\"Expires\" content=\"0\"><meta http-equi=\"Connection\" content=\"close\">");
@@ -1309,17 +2929,17 @@ void tSysConfig::drawGraph(){
  
 }
 
+bool tSysConfig::webAuth(){
+ // used by restricted Configuration pages
+ return server.authenticate(_data.userName, _data.userPass);
+}
+
 void tSysConfig::handleNotFound(){
   Serial.println("handleNotFound");
   // the 404 page, we want to show the message and give the user a link back to the index page
   // unlike the other pages, this one is entirely self contained, including the CSS it needs
   // one caveat, figure out if its framed or unframed from the uri
- File dataFile = SPIFFS.open("/404.html", "r"); 
- if (dataFile.size()<=0) {Serial.println(F("help.htm bad file size"));
- }
- if (server.streamFile(dataFile, "text/html") != dataFile.size()) {Serial.println(F("404.html streaming error"));
- }
- dataFile.close();  
+ sendAsset(a_notfound, 404);
 // server.client().stop();
 }
 
@@ -26,6 +26,8 @@
 #include <lwip/dns.h>
 #include <dhcpserver.h>
 #include <sntp.h>      // sntp_servermode_dhcp()
+#include <bearssl/bearssl.h> // HMAC-SHA256 of the session cookies
+#include <StreamString.h> // the text of /loop.txt
 
 /*
 #include <TimeAlarms.h>
@@ -94,7 +96,21 @@ char NodeName[32];
 time_t regDate;
 long regID;
 long checksum;
+// the access point and lease of the last connection, so that the next one can skip the scan and DHCP
+alignas(time_t) alignas(long) uint8_t lastBSSID[6]; // aligned like the members above, config files from before it end here
+byte lastChannel; // 0 when nothing is cached
+byte lastAP; // index into AccessPoints
+uint32_t lastIP; // the lease as plain addresses, an IPAddress carries a vtable pointer that must not go to flash
+uint32_t lastGateway;
+uint32_t lastSubnet;
+uint32_t lastDNS;
 } dataframe;
+// the IPAddress members leave dataframe non-standard-layout, it has no bases or virtual members of its own so the offsets
+// are still those of a plain struct, and only the places that take them turn off -Winvalid-offsetof
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+constexpr size_t CONFIG_SHORT_SIZE=offsetof(dataframe, lastBSSID); // size of a config file written before the connection was cached
+#pragma GCC diagnostic pop
 
 typedef struct {
  String css;
@@ -108,6 +124,19 @@ typedef struct {
  String hint; // adds an acronym object using the label as the key text
 } htmlproperties;
 
+// page generation statistics, one entry per generated page, so the cost of building a page can be tracked on the device
+typedef struct {
+ uint32_t renders; // number of times the page has been generated
+ uint32_t lastMicros; // time taken to build the last page
+ uint32_t maxMicros;
+ uint32_t totalMicros;
+ uint32_t lastBytes; // size of the last page sent
+ uint32_t maxBytes;
+ uint32_t maxHeap; // largest amount of heap held by the page while it was built
+ uint32_t allocations; // heap allocations made building the page, over all renders
+ uint32_t maxAllocations;
+} tpagestats;
+
 // defines
 #define NaN -1
 #define NoString NaN-1
@@ -127,6 +156,23 @@ typedef struct {
 #define PT_SCANNING  0b11010000000000011010000000000000
 #define SCAN_PERIOD 5000
 #define CONNECT_PERIOD 500
+// generated pages, used to index the page statistics
+#define PAGE_CONFIG 0
+#define PAGE_TIME 1
+#define PAGE_OTA 2
+#define PAGE_SENSORS 3
+#define PAGE_TIMERS 4
+#define PAGE_ACL 5
+#define PAGE_REGISTER 6
+#define PAGE_MQTT 7
+#define PAGE_SYSINFO 8
+#define PAGE_CHARTS 9
+#define PAGE_COUNT 10
+#define HTML_CHUNK 512 // size of the buffer used to stream generated pages
+#define BENCH_MAX_LOOPS 1000 // the most loops /bench.html runs, the benchmark holds up the loop while it runs
+/* HEAP_ALLOCATIONS() is the number of heap allocations made so far, when the platform can count them the page statistics
+ * include the allocations each page makes, the host build defines it, the ESP8266 core has no such count
+*/
 
 // global variables
 IPAddress ip(192,168,4,1);
@@ -134,17 +180,387 @@ IPAddress gateway(192,168,4,1);
 IPAddress subnet(255,255,255,0);
 byte APchannel = 11;
 unsigned int localPort = 2390;  // local port to listen for UDP packets
+const char *pageNames[PAGE_COUNT]={"Config","Time","OTA","Sensors","Timers","ACL","Register","MQTT","Sysinfo","Charts"};
 
 // main classes for Configuration management, time management and NAT
 enum s_class {s_none, s_byte, s_int32_t, s_float, s_text};// used by the select functions
 enum eSensorClass {s_undefined, s_NTC, s_BMP, s_BME, s_ADC, s_Freq, s_PWM, s_Weight};
 
+#define COMMIT_DELAY 3000 // ms a save waits for further changes, so a user working through several pages causes one write
+// logins, /login.html sets a cookie signed with HMAC-SHA256 that the restricted pages accept in place of Basic auth
+#define SESSIONS 4 // validated sessions remembered, a cookie that is not among them has its signature checked again
+#define SESSION_LIFE 3600 // seconds a login lasts
+#define SESSION_CLOCK() ((uint32_t)(micros64()/1000000)) // uptime in seconds, millis()/1000 would wrap after 49.7 days and bring old cookies back
+#define SESSION_COOKIE "ESPSESSION"
+typedef struct {
+ uint32_t id; // 0 for a free slot
+ uint32_t expiry; // uptime in seconds
+ byte mac[16]; // the signature the cookie carries
+} tsession;
 typedef std::function<void(time_t trigger)> TTimerFunction;
+/* each job, and each pass of run() that runs one, is timed with the cycle counter into a histogram of power of two buckets
+ * p50 and p99 are the upper edge of the bucket they fall in so they are good to a factor of two, max and mean are exact
+ * the report is served at /loop.txt and printed for the serial command "stats", "stats reset" clears it, LOOP_STATS 0 compiles it out
+*/
+#ifndef LOOP_STATS
+#define LOOP_STATS 1
+#endif
+#define HISTOGRAM_BUCKETS 24 // bucket b counts times of 2^b to 2^(b+1)-1 cycles, the last one also everything longer
+#define SERIAL_PERIOD 100 // ms between reads of serial commands
+typedef struct {
+ uint32_t counts[HISTOGRAM_BUCKETS];
+ uint32_t samples;
+ uint32_t maxCycles;
+ uint64_t totalCycles;
+} thistogram;
+inline void recordCycles(thistogram &h, uint32_t cycles){
+ byte b=cycles ? 31-__builtin_clz(cycles) : 0;
+ h.counts[b<HISTOGRAM_BUCKETS ? b : HISTOGRAM_BUCKETS-1]++;
+ h.samples++;
+ h.totalCycles+=cycles;
+ if (cycles>h.maxCycles){ h.maxCycles=cycles;}
+}
+uint32_t histogramPercentile(const thistogram &h, uint32_t perMille){ // in cycles
+ uint32_t rank=((uint64_t)h.samples*perMille+999)/1000;
+ uint32_t seen=0;
+ for (byte b=0;b<HISTOGRAM_BUCKETS;b++){
+  seen+=h.counts[b];
+  if (seen&&(seen>=rank)){
+   uint32_t edge=b+1<HISTOGRAM_BUCKETS ? (2u<<b)-1 : h.maxCycles;
+   return edge<h.maxCycles ? edge : h.maxCycles;
+  }
+ }
+ return h.maxCycles;
+}
+void statsLine(Print &out, const char *name, const thistogram &h, uint32_t mhz){
+ out.printf("%-8s %9u %9.1f %9.1f %9.1f %9.1f\r\n", name, h.samples, h.samples ? (float)h.totalCycles/h.samples/mhz : 0.0f,
+  (float)histogramPercentile(h, 500)/mhz, (float)histogramPercentile(h, 990)/mhz, (float)h.maxCycles/mhz);
+}
+/* run() is driven by a table of jobs, each with a period and the millis() it is next due, a pass only calls the jobs that are due
+ * and returns the ms until the next deadline, while nothing is due a pass costs a single compare
+ * a job with a period of 0 runs once each time it is woken, the application can add its own jobs with schedule()
+*/
+typedef std::function<void()> TJobFunction;
+typedef struct {
+ TJobFunction job; // empty while the slot is free
+ const char *name; // for the timing report
+ uint32_t period; // ms from one run to the next, missed runs are skipped rather than caught up
+ uint32_t due; // millis() of the next run
+ bool armed; // false while a one-shot job waits to be woken
+#if LOOP_STATS
+ thistogram stats;
+#endif
+} tjob;
+#ifndef JOBS
+#define JOBS 10 // the system uses up to 9
+#endif
+#define NO_JOB -1
+#define JOB_IDLE 1000 // the longest run() reports when no job is armed
+#define WEB_PERIOD 1 // ms between polls of the web server
+#define OTA_PERIOD 20
+#define WIFI_PERIOD 1000 // ms between checks of the station link once it is up
+#define WIFI_STEP 100 // ms between steps of the station state machine while it scans and connects
+#define CONNECT_TIMEOUT 10000 // ms each access point is given to connect
+#define RESUME_TIMEOUT 3000 // ms the cached access point is given before a full scan
+#define WIFI_BACKOFF 10000 // ms before scanning again once every access point has failed, doubled each round up to WIFI_BACKOFF_MAX
+#define WIFI_BACKOFF_MAX 160000
+#define WIFI_CANDIDATES 8 // configured access points kept from a scan, an SSID served by several radios counts once per radio
+/* the station side of the WiFi, stepped by the WiFi job so that init() returns with the access point and web server up
+ * w_resume waits on the access point of the last connection, joined on its channel with its lease as a static address
+ * w_scan starts a scan, w_scanning waits for it and picks the configured access points it found, strongest first
+ * w_connect starts on the next of them, w_connecting waits for it, w_backoff waits to scan again when they all failed
+ */
+enum w_state {w_idle, w_resume, w_scan, w_scanning, w_connect, w_connecting, w_connected, w_backoff};
+typedef struct {
+ byte ap; // index into AccessPoints
+ int32_t RSSI;
+ int32_t channel;
+ uint8_t BSSID[6];
+} tcandidate;
+#define MDNS_PERIOD 100
+#define WPS_PERIOD 50 // the WPS button is read this often
 String HTML;
 char buffer[256];
 dataframe _data; // the data is contained in the private section as its not meant to be directly interatecd with by the main program
 //dataframe _formdata; // the data contained herein is used to process the form data
   
+/* from_chars style scanners for form input, each converts the text at the start of [first,last) in place, without copies or substrings
+ * and returns the position after what it consumed, or nullptr if there is nothing to convert or the value overflows
+ * the caller compares the result with last to require that the whole field was consumed
+*/
+const char *scanUnsigned(const char *first, const char *last, uint32_t &value){
+ if ((first==last)||!isDigit(*first)){ return nullptr;}
+ uint32_t v=0;
+ for (;(first<last)&&isDigit(*first);first++){
+  byte d=*first-'0';
+  if (v>(0xFFFFFFFFu-d)/10){ return nullptr;}
+  v=v*10+d;
+ }
+ value=v;
+ return first;
+}
+const char *scanFloat(const char *first, const char *last, float &value){ // digits with an optional decimal point, either side may be empty but not both
+ float v=0;
+ float scale=1;
+ bool digits=false;
+ for (;(first<last)&&isDigit(*first);first++){ v=v*10+(*first-'0'); digits=true;}
+ if ((first<last)&&(*first=='.')){
+  for (first++;(first<last)&&isDigit(*first);first++){ scale/=10; v+=(*first-'0')*scale; digits=true;}
+ }
+ if (!digits){ return nullptr;}
+ value=v;
+ return first;
+}
+const char *scanTime(const char *first, const char *last, uint32_t &hours, uint32_t &minutes){ // hh:mm
+ first=scanUnsigned(first,last,hours);
+ if ((!first)||(first==last)||(*first!=':')){ return nullptr;}
+ return scanUnsigned(first+1,last,minutes);
+}
+const char *scanIP(const char *first, const char *last, IPAddress &ip){ // dotted quad, each part 0-255
+ uint32_t part[4];
+ for (byte i=0;i<4;i++){
+  if (i>0){
+   if ((first==last)||(*first!='.')){ return nullptr;}
+   first++;
+  }
+  first=scanUnsigned(first,last,part[i]);
+  if ((!first)||(part[i]>255)){ return nullptr;}
+ }
+ ip=IPAddress(part[0],part[1],part[2],part[3]);
+ return first;
+}
+
+uint32_t crc32(const byte *data, size_t length, uint32_t crc=0){ // standard CRC32, a nibble at a time so the table stays small
+ static const uint32_t table[16]={0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+ crc=~crc;
+ while (length--){
+  crc=table[(crc^*data)&15]^(crc>>4);
+  crc=table[(crc^(*data>>4))&15]^(crc>>4);
+  data++;
+ }
+ return ~crc;
+}
+
+// the static files served from SPIFFS, the ETag of each is the CRC of its content taken when SPIFFS is mounted
+// so revalidating an unchanged file costs a 304 without opening it
+// a gzip copy (index.html.gz) is sent instead to browsers that accept it, its trailer holds the CRC of the content so a stale copy is ignored
+typedef struct {
+ const char *path;
+ const char *type;
+} tasset;
+enum a_asset {a_index, a_icon, a_logo, a_css, a_js, a_scjs, a_notfound};
+const tasset assets[]={{"/index.html","text/html"},{"/favicon.ico","image/vnd"},{"/logo.png","image/png"},{"/w3.css","text/css"},{"/w3.js","text/javascript"},{"/sc.js","text/javascript"},{"/404.html","text/html"}};
+#define ASSETS (sizeof(assets)/sizeof(tasset))
+#define ASSET_PLAIN 1 // the copies of an asset found in SPIFFS
+#define ASSET_GZIP 2
+// small assets are kept in RAM once served, the least recently used ones are dropped to stay within the budget
+#ifndef ASSET_CACHE
+#define ASSET_CACHE 4096 // bytes of asset bodies kept in RAM
+#endif
+#ifndef ASSET_CACHE_FILE
+#define ASSET_CACHE_FILE 2048 // larger files are always streamed from SPIFFS
+#endif
+typedef struct {
+ byte *body; // nullptr while this copy is not cached
+ uint16_t size;
+ uint32_t used; // cacheClock when it was last served
+} tcacheentry;
+// files too large for the cache are sent from run() a send window at a time, so a slow client does not hold up the loop
+// the web server parses the request and runs the handler as before, then the connection is handed to a transfer slot
+#ifndef ASYNC_TRANSFERS
+#define ASYNC_TRANSFERS 2 // files being sent at once, a request beyond that is streamed while it waits
+#endif
+#ifndef ASYNC_BUDGET
+#define ASYNC_BUDGET 10 // ms run() may spend sending files each time it is called
+#endif
+#define ASYNC_BLOCK 512 // bytes read from SPIFFS at a time
+#define ASYNC_TIMEOUT 10000 // ms a client may take nothing before the transfer is dropped
+typedef struct {
+ File file; // closed while the slot is free
+ WiFiClient client;
+ uint32_t lastMillis; // when the client last took data
+} ttransfer;
+#define ASSET_MAX_AGE 31536000 // a year, for requests that name the version they want with ?v=, as the page heads do
+
+// the web pages, each route names the method and the login it needs and the tSysConfig member that serves it
+// the table is kept sorted by uri so a request is matched with a binary search rather than a walk of every registered handler
+// compares without an early exit, so the time taken does not tell how much of a secret matched
+bool sameBytes(const byte *a, const byte *b, size_t length){
+ byte d=0;
+ while (length--){ d|=*a++^*b++;}
+ return !d;
+}
+bool sameText(const String &a, const char *b, size_t size){
+ // b is a zero terminated field of size bytes, every byte of it is compared
+ if (a.length()>=size){ return false;}
+ byte d=0;
+ bool ended=false;
+ for (size_t i=0;i<size;i++){
+  char c=ended ? 0 : b[i];
+  d|=c^(i<a.length() ? a[i] : 0);
+  ended|=!c;
+ }
+ return !d;
+}
+int hexDigit(char c){
+ if ((c>='0')&&(c<='9')){ return c-'0';}
+ if ((c>='a')&&(c<='f')){ return c-'a'+10;}
+ if ((c>='A')&&(c<='F')){ return c-'A'+10;}
+ return -1;
+}
+
+// persistent connections, a page and its assets are fetched over one connection rather than one each
+#ifndef KEEPALIVE_REQUESTS
+#define KEEPALIVE_REQUESTS 16 // requests served on a connection before it is closed
+#endif
+#ifndef KEEPALIVE_IDLE
+#define KEEPALIVE_IDLE 1000 // ms an idle connection is kept open, it is closed at once when another client is waiting
+#endif
+// adds to the web server what the transfers and persistent connections need
+class tWebServer : public ESP8266WebServer{
+ public:
+  tWebServer(int port=80):ESP8266WebServer(port){}
+  uint32_t keepAliveIdle=KEEPALIVE_IDLE;
+  uint16_t connectionRequests=0; // requests served on the current connection
+  void handleClient(){
+   // the server only serves one connection at a time, so an idle one must not keep the next client waiting
+   if ((_currentStatus==HC_WAIT_CLOSE)&&!_currentClient.available()&&((millis()-_statusChange>keepAliveIdle)||_server.hasClient())){
+    _currentClient=WiFiClient();
+    _currentStatus=HC_NONE;
+   }
+   if (_currentStatus==HC_NONE){
+    connectionRequests=0;
+    keepAlive(true);
+   }
+   ESP8266WebServer::handleClient();
+  }
+  void countRequest(){
+   // the response to the last request allowed on a connection says Connection: close
+   if (++connectionRequests>=KEEPALIVE_REQUESTS){ keepAlive(false);}
+  }
+  // takes over the connection of the current request, the server forgets it without closing it
+  WiFiClient detachClient(){ WiFiClient c=_currentClient; _currentClient=WiFiClient(); return c; }
+};
+
+class tSysConfig;
+typedef void (tSysConfig::*troutehandler)();
+/* writes /metrics in the Prometheus text format straight to the client, lines are formatted into a chunk of METRICS_CHUNK bytes
+ * that is sent each time it fills, so a scrape builds no String and holds no more memory than the chunk
+*/
+#define METRICS_CHUNK 512
+class tMetricsWriter{
+ public:
+  tMetricsWriter(ESP8266WebServer &server):server(server){}
+  void begin(); // sends the headers, the body follows in chunks
+  void end(); // sends the rest of the body and the final chunk
+  void family(const char *name, const char *type, const __FlashStringHelper *help); // the HELP and TYPE lines that come before the samples of a metric
+  void sample(const char *name, const char *labels, uint32_t v, const char *suffix=nullptr); // labels such as route="/", or nullptr
+  void sample(const char *name, const char *labels, int32_t v, const char *suffix=nullptr);
+  void sample(const char *name, const char *labels, float v, const char *suffix=nullptr);
+ private:
+  ESP8266WebServer &server;
+  char chunk[METRICS_CHUNK];
+  size_t length=0;
+  void name(const char *name, const char *suffix, const char *labels);
+  void put(char c);
+  void put(const char *text);
+  void put(const char *text, size_t n);
+  void put(const __FlashStringHelper *text);
+  void flush();
+};
+
+void tMetricsWriter::begin(){
+ length=0;
+ server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+ server.send(200, "text/plain; version=0.0.4", "");
+}
+void tMetricsWriter::end(){
+ flush();
+ server.sendContent("");
+}
+void tMetricsWriter::family(const char *name, const char *type, const __FlashStringHelper *help){
+ put("# HELP ");
+ put(name);
+ put(' ');
+ put(help);
+ put("\n# TYPE ");
+ put(name);
+ put(' ');
+ put(type);
+ put('\n');
+}
+void tMetricsWriter::sample(const char *name, const char *labels, uint32_t v, const char *suffix){
+ char text[12];
+ this->name(name, suffix, labels);
+ put(text, snprintf(text, sizeof(text), "%u\n", v));
+}
+void tMetricsWriter::sample(const char *name, const char *labels, int32_t v, const char *suffix){
+ char text[13];
+ this->name(name, suffix, labels);
+ put(text, snprintf(text, sizeof(text), "%d\n", (int)v));
+}
+void tMetricsWriter::sample(const char *name, const char *labels, float v, const char *suffix){
+ char text[24];
+ this->name(name, suffix, labels);
+ put(text, snprintf(text, sizeof(text), "%.6g\n", v)); // seconds of a job are often below a microsecond
+}
+void tMetricsWriter::name(const char *name, const char *suffix, const char *labels){
+ put(name);
+ if (suffix){ put(suffix);}
+ if (labels){
+  put('{');
+  put(labels);
+  put('}');
+ }
+ put(' ');
+}
+void tMetricsWriter::put(char c){
+ if (length==sizeof(chunk)){ flush();}
+ chunk[length++]=c;
+}
+void tMetricsWriter::put(const char *text){
+ while (*text){ put(*text++);}
+}
+void tMetricsWriter::put(const char *text, size_t n){
+ while (n--){ put(*text++);}
+}
+void tMetricsWriter::put(const __FlashStringHelper *text){
+ PGM_P p=reinterpret_cast<PGM_P>(text);
+ char c;
+ while ((c=pgm_read_byte(p++))){ put(c);}
+}
+void tMetricsWriter::flush(){
+ if (length){ server.sendContent(chunk, length);}
+ length=0;
+}
+
+enum r_auth {r_open, r_user}; // r_user routes ask for the userName & userPass login
+typedef struct {
+ const char *uri;
+ HTTPMethod method; // HTTP_ANY accepts every method
+ r_auth auth;
+ troutehandler handler;
+} troute;
+typedef struct {
+ uint32_t hits;
+ uint32_t totalMicros;
+ uint32_t maxMicros;
+} troutestats;
+constexpr int uriCompare(const char *a, const char *b){ return (*a!=*b)||!*a ? (unsigned char)*a-(unsigned char)*b : uriCompare(a+1, b+1);}
+const char *methodName(HTTPMethod method){ // the token of a route method, for the Allow header of a 405
+ switch (method){
+  case HTTP_GET: return "GET";
+  case HTTP_HEAD: return "HEAD";
+  case HTTP_POST: return "POST";
+  case HTTP_PUT: return "PUT";
+  case HTTP_PATCH: return "PATCH";
+  case HTTP_DELETE: return "DELETE";
+  case HTTP_OPTIONS: return "OPTIONS";
+  default: return "";
+ }
+}
+
 class tSysConfig{
  private:
    // LED information for heartbeat LED
@@ -157,6 +573,21 @@ class tSysConfig{
   long lastConnectMillis;
  // network scanning info
   bool STAconnected=false;
+  uint32_t wifiReconnects=0; // times the station link came back after it was lost
+  w_state wifiState=w_idle;
+  uint32_t wifiStateMillis; // millis() when wifiState was entered
+  uint32_t wifiBackoff=WIFI_BACKOFF;
+  bool wifiEverConnected=false;
+  bool softAPup=false;
+  int wifiJob=NO_JOB;
+  tcandidate candidates[WIFI_CANDIDATES];
+  byte candidateCount=0;
+  byte candidate=0; // the one being tried
+  byte connectingAP=0; // index into AccessPoints of the attempt under way
+  bool cachedLease=false; // the station has the cached address set rather than asking DHCP
+  uint32_t connectStart=0; // millis() when the station started looking for a connection
+  uint32_t connectTime=0; // ms the last connection took
+  bool naptEnabled=false; // the access point routes through NAPT, whose table /metrics reports
   int32_t n=-2;
   String ssid;
   uint8_t encryptionType;
@@ -177,6 +608,39 @@ class tSysConfig{
   s_class inSelect; // if we are in a select group we need to know the class so it processes the correct information
   bool inOptgroup;
   bool lightHTML;
+ // page generation statistics
+  uint32_t renderMicros; // start time of the page being built
+  uint32_t renderHeap; // free heap when the page was started
+  uint32_t renderAllocations; // HEAP_ALLOCATIONS() when the page was started
+  bool benchmark=false; // pages are built but not sent while the benchmark is running
+ // streamed page output, pages are sent in HTTP chunks as the buffer fills rather than built in RAM
+  char chunk[HTML_CHUNK];
+  size_t chunkLen;
+  uint32_t pageBytes; // size of the page generated so far
+ // deferred saving of the config
+  bool commitPending=false;
+ // the scheduler behind run()
+  tjob jobs[JOBS];
+  uint32_t nextDue=0; // the earliest deadline of the armed jobs
+  int ledJob=NO_JOB;
+  int commitJob=NO_JOB;
+#if LOOP_STATS
+  thistogram runStats; // the passes of run() that ran a job
+  uint32_t idlePasses=0; // passes with nothing due, these are not timed
+  uint32_t statsOverhead=0; // cycles the timing adds to each job
+  char command[16]; // serial command being typed
+  byte commandLength=0;
+#endif
+  uint32_t savedCRC=0; // CRC of the config as it is in flash
+ // logins
+  byte sessionKey[32]; // signs the session cookies, a new key at every boot or logout ends all sessions
+  tsession sessions[SESSIONS]={};
+  uint32_t assetTags[ASSETS]; // CRC of the uncompressed content of each asset
+  byte assetFiles[ASSETS]; // ASSET_PLAIN and ASSET_GZIP of the copies present, 0 when the asset is missing
+  tcacheentry assetCache[ASSETS*2]={}; // the plain and the gzip copy of each asset
+  uint32_t cacheBytes=0;
+  ttransfer transfers[ASYNC_TRANSFERS];
+  uint32_t cacheClock=0;
   public:
   char *author;
   char *copyright;
@@ -190,6 +654,12 @@ class tSysConfig{
   String SensorName;
   int SensorFrequency=100; // time in milliseconds
   bool validConfig=false;
+  uint32_t commitDelay=COMMIT_DELAY; // debounce window of commitConfig
+  uint32_t burnsAvoided=0; // commits that found the config unchanged and wrote nothing, counted alongside burncount
+  uint32_t cacheHits=0; // assets served from RAM
+  uint32_t cacheMisses=0; // assets read from SPIFFS
+  bool asyncFiles=true; // large files are sent from run() rather than blocking the handler until the client has them
+  uint32_t asyncBudget=ASYNC_BUDGET;
  public:
 // this is API to the Config system but the only routines that the user is required to utilize are tSysConfig(); & run();
 // if desired, the device name can be changed prior to calling init
@@ -198,7 +668,7 @@ class tSysConfig{
  // in the event the system is unconfigured, it will activate wps on reset
  
  htmlproperties webobj;
- ESP8266WebServer server;
+ tWebServer server;
  ESP8266WiFiMulti multiWiFi;
  WiFiUDP udp; 
  /* this is meant to engage an automated Configuration mode that connects to a predefined WiFi and then calls some functions to get the logo, CSS, about, help and initConfig files 
@@ -206,26 +676,53 @@ class tSysConfig{
  * firstrun also exposes the AP with the default device name in the format of TRL-xxxxxx with the password of TRLinitialize
  */ 
  void initNTP(); // time system
- void initWiFi();
- void scanWiFi();
+ void initWiFi(); // brings up the access point and starts the station connecting, without waiting for it
+ void scanWiFi(); // looks for the configured access points again and connects to the strongest, in the background
  bool WPS();
  void initWebserver(); // sets up the network and servers
  bool readConfig();// reads from the Configuration file, also enters system defaults to complete initialization routines
  void initConfig();// reads the Configuration file, also responsiible for calling firstrun if the Config files do not exist
  bool writeConfig();// writes to the Configuration file
+ void assetsChanged(); // call after writing files to SPIFFS, works out the ETags again and empties the asset cache
+ void commitConfig();// requests a save, run() writes it once no further request has come in for commitDelay
+ bool flushConfig();// writes a requested save now, skipping the write if nothing changed
+ uint32_t configCRC();// CRC of the config less the bookkeeping of the saves themselves
  void updateConfig();// reinitialize the unit
  void OTAinit(); // Over the air update system management
  void blink(); 
  void init(); // startup code
  void init(int WPS){WPSpin=WPS; init();}
- void run(); // called from the loop code to maintain periodic functions
+ uint32_t run(); // called from the loop code to maintain periodic functions, returns the ms until something is next due
+ void initJobs(); // schedules the periodic functions of the system
+ int schedule(const char *name, TJobFunction job, uint32_t period, uint32_t delay=0); // the id of the job, NO_JOB when the table is full
+ void setPeriod(int id, uint32_t period);
+ void wake(int id, uint32_t delay=0); // the job next runs delay ms from now, a one-shot job is armed for that one run
+ void cancel(int id);
+ void OTAhandle();
+ void stepWiFi(); // one step of the station state machine, run by the WiFi job
+ void setWiFiState(w_state state);
+ uint32_t wifiPeriod(); // the pace of the WiFi job in the current state
+ void pickCandidates(int found); // the configured access points among the scan results, strongest first
+ bool resumeWiFi(); // joins the access point of the last connection directly, false when nothing is cached
+ void onConnected();
+ void Metrics(); // /metrics, device health for Prometheus
+#if LOOP_STATS
+ void metricsSummary(tMetricsWriter &metrics, const char *name, const char *labels, const thistogram &h); // quantiles, sum and count in seconds
+#endif
+#if LOOP_STATS
+ bool serialCommands=true; // run() reads commands from Serial, clear it if the sketch reads Serial itself
+ void loopReport(Print &out); // the timing histograms as a text table
+ void clearStats();
+ void serialCommand();
+ void LoopStats(); // /loop.txt
+#endif
  // there are lots of web functions as this is a web based Configuration program
  void indexPage(void);
  // procedures to handle forms
- boolean isinteger(String str); 
- boolean isFloat(String str);
- boolean isTime(String str);
- boolean isIP(String str);
+ boolean isinteger(const String &str);
+ boolean isFloat(const String &str);
+ boolean isTime(const String &str);
+ boolean isIP(const String &str);
 
  // copy values from post function is overloaded and has default parameters, if min-max are equal, range is ignored otherwise range checking is used
  int32_t copyval(byte &var, char const *name, byte min=0, byte max=0);
@@ -239,8 +736,8 @@ class tSysConfig{
  // form creation support
  bool form(htmlproperties obj);// all forms are post request only
  bool form(); // if the buttoncaption is not included, then the standard send button is created
- void tab(char* tag);
- void fieldset(char* tag); // use to create groupboxes on the form
+ void tab(char const *tag);
+ void fieldset(char const *tag); // use to create groupboxes on the form
  void fieldset();
  void label(htmlproperties obj);
  bool edit(htmlproperties obj, char* data, int32_t size);
@@ -264,11 +761,11 @@ class tSysConfig{
  bool optiongroup(char const *name); //groups a value list
  bool optiongroup(); //terminates the group
 
- bool option(bool data, char *name);
- bool option(byte data, char *name);
- bool option(int32_t data, char *name);
- bool option(float data, char *name);
- bool option(char* data, char *name);
+ bool option(bool data, char const *name);
+ bool option(byte data, char const *name);
+ bool option(int32_t data, char const *name);
+ bool option(float data, char const *name);
+ bool option(char* data, char const *name);
  bool checkbox(htmlproperties obj, bool &data);
  bool checkbox(htmlproperties obj, int32_t &data);
  bool checkbox(htmlproperties obj, char* data, int32_t size);
@@ -285,6 +782,19 @@ class tSysConfig{
  // https://www.w3schools.com/tags/tag_details.asp
  void details(htmlproperties obj);
  void div();
+ // page generation, every generated page starts with renderBegin and ends with sendPage
+ tpagestats pagestats[PAGE_COUNT];
+ void renderBegin();
+ void sendPage(byte page);
+ bool streamPages=true; // when false, pages are built in the HTML string and sent in one piece
+ void pageBegin(); // starts the response
+ void pageEnd(); // completes the response
+ void html(const char *text); // adds text to the page
+ void html(const __FlashStringHelper *text);
+ void flushHTML(); // sends the buffered part of the page
+ bool isPost(); // true when the page is processing a form post
+ void benchPages(uint32_t loops); // builds every page repeatedly and reports the cost of each one
+ void Bench();
  // server page support functions
  void getAbout();
  void getCharts();// does the charting page
@@ -305,7 +815,21 @@ class tSysConfig{
  void getIcon();
  void getJS();
  void getSCjs();
+ void hashAssets(); // works out the ETags of the assets
+ void sendAsset(a_asset asset, int code=200); // streams an asset or answers 304 when the browser already has it
+ bool cacheAsset(tcacheentry &c, File &dataFile); // reads a small asset into the cache, false when it is streamed instead
+ void clearCache();
+ bool sendAsync(File &dataFile, const char *type, int code, bool gzip); // sends the headers and leaves the body to run(), false when no slot is free
+ void runTransfers(); // sends what the clients of the transfers will take, within asyncBudget
+ void endTransfer(ttransfer &t);
+ void dropAssets(); // forgets the cached assets and their ETags while SPIFFS is being replaced
+ void headLinks(); // the stylesheet and script of a page head, versioned so the browser keeps them
  bool webAuth(); // used by restricted Configuration pages
+ void sessionMAC(uint32_t id, uint32_t expiry, byte *mac); // the signature of a session cookie
+ bool validSession(); // the request carries the cookie of a live session
+ void Login(); // the login form, a correct post sets the session cookie
+ void Logout();
+ void dispatch(); // serves a request from the route table
  void handleNotFound();
  // to support a Configuration application, we have the JSON data exchanges, there are no individual pages in the JSON processing
  void JSON();// format bytes
@@ -313,6 +837,42 @@ class tSysConfig{
  String formatbytes(size_t bytes);
 };
 
+constexpr troute routes[]={
+ {"/", HTTP_ANY, r_open, &tSysConfig::indexPage},
+ {"/about.html", HTTP_ANY, r_open, &tSysConfig::getAbout},
+ {"/acl.html", HTTP_ANY, r_user, &tSysConfig::ACL},
+ {"/bench.html", HTTP_ANY, r_user, &tSysConfig::Bench},
+ {"/charts.html", HTTP_ANY, r_open, &tSysConfig::getCharts},
+ {"/config.html", HTTP_ANY, r_user, &tSysConfig::Config},
+ {"/favicon.ico", HTTP_ANY, r_open, &tSysConfig::getIcon},
+ {"/graph", HTTP_ANY, r_open, &tSysConfig::drawGraph},
+ {"/help.html", HTTP_ANY, r_open, &tSysConfig::getHelp},
+ {"/index", HTTP_ANY, r_open, &tSysConfig::indexPage},
+ {"/index.htm", HTTP_ANY, r_open, &tSysConfig::indexPage},
+ {"/index.html", HTTP_ANY, r_open, &tSysConfig::indexPage},
+ {"/login.html", HTTP_ANY, r_open, &tSysConfig::Login},
+ {"/logo.png", HTTP_ANY, r_open, &tSysConfig::getLogo},
+ {"/logout", HTTP_POST, r_open, &tSysConfig::Logout}, // a link or prefetch must not end the sessions
+#if LOOP_STATS
+ {"/loop.txt", HTTP_GET, r_user, &tSysConfig::LoopStats},
+#endif
+ {"/metrics", HTTP_GET, r_open, &tSysConfig::Metrics},
+ {"/mqtt.html", HTTP_ANY, r_user, &tSysConfig::MQTT},
+ {"/register.html", HTTP_ANY, r_user, &tSysConfig::Register},
+ {"/sc.js", HTTP_ANY, r_open, &tSysConfig::getSCjs},
+ {"/sensor.html", HTTP_ANY, r_user, &tSysConfig::Sensors},
+ {"/sysinfo.html", HTTP_ANY, r_open, &tSysConfig::Sysinfo},
+ {"/time.html", HTTP_ANY, r_user, &tSysConfig::Time},
+ {"/timer.html", HTTP_ANY, r_user, &tSysConfig::Timers},
+ {"/update.html", HTTP_ANY, r_user, &tSysConfig::OTA},
+ {"/w3.css", HTTP_ANY, r_open, &tSysConfig::getCSS},
+ {"/w3.js", HTTP_ANY, r_open, &tSysConfig::getJS}
+};
+#define ROUTES (sizeof(routes)/sizeof(troute))
+constexpr bool routesSorted(size_t i){ return (i+1>=ROUTES)||((uriCompare(routes[i].uri, routes[i+1].uri)<0)&&routesSorted(i+1));}
+static_assert(routesSorted(0), "routes must be sorted by uri");
+troutestats routeStats[ROUTES]; // requests served and time taken by each route
+
 void tSysConfig::init() {
  WiFi.persistent(false);
  pinMode(LED_BUILTIN, OUTPUT);
@@ -348,8 +908,9 @@ void tSysConfig::init() {
  initWebserver();
  initNTP();
  OTAinit(); // OTA update services 
+ initJobs();
 }
-void tSysConfig::run() {
+void tSysConfig::OTAhandle() {
  // as there is no stop or end function in ArduinoOTA, this hack is used to stop it functioning
  // there is no provision for on demand update in the code yet
  // noob value is to activate OTA
@@ -359,11 +920,377 @@ void tSysConfig::run() {
  case 0:break; // totally stopped
  default: ArduinoOTA.handle();
  }
- server.handleClient();
- MDNS.update(); 
- if (digitalRead(WPSpin)==0){WPS();}
- currentMillis = millis(); 
- blink(); 
+}
+
+void tSysConfig::setWiFiState(w_state state) {
+ if ((state==w_resume)||((state==w_scan)&&(wifiState!=w_resume))){ connectStart=millis();} // a scan after a failed resume is the same attempt
+ wifiState=state;
+ wifiStateMillis=millis();
+ setPeriod(wifiJob, wifiPeriod());
+}
+
+uint32_t tSysConfig::wifiPeriod() {
+ switch (wifiState){
+ case w_idle:
+ case w_connected: return WIFI_PERIOD;
+ case w_backoff: return wifiBackoff;
+ default: return WIFI_STEP;
+ }
+}
+
+void tSysConfig::stepWiFi() {
+ wl_status_t status=WiFi.status();
+ switch (wifiState){
+ case w_idle: // no access point is configured
+  if (status==WL_CONNECTED){ onConnected();} // unless the WPS button has since found one
+  break;
+ case w_resume:
+  if (status==WL_CONNECTED){ onConnected(); break;}
+  if ((status!=WL_CONNECT_FAILED)&&(status!=WL_NO_SSID_AVAIL)&&(millis()-wifiStateMillis<RESUME_TIMEOUT)){ break;}
+  Serial.println(F("WiFi cached access point did not answer"));
+  WiFi.disconnect();
+  setWiFiState(w_scan);
+  break;
+ case w_scan:
+  WiFi.scanNetworks(true);
+  setWiFiState(w_scanning);
+  break;
+ case w_scanning: {
+  int found=WiFi.scanComplete();
+  if (found==WIFI_SCAN_RUNNING){ break;}
+  pickCandidates(found);
+  WiFi.scanDelete();
+  candidate=0;
+  if (candidateCount){ setWiFiState(w_connect); break;}
+  Serial.println(F("WiFi found no configured network"));
+  setWiFiState(w_backoff);
+  break;
+ }
+ case w_connect: {
+  tcandidate &c=candidates[candidate];
+  STAconnected=false;
+  if (cachedLease){ // the access point may hand out a different address, so DHCP is asked again
+   WiFi.config(IPAddress(), IPAddress(), IPAddress());
+   cachedLease=false;
+  }
+  connectingAP=c.ap;
+  Serial.printf("WiFi connecting to %s, Ch:%d (%ddBm)\n", _data.AccessPoints[c.ap].WiFiname, c.channel, c.RSSI);
+  WiFi.begin(_data.AccessPoints[c.ap].WiFiname, _data.AccessPoints[c.ap].WiFipassword, c.channel, c.BSSID);
+  setWiFiState(w_connecting);
+  break;
+ }
+ case w_connecting:
+  if (status==WL_CONNECTED){ onConnected(); break;}
+  if ((status!=WL_CONNECT_FAILED)&&(status!=WL_NO_SSID_AVAIL)&&(millis()-wifiStateMillis<CONNECT_TIMEOUT)){ break;}
+  Serial.printf("WiFi failed to connect to %s\n", _data.AccessPoints[candidates[candidate].ap].WiFiname);
+  WiFi.disconnect();
+  if (++candidate<candidateCount){ setWiFiState(w_connect); break;}
+  if (!softAPup){ // with APconfig 0 the access point is only wanted once the station has failed
+   softAPup=WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel);
+   Serial.println(F("WiFi AP started"));
+  }
+  setWiFiState(w_backoff);
+  break;
+ case w_connected:
+  if (status==WL_CONNECTED){ break;}
+  STAconnected=false;
+  Serial.println(F("WiFi connection lost"));
+  if (!resumeWiFi()){ setWiFiState(w_scan);}
+  break;
+ case w_backoff:
+  if (status==WL_CONNECTED){ onConnected(); break;} // the WPS button may have connected meanwhile
+  wifiBackoff=wifiBackoff<WIFI_BACKOFF_MAX/2 ? wifiBackoff*2 : WIFI_BACKOFF_MAX;
+  setWiFiState(w_scan);
+  break;
+ }
+}
+
+void tSysConfig::pickCandidates(int found) {
+ candidateCount=0;
+ for (int i=0;i<found;i++){
+  WiFi.getNetworkInfo(i, ssid, encryptionType, RSSI, BSSID, channel, isHidden);
+  Serial.printf("%d: %s, Ch:%d (%ddBm) %s %s\r\n", i + 1, ssid.c_str(), channel, RSSI, encryptionType == ENC_TYPE_NONE ? "open" : "", isHidden ? "hidden" : "");
+  for (byte ap=0;ap<5;ap++){
+   if (!_data.AccessPoints[ap].WiFiname[0]||(ssid!=_data.AccessPoints[ap].WiFiname)){ continue;}
+   // insertion by signal strength, the weakest falls off the end when the list is full
+   byte at=candidateCount;
+   while ((at>0)&&(candidates[at-1].RSSI<RSSI)){ at--;}
+   if (at>=WIFI_CANDIDATES){ break;}
+   if (candidateCount<WIFI_CANDIDATES){ candidateCount++;}
+   memmove(&candidates[at+1], &candidates[at], (candidateCount-1-at)*sizeof(tcandidate));
+   candidates[at]={ap, RSSI, channel};
+   memcpy(candidates[at].BSSID, BSSID, 6);
+   break;
+  }
+ }
+}
+
+bool tSysConfig::resumeWiFi() {
+ byte ap=_data.lastAP;
+ if (!_data.lastChannel||(ap>=5)||!_data.AccessPoints[ap].WiFiname[0]||!_data.lastIP){ return false;}
+ Serial.printf("WiFi resuming %s, Ch:%d\n", _data.AccessPoints[ap].WiFiname, _data.lastChannel);
+ // the router keeps the lease for this MAC, so it is safe to take it again without asking
+ WiFi.config(IPAddress(_data.lastIP), IPAddress(_data.lastGateway), IPAddress(_data.lastSubnet), IPAddress(_data.lastDNS));
+ cachedLease=true;
+ connectingAP=ap;
+ WiFi.begin(_data.AccessPoints[ap].WiFiname, _data.AccessPoints[ap].WiFipassword, _data.lastChannel, _data.lastBSSID);
+ setWiFiState(w_resume);
+ return true;
+}
+
+void tSysConfig::onConnected() {
+ if (wifiEverConnected){ wifiReconnects++;}
+ wifiEverConnected=true;
+ STAconnected=true;
+ wifiBackoff=WIFI_BACKOFF;
+ connectTime=millis()-connectStart;
+ Serial.printf("WiFi connected in %u ms\n", connectTime);
+ Serial.println(F("IP address: "));
+ Serial.println(WiFi.localIP());
+ // the next connection goes straight back to this access point, the config is only written when it has changed
+ byte channel=WiFi.channel();
+ if (memcmp(_data.lastBSSID, WiFi.BSSID(), 6)||(_data.lastChannel!=channel)||(_data.lastAP!=connectingAP)
+  ||(_data.lastIP!=(uint32_t)WiFi.localIP())||(_data.lastGateway!=(uint32_t)WiFi.gatewayIP())
+  ||(_data.lastSubnet!=(uint32_t)WiFi.subnetMask())||(_data.lastDNS!=(uint32_t)WiFi.dnsIP(0))){
+  memcpy(_data.lastBSSID, WiFi.BSSID(), 6);
+  _data.lastChannel=channel;
+  _data.lastAP=connectingAP;
+  _data.lastIP=(uint32_t)WiFi.localIP();
+  _data.lastGateway=(uint32_t)WiFi.gatewayIP();
+  _data.lastSubnet=(uint32_t)WiFi.subnetMask();
+  _data.lastDNS=(uint32_t)WiFi.dnsIP(0);
+  commitConfig();
+ }
+ // give DNS servers to AP side, the station only has them once it is connected
+ dhcps_set_dns(0, WiFi.dnsIP(0));
+ dhcps_set_dns(1, WiFi.dnsIP(1));
+ Serial.println(F("Starting Time UDP"));
+ udp.begin(localPort);
+ Serial.print(F("Local port: "));
+ Serial.println(udp.localPort());
+ setWiFiState(w_connected);
+}
+
+#if LOOP_STATS
+void tSysConfig::metricsSummary(tMetricsWriter &metrics, const char *name, const char *labels, const thistogram &h) {
+ char quantile[48];
+ float scale=1e-6f/ESP.getCpuFreqMHz(); // cycles to seconds
+ snprintf(quantile, sizeof(quantile), "%s%squantile=\"0.5\"", labels ? labels : "", labels ? "," : "");
+ metrics.sample(name, quantile, histogramPercentile(h, 500)*scale);
+ snprintf(quantile, sizeof(quantile), "%s%squantile=\"0.99\"", labels ? labels : "", labels ? "," : "");
+ metrics.sample(name, quantile, histogramPercentile(h, 990)*scale);
+ metrics.sample(name, labels, h.totalCycles*scale, "_sum");
+ metrics.sample(name, labels, h.samples, "_count");
+}
+#endif
+
+void tSysConfig::Metrics() {
+ tMetricsWriter metrics(server);
+ char labels[48];
+ uint32_t heap=ESP.getFreeHeap();
+ metrics.begin();
+ metrics.family("esp_uptime_seconds", "counter", F("Time since boot."));
+ metrics.sample("esp_uptime_seconds", nullptr, (uint32_t)(micros64()/1000000));
+ metrics.family("esp_heap_free_bytes", "gauge", F("Free heap."));
+ metrics.sample("esp_heap_free_bytes", nullptr, heap);
+ metrics.family("esp_heap_max_block_bytes", "gauge", F("Largest block that can be allocated."));
+ metrics.sample("esp_heap_max_block_bytes", nullptr, (uint32_t)ESP.getMaxFreeBlockSize());
+ metrics.family("esp_heap_fragmentation_percent", "gauge", F("Share of the free heap that is not in the largest block."));
+ metrics.sample("esp_heap_fragmentation_percent", nullptr, (uint32_t)(ESP.getHeapFragmentation()));
+ metrics.family("esp_config_writes_total", "counter", F("Config saves written to flash."));
+ metrics.sample("esp_config_writes_total", nullptr, (uint32_t)_data.burncount);
+ metrics.family("esp_config_writes_avoided_total", "counter", F("Config saves skipped because nothing had changed."));
+ metrics.sample("esp_config_writes_avoided_total", nullptr, burnsAvoided);
+ metrics.family("esp_wifi_connected", "gauge", F("1 while the station is connected to an access point."));
+ metrics.sample("esp_wifi_connected", nullptr, (uint32_t)STAconnected);
+ if (STAconnected){
+  metrics.family("esp_wifi_rssi_dbm", "gauge", F("Signal strength of the access point the station is connected to."));
+  metrics.sample("esp_wifi_rssi_dbm", nullptr, (int32_t)WiFi.RSSI());
+ }
+ metrics.family("esp_wifi_reconnects_total", "counter", F("Times the station link came back after it was lost."));
+ metrics.sample("esp_wifi_reconnects_total", nullptr, wifiReconnects);
+ metrics.family("esp_wifi_connect_seconds", "gauge", F("Time the last connection took, from the first attempt to the address."));
+ metrics.sample("esp_wifi_connect_seconds", nullptr, connectTime*1e-3f);
+ if (naptEnabled){
+  stats_ip_napt napt;
+  ip_napt_get_stats(&napt);
+  metrics.family("esp_napt_table_size", "gauge", F("Entries the NAPT table can hold."));
+  metrics.sample("esp_napt_table_size", nullptr, (uint32_t)NAPT);
+  metrics.family("esp_napt_entries", "gauge", F("NAPT table entries in use by protocol."));
+  metrics.sample("esp_napt_entries", "protocol=\"tcp\"", (uint32_t)napt.nr_active_tcp);
+  metrics.sample("esp_napt_entries", "protocol=\"udp\"", (uint32_t)napt.nr_active_udp);
+  metrics.sample("esp_napt_entries", "protocol=\"icmp\"", (uint32_t)napt.nr_active_icmp);
+  metrics.family("esp_napt_evictions_total", "counter", F("NAPT entries dropped to make room for new ones."));
+  metrics.sample("esp_napt_evictions_total", nullptr, (uint32_t)napt.nr_forced_evictions);
+ }
+ metrics.family("esp_http_request_duration_seconds", "summary", F("Time taken to serve each route."));
+ for (byte i=0;i<ROUTES;i++){
+  snprintf(labels, sizeof(labels), "route=\"%s\"", routes[i].uri);
+  metrics.sample("esp_http_request_duration_seconds", labels, routeStats[i].totalMicros*1e-6f, "_sum");
+  metrics.sample("esp_http_request_duration_seconds", labels, routeStats[i].hits, "_count");
+ }
+ metrics.family("esp_http_request_duration_max_seconds", "gauge", F("Longest time taken to serve each route."));
+ for (byte i=0;i<ROUTES;i++){
+  snprintf(labels, sizeof(labels), "route=\"%s\"", routes[i].uri);
+  metrics.sample("esp_http_request_duration_max_seconds", labels, routeStats[i].maxMicros*1e-6f);
+ }
+#if LOOP_STATS
+ metrics.family("esp_loop_pass_duration_seconds", "summary", F("Passes of run() that ran a job."));
+ metricsSummary(metrics, "esp_loop_pass_duration_seconds", nullptr, runStats);
+ metrics.family("esp_loop_pass_duration_max_seconds", "gauge", F("Longest pass of run()."));
+ metrics.sample("esp_loop_pass_duration_max_seconds", nullptr, (float)runStats.maxCycles/ESP.getCpuFreqMHz()*1e-6f);
+ metrics.family("esp_loop_idle_passes_total", "counter", F("Passes of run() that found nothing due."));
+ metrics.sample("esp_loop_idle_passes_total", nullptr, idlePasses);
+ metrics.family("esp_job_duration_seconds", "summary", F("Time taken by each scheduled job."));
+ for (byte i=0;i<JOBS;i++){
+  if (!jobs[i].job){ continue;}
+  snprintf(labels, sizeof(labels), "job=\"%s\"", jobs[i].name ? jobs[i].name : "job");
+  metricsSummary(metrics, "esp_job_duration_seconds", labels, jobs[i].stats);
+ }
+ metrics.family("esp_job_duration_max_seconds", "gauge", F("Longest time taken by each scheduled job."));
+ for (byte i=0;i<JOBS;i++){
+  if (!jobs[i].job){ continue;}
+  snprintf(labels, sizeof(labels), "job=\"%s\"", jobs[i].name ? jobs[i].name : "job");
+  metrics.sample("esp_job_duration_max_seconds", labels, (float)jobs[i].stats.maxCycles/ESP.getCpuFreqMHz()*1e-6f);
+ }
+#endif
+ metrics.end();
+}
+
+void tSysConfig::initJobs() {
+ schedule("web", [this](){ server.handleClient();}, WEB_PERIOD);
+ schedule("files", [this](){ runTransfers();}, WEB_PERIOD);
+ schedule("OTA", [this](){ OTAhandle();}, OTA_PERIOD);
+ schedule("MDNS", [this](){ MDNS.update();}, MDNS_PERIOD);
+ if (WPSpin>0){ schedule("WPS", [this](){ if (digitalRead(WPSpin)==0){ WPS();}}, WPS_PERIOD);} // without a button pin there is nothing to read
+ wifiJob=schedule("WiFi", [this](){ stepWiFi();}, wifiPeriod()); // the pace of the state initWiFi() left it in, without entering it again
+ ledJob=schedule("LED", [this](){ blink(); setPeriod(ledJob, blinkstate>3 ? FAST_BLINK : SLOW_BLINK);}, SLOW_BLINK);
+ commitJob=schedule("config", [this](){ if (commitPending){ flushConfig();}}, 0);
+ if (commitPending){ wake(commitJob, commitDelay);} // a commit made before the jobs existed, the WPS connect in initWiFi() among them
+#if LOOP_STATS
+ schedule("serial", [this](){ if (serialCommands){ serialCommand();}}, SERIAL_PERIOD);
+ clearStats();
+#endif
+}
+
+int tSysConfig::schedule(const char *name, TJobFunction job, uint32_t period, uint32_t delay) {
+ for (int i=0;i<JOBS;i++){
+  tjob &j=jobs[i];
+  if (j.job){ continue;}
+  j=tjob();
+  j.job=job;
+  j.name=name;
+  j.period=period;
+  j.armed=false;
+  if (period){ wake(i, delay);}
+  return i;
+ }
+ return NO_JOB;
+}
+
+void tSysConfig::setPeriod(int id, uint32_t period) {
+ if ((id<0)||(id>=JOBS)){ return;}
+ jobs[id].period=period;
+ if (period){ wake(id, period);} // the new period counts from now
+}
+
+void tSysConfig::wake(int id, uint32_t delay) {
+ if ((id<0)||(id>=JOBS)||!jobs[id].job){ return;}
+ tjob &j=jobs[id];
+ j.due=millis()+delay;
+ j.armed=true;
+ if ((int32_t)(j.due-nextDue)<0){ nextDue=j.due;}
+}
+
+#if LOOP_STATS
+void tSysConfig::clearStats() {
+ for (byte i=0;i<JOBS;i++){ memset(&jobs[i].stats, 0, sizeof(thistogram));}
+ memset(&runStats, 0, sizeof(runStats));
+ idlePasses=0;
+ // timing a job costs two reads of the cycle counter and a record, measured here on a scratch histogram
+ thistogram scratch={};
+ uint32_t start=ESP.getCycleCount();
+ for (byte i=0;i<16;i++){
+  uint32_t t=ESP.getCycleCount();
+  recordCycles(scratch, ESP.getCycleCount()-t);
+ }
+ statsOverhead=(ESP.getCycleCount()-start)/16;
+}
+
+void tSysConfig::loopReport(Print &out) {
+ uint32_t mhz=ESP.getCpuFreqMHz();
+ uint32_t samples=runStats.samples;
+ for (byte i=0;i<JOBS;i++){ samples+=jobs[i].stats.samples;}
+ out.printf("%u MHz, %u idle passes, timing costs %u cycles a job, %.2f%% of the time in run()\r\n", mhz, idlePasses, statsOverhead,
+  runStats.totalCycles ? 100.0f*statsOverhead*samples/runStats.totalCycles : 0.0f);
+ out.printf("%-8s %9s %9s %9s %9s %9s\r\n", "stage", "samples", "mean us", "p50 us", "p99 us", "max us");
+ statsLine(out, "run", runStats, mhz);
+ for (byte i=0;i<JOBS;i++){
+  if (jobs[i].job){ statsLine(out, jobs[i].name ? jobs[i].name : "job", jobs[i].stats, mhz);}
+ }
+}
+
+void tSysConfig::serialCommand() {
+ while (Serial.available()){
+  char c=Serial.read();
+  if ((c!='\r')&&(c!='\n')){
+   if (commandLength<sizeof(command)-1){ command[commandLength++]=c;}
+   continue;
+  }
+  command[commandLength]=0;
+  if (strcmp(command, "stats")==0){ loopReport(Serial);}
+  else if (strcmp(command, "stats reset")==0){ clearStats(); Serial.println("stats cleared");}
+  commandLength=0;
+ }
+}
+
+void tSysConfig::LoopStats() {
+ StreamString text;
+ loopReport(text);
+ server.send(200, "text/plain", text);
+}
+#endif
+
+void tSysConfig::cancel(int id) {
+ if ((id>=0)&&(id<JOBS)){ jobs[id]=tjob();}
+}
+
+uint32_t tSysConfig::run() {
+ uint32_t now=millis();
+ if ((int32_t)(nextDue-now)>0){
+#if LOOP_STATS
+  idlePasses++;
+#endif
+  return nextDue-now;
+ }
+#if LOOP_STATS
+ uint32_t passStart=ESP.getCycleCount();
+#endif
+ currentMillis=now;
+ for (byte i=0;i<JOBS;i++){
+  tjob &j=jobs[i];
+  if (!j.armed||((int32_t)(j.due-now)>0)){ continue;}
+  // the deadline moves before the call, so a job may wake or reschedule itself
+  j.armed=j.period>0;
+  j.due=now+j.period;
+#if LOOP_STATS
+  uint32_t start=ESP.getCycleCount();
+  j.job();
+  recordCycles(j.stats, ESP.getCycleCount()-start);
+#else
+  j.job();
+#endif
+ }
+ // jobs that ran may have woken others, so the next deadline is found once they have all run
+ now=millis();
+ nextDue=now+JOB_IDLE;
+ for (byte i=0;i<JOBS;i++){
+  if (jobs[i].armed&&((int32_t)(jobs[i].due-nextDue)<0)){ nextDue=jobs[i].due;}
+ }
+#if LOOP_STATS
+ recordCycles(runStats, ESP.getCycleCount()-passStart);
+#endif
+ return (int32_t)(nextDue-now)>0 ? nextDue-now : 0;
 }
 
 void tSysConfig::initNTP() {
@@ -372,56 +1299,50 @@ void tSysConfig::initNTP() {
 }
 
 void tSysConfig::initWebserver() {
- server.on("/", [&]{ indexPage(); });
- server.on("/index", [&]{ indexPage(); });
- server.on("/index.htm", [&]{ indexPage(); });
- server.on("/index.html", [&]{ indexPage(); });
- server.on("/charts.html", [&]{ getCharts();} );
- server.on("/graph", [&]{ drawGraph();} );
- server.on("/config.html", [&]{  if (!server.authenticate(_data.userName, _data.userPass)) {
-      return server.requestAuthentication();
-    }
-   Config(); });
- server.on("/sensor.html", [&]{ if (!server.authenticate(_data.userName, _data.userPass)) {
-      return server.requestAuthentication();
-    }
- Sensors(); });
- server.on("/timer.html", [&]{ if (!server.authenticate(_data.userName, _data.userPass)) {
-      return server.requestAuthentication();
-    }
- Timers(); });
- server.on("/time.html", [&]{ if (!server.authenticate(_data.userName, _data.userPass)) {
-      return server.requestAuthentication();
-    }
- Time(); });
- server.on("/update.html", [&]{ if (!server.authenticate(_data.userName, _data.userPass)) {
-      return server.requestAuthentication();
-    }
- OTA(); });
- server.on("/acl.html", [&]{ if (!server.authenticate(_data.userName, _data.userPass)) {
-      return server.requestAuthentication();
-    }
- ACL(); });
- server.on("/register.html", [&]{ if (!server.authenticate(_data.userName, _data.userPass)) {
-      return server.requestAuthentication();
-    }
- Register(); });
- server.on("/mqtt.html", [&]{ if (!server.authenticate(_data.userName, _data.userPass)) {
-      return server.requestAuthentication();
-    }
- MQTT(); });
- server.on("/sysinfo.html", [&]{ Sysinfo(); });
- server.on("/help.html", [&]{ getHelp(); });
- server.on("/about.html", [&]{ getAbout(); });
- server.on("/favicon.ico", [&] { getIcon();} );
- server.on("/logo.png", [&]{ getLogo();} );
- server.on("/w3.css", [&]{ getCSS();} );
- server.on("/w3.js", [&]{ getJS();} );
- server.on("/sc.js", [&]{ getSCjs();} );
- server.onNotFound([&](){ handleNotFound(); });
+ // every request falls through to the route table, see routes
+ const char *headers[]={"If-None-Match", "Accept-Encoding", "Cookie"}; // the web server only keeps the request headers it is asked for
+ server.collectHeaders(headers, 3);
+ ESP.random(sessionKey, sizeof(sessionKey));
+ server.onNotFound([&](){ dispatch(); });
  server.begin();
 }
 
+void tSysConfig::dispatch(){
+ const String &uri=server.uri();
+ server.countRequest();
+ int lo=0;
+ int hi=ROUTES-1;
+ while (lo<=hi){
+  int mid=(lo+hi)/2;
+  int c=strcmp(uri.c_str(), routes[mid].uri);
+  if (c<0){ hi=mid-1;}
+  else if (c>0){ lo=mid+1;}
+  else {
+   const troute &r=routes[mid];
+   if ((r.method!=HTTP_ANY)&&(r.method!=server.method())){
+    // the path exists, so the client is told the method it takes rather than that there is nothing here
+    server.sendHeader("Allow", methodName(r.method));
+    return server.send(405);
+   }
+   if ((r.auth==r_user)&&!webAuth()){
+    // browsers are sent to the login form, clients that tried Basic auth are asked again
+    if (server.hasHeader("Authorization")){ return server.requestAuthentication();}
+    server.sendHeader("Location", "/login.html?page=" + uri);
+    return server.send(303);
+   }
+   troutestats &s=routeStats[mid];
+   uint32_t start=micros();
+   (this->*r.handler)();
+   uint32_t t=micros()-start;
+   s.hits++;
+   s.totalMicros+=t;
+   if (t>s.maxMicros){ s.maxMicros=t;}
+   return;
+  }
+ }
+ handleNotFound();
+}
+
 bool tSysConfig::readConfig(){
 // read the parameters from flash
  Serial.println("Opening SPIFFS /config.bin");
@@ -432,12 +1353,15 @@ bool tSysConfig::readConfig(){
  if (!ConfigFile) {Serial.println("No manufacturers config file"); return false;}
  }
 size_t size = ConfigFile.size();
- if (size != sizeof(_data)) {
+ if ((size != sizeof(_data))&&(size != CONFIG_SHORT_SIZE)) {
  Serial.println("Config file size is invalid");
+ ConfigFile.close();
  return false;
  }
- ConfigFile.read((byte*) &_data, sizeof(_data));
+ memset((byte*) &_data+CONFIG_SHORT_SIZE, 0, sizeof(_data)-CONFIG_SHORT_SIZE); // nothing is cached in a short file
+ ConfigFile.read((byte*) &_data, size);
  ConfigFile.close();
+ savedCRC=configCRC();
  if (_data.OTA==3){_data.OTA=4;}// ensures OTA is off at reboot
  return true;
 }
@@ -455,6 +1379,7 @@ void tSysConfig::initConfig() {
  }
  Serial.println();
  readConfig();
+ hashAssets();
  Serial.print("Last Config:");
  Serial.println(_data.burntime);
  Serial.print("Burn count:");
@@ -511,47 +1436,22 @@ bool tSysConfig::WPS(){
         Serial.printf("WPS finished. Connected successfull to SSID '%s':'%s'\n", newSSID.c_str(),psk.c_str());
        strlcpy(_data.AccessPoints[0].WiFiname,newSSID.c_str(),32);
        strlcpy(_data.AccessPoints[0].WiFipassword, psk.c_str(),32);
+       connectingAP=0;
        writeConfig();
       } 
   } 
 WiFi.mode(WIFI_AP_STA);// needs to be in this mode for normal operations
+ return wpsSuccess;
 }
 
 void tSysConfig::initWiFi(){
- byte retries = 0;
 WiFi.mode(WIFI_AP_STA);
  WiFi.disconnect();
- // scan for available networks
- scanWiFi();
- for ( byte i = 0; i < 5; i++ ) {
- multiWiFi.addAP(_data.AccessPoints[i].WiFiname, _data.AccessPoints[i].WiFipassword);
- }
+ WiFi.setAutoReconnect(false); // stepWiFi() finds the strongest access point again instead
  WiFi.beginSmartConfig();
  if (!validConfig){
-   WPS();
- } else {
- // WiFi.begin(_data.AccessPoints[0].WiFiname, _data.AccessPoints[0].WiFipassword); 
- // wait for connection here
- while ((multiWiFi.run() != WL_CONNECTED) && (retries<30)) {
- delay(500);
- Serial.print(".");
- ++retries;
- }
- if (WiFi.status() == WL_CONNECTED){
- STAconnected=true;
- Serial.println("");
- Serial.println(F("WiFi connected"));
- Serial.println(F("IP address: "));
- Serial.println(WiFi.localIP());
- Serial.println(F("Starting Time UDP"));
- udp.begin(localPort);
- Serial.print(F("Local port: "));
- Serial.println(udp.localPort());
+   WPS(); // the SDK waits for the router here, an unconfigured device has nothing else to connect to
  }
- else{
- Serial.println(F("WiFi failed to connect"));
- }
-}
  WiFi.softAPConfig(_data.ip,_data.gateway,_data.subnet);
  // check if wifi is connected and what the AP rules are
  // Turn on local Access point
@@ -567,22 +1467,24 @@ WiFi.mode(WIFI_AP_STA);
     IPAddress(172, 217, 28, 254),
     IPAddress(255, 255, 255, 0));
    }
-   // give DNS servers to AP side
-   dhcps_set_dns(0, WiFi.dnsIP(0));
-   dhcps_set_dns(1, WiFi.dnsIP(1));
-   WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel);
+   // the AP side is given DNS servers once the station has them, see onConnected()
+   softAPup=WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel);
    err_t ret = ip_napt_init(NAPT, NAPT_PORT);
    if (ret == ERR_OK) {
     ret = ip_napt_enable_no(SOFTAP_IF, 1);
-    if (ret == ERR_OK) {
-    }
+    naptEnabled=ret == ERR_OK;
    }
    break;
  }
  case 4: {}// mesh mode
  }
-if (WiFi.status() != WL_CONNECTED){ 
-  WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel); 
+ bool configured=false;
+ for ( byte i = 0; i < 5; i++ ) { configured|=_data.AccessPoints[i].WiFiname[0]!=0;}
+ if (WiFi.status() == WL_CONNECTED){ onConnected();} // WPS has connected
+ else if (!configured){ setWiFiState(w_idle);}
+ else if (!resumeWiFi()){ scanWiFi();}
+if (!softAPup&&!configured&&!STAconnected){ // nothing to connect to, the AP is the only way in
+  softAPup=WiFi.softAP(_data.APname, _data.APpassword, _data.APchannel); 
   Serial.println(F("WiFi AP started"));} 
   Serial.println(_data.APname);
   Serial.println(_data.APpassword);
@@ -603,6 +1505,31 @@ bool tSysConfig::writeConfig() {
  return readConfig();
 }
 
+void tSysConfig::commitConfig() {
+ commitPending=true;
+ wake(commitJob, commitDelay); // a later request moves the write back again
+}
+
+bool tSysConfig::flushConfig() {
+ commitPending=false;
+ if (configCRC()==savedCRC){
+  burnsAvoided++;
+  Serial.print("Config unchanged, writes avoided:");
+  Serial.println(burnsAvoided);
+  return true;
+ }
+ return writeConfig();
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof" // see CONFIG_SHORT_SIZE
+uint32_t tSysConfig::configCRC() {
+ uint32_t crc=crc32((byte*) &_data, offsetof(dataframe, burncount));
+ crc=crc32((byte*) &_data+offsetof(dataframe, userName), offsetof(dataframe, checksum)-offsetof(dataframe, userName), crc);
+ return crc32((byte*) &_data+CONFIG_SHORT_SIZE, sizeof(_data)-CONFIG_SHORT_SIZE, crc);
+}
+#pragma GCC diagnostic pop
+
 void tSysConfig::updateConfig() {
  // intended to reinitialize the ESP without rebooting
 }
@@ -610,7 +1537,7 @@ void tSysConfig::updateConfig() {
 void tSysConfig::blink() {
  int32_t t=SLOW_BLINK;
 if (blinkstate>3) {t=FAST_BLINK;}
- if (currentMillis - lastBlinkMillis > t)
+ if (currentMillis - lastBlinkMillis >= t)
  {
  LEDstate++;
  if (LEDstate>31){LEDstate=0;}
@@ -641,12 +1568,14 @@ if (blinkstate>3) {t=FAST_BLINK;}
  }
 }
 void tSysConfig::OTAinit(){ 
- ArduinoOTA.onStart([]() {
+ ArduinoOTA.onStart([&]() {
  String type;
  if (ArduinoOTA.getCommand() == U_FLASH)
   type = "sketch";
- else // U_SPIFFS
+ else { // U_SPIFFS
   type = "filesystem";
+  dropAssets(); // nothing cached or revalidated from the files being replaced
+ }
  // NOTE: if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
  Serial.println("Start updating " + type);
  });
@@ -669,22 +1598,17 @@ void tSysConfig::OTAinit(){
  }
  
 void tSysConfig::indexPage(void) {
-  File dataFile = SPIFFS.open("/index.html", "r"); 
- if (dataFile.size()<=0) {Serial.println("bad file size");
- }
- if (server.streamFile(dataFile, "text/html") != dataFile.size()) {Serial.println(F("index.html streaming error"));
- }
- dataFile.close(); 
+ sendAsset(a_index);
 }
 void tSysConfig::Config(){ 
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Config Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\">");
- HTML+=F("<script type=\"text/javascript\" src=\"sc.js\"></script>");
- HTML+=F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">");
- HTML+=F("WiFi configuration <button onclick=\"openTab('A')\">WiFi connection</button>");
- HTML+=F("<button onclick=\"openTab('B')\">AP</button>");
- if (hasBluetooth){ HTML+=F("<button onclick=\"openTab('C')\">Bluetooth</button>");}
- HTML+=F("</div>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Config Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("WiFi configuration <button onclick=\"openTab('A')\">WiFi connection</button>"));
+ html(F("<button onclick=\"openTab('B')\">AP</button>"));
+ if (hasBluetooth){ html(F("<button onclick=\"openTab('C')\">Bluetooth</button>"));}
+ html(F("</div>"));
  
  webobj.css=F("w3-container w3-card-4 w3-light-grey w3-text-blue w3-margin");
  webobj.value="";
@@ -773,18 +1697,16 @@ void tSysConfig::Config(){
  
  fieldset();
  form();
-   if ( server.method() == HTTP_POST ){ writeConfig();}
- HTML+=F("</body></html>");
- server.send(200, "text/html", HTML);
- server.client().stop();
- HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder="";
+   if ( isPost() ){ commitConfig();}
+ html(F("</body></html>"));
+ sendPage(PAGE_CONFIG);
 }
 void tSysConfig::Time(){ 
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Config Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\">");
- HTML+=F("<script type=\"text/javascript\" src=\"sc.js\"></script>");
- HTML+=F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">");
- HTML+=F("Time settings</div>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Config Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("Time settings</div>"));
  
  webobj.css=F("w3-container w3-card-4 w3-light-grey w3-text-blue w3-margin");
  webobj.value="";
@@ -812,18 +1734,16 @@ void tSysConfig::Time(){
  editTime(webobj,_data.DST);
 
  form();
-   if ( server.method() == HTTP_POST ){ writeConfig();}
- HTML+=F("</body></html>");
- server.send(200, "text/html", HTML);
- server.client().stop();
- HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder="";
+   if ( isPost() ){ commitConfig();}
+ html(F("</body></html>"));
+ sendPage(PAGE_TIME);
 }
 void tSysConfig::OTA(){ 
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Config Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\">");
- HTML+=F("<script type=\"text/javascript\" src=\"sc.js\"></script>");
- HTML+=F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">");
- HTML+=F("Bios Updates</div>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Config Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("Bios Updates</div>"));
  
  webobj.css=F("w3-container w3-card-4 w3-light-grey w3-text-blue w3-margin");
  webobj.value="";
@@ -850,32 +1770,32 @@ void tSysConfig::OTA(){
 
  fieldset();
  form();
-   if ( server.method() == HTTP_POST ){ writeConfig();}
- HTML+=F("</body></html>");
- server.send(200, "text/html", HTML);
- server.client().stop();
- HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder="";
+   if ( isPost() ){ commitConfig();}
+ html(F("</body></html>"));
+ sendPage(PAGE_OTA);
 }
 void tSysConfig::Sensors(){
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Sensor Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\"><script src=\"sc.js\"></script></head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">");
- HTML+=F("Sensor configuration</div>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Sensor Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("Sensor configuration</div>"));
  webobj.name="sensors";
  form(webobj);
  
  form();
-    if ( server.method() == HTTP_POST ){ writeConfig();}
-HTML+=F("</body></html>");
- server.send(200, "text/html", HTML);
- server.client().stop();
- HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder="";
+    if ( isPost() ){ commitConfig();}
+html(F("</body></html>"));
+ sendPage(PAGE_SENSORS);
 }
 void tSysConfig::Timers(){ 
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\"><script src=\"sc.js\"></script></head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">Timers</div>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">Timers</div>"));
  webobj.name="timers";
  form(webobj); 
- HTML+=F("<table id = \"tt\"></table><script>var time, i, id, x = \"\";\r\n var time ='{\"alarms\":[");
+ html(F("<table id = \"tt\"></table><script>var time, i, id, x = \"\";\r\n var time ='{\"alarms\":["));
  
 /* add the variables here for the form, deliberately ignore blank entries on the first pass and include them as an addendum so that 
  *  all active timers go to the top of the page
@@ -885,7 +1805,7 @@ void tSysConfig::Timers(){
  char name[16];
  for(int i = 0; i<16 ;i++) 
  { 
-  if ( server.method() == HTTP_POST ){
+  if ( isPost() ){
    sprintf(name,"st_%d",i);
    error=copyval(_data.timers[i].startTime,name);
    sprintf(name,"et_%d",i);
@@ -903,31 +1823,31 @@ void tSysConfig::Timers(){
    sprintf(buffer,",[\"%02d:%02d\",\"%02d:%02d\",%d]",stime.Hour, stime.Minute, etime.Hour, etime.Minute, _data.timers[i].dow); } else {
    sprintf(buffer,"[\"%02d:%02d\",\"%02d:%02d\",%d]",stime.Hour, stime.Minute, etime.Hour, etime.Minute, _data.timers[i].dow);         
    }
-   HTML+=buffer;
+   html(buffer);
   }// else {++dis;}// dont add a variable, instead we give a count in the json object to let the script know how many blank fields to add
  }
 
   sprintf(buffer,"]}';\r\n");
 // dynamically create the form 
- HTML+=buffer;
- HTML+=F("var times = JSON.parse(time);\r\n  id=0;\r\n  for (i in times.alarms) {\r\n ++id; x+=\"<tr><td>\"+ id +\"</td><td><input type=\\\"time\\\" name=\\\"st_\"+i+");
- HTML+=F("\"\\\" value=\\\"\" + times.alarms[i][0] + \"\\\"></td><td><input type=\\\"time\\\" name=\\\"et_\"+i+\"\\\" value=\\\"\" + times.alarms[i][1] +");  
- HTML+=F("\"\\\"></td><td><select name=\\\"d_\"+i+\"\\\" value=\\\"\" + times.alarms[i][2]+");
- HTML+=F("\"\\\"><option value=0>Disabled</option><option value=1>Sun</option><option value=2>Mon</option><option value=3>Tue</option><option value=4>Wed</option><option value=5>Thu</option><option value=6>Fri</option><option value=7>Sat</option><option value=8>Daily</option><option value=9>Once</option></select></td></tr>\";");
- HTML+=F("}\r\n  document.getElementById(\"tt\").innerHTML = \"<TR><TD>ID</td><td>Start</td><td>Stop</td><td><abbr title=\\\"Day of week\\\">DOW<abbr></TD></tr>\"+x; </script>");
+ html(buffer);
+ html(F("var times = JSON.parse(time);\r\n  id=0;\r\n  for (i in times.alarms) {\r\n ++id; x+=\"<tr><td>\"+ id +\"</td><td><input type=\\\"time\\\" name=\\\"st_\"+i+"));
+ html(F("\"\\\" value=\\\"\" + times.alarms[i][0] + \"\\\"></td><td><input type=\\\"time\\\" name=\\\"et_\"+i+\"\\\" value=\\\"\" + times.alarms[i][1] +"));  
+ html(F("\"\\\"></td><td><select name=\\\"d_\"+i+\"\\\" value=\\\"\" + times.alarms[i][2]+"));
+ html(F("\"\\\"><option value=0>Disabled</option><option value=1>Sun</option><option value=2>Mon</option><option value=3>Tue</option><option value=4>Wed</option><option value=5>Thu</option><option value=6>Fri</option><option value=7>Sat</option><option value=8>Daily</option><option value=9>Once</option></select></td></tr>\";"));
+ html(F("}\r\n  document.getElementById(\"tt\").innerHTML = \"<TR><TD>ID</td><td>Start</td><td>Stop</td><td><abbr title=\\\"Day of week\\\">DOW<abbr></TD></tr>\"+x; </script>"));
 
  form();
-   if ( server.method() == HTTP_POST ){ writeConfig();}
- HTML+=F("</body></html>"); 
- server.send(200, "text/html", HTML);
- server.client().stop();
- HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder="";
+   if ( isPost() ){ commitConfig();}
+ html(F("</body></html>")); 
+ sendPage(PAGE_TIMERS);
 }
 
 void tSysConfig::ACL(){ 
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\"><script src=\"sc.js\"></script></head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">");
- HTML+=F("Access control</div>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("Access control</div>"));
  webobj.name="ACL";
  form(webobj);
  webobj.name="fname";
@@ -940,20 +1860,16 @@ void tSysConfig::ACL(){
  password(webobj,_data.userPass,32);
  
  form();
-   if ( server.method() == HTTP_POST ){ writeConfig();}
- HTML+=F("</body></html>"); 
- server.send(200, "text/html", HTML);
- server.client().stop();
- HTML=""; 
- webobj.name=""; 
- webobj.css="";
- webobj.label=""; 
- webobj.placeholder="";
+   if ( isPost() ){ commitConfig();}
+ html(F("</body></html>")); 
+ sendPage(PAGE_ACL);
 }
 void tSysConfig::Register(){ 
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\"><script src=\"sc.js\"></script></head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">");
- HTML+=F("Device registration</div>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("Device registration</div>"));
  webobj.name="register";
  form(webobj);
  webobj.name="fname";
@@ -977,146 +1893,412 @@ void tSysConfig::Register(){
  webobj.placeholder="Device Name";
  edit(webobj,_data.NodeName,32);
  form();
-    if ( server.method() == HTTP_POST ){ writeConfig();}
- HTML+=F("</body></html>"); 
- server.send(200, "text/html", HTML);
- server.client().stop();
- HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder="";
+    if ( isPost() ){ commitConfig();}
+ html(F("</body></html>")); 
+ sendPage(PAGE_REGISTER);
 }
 void tSysConfig::MQTT(){ 
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\"><script src=\"sc.js\"></script></head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">");
- HTML+=F("MQTT configuration</div>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("MQTT configuration</div>"));
  webobj.name="MQTT";
  form(webobj);
  
  form();
- HTML+=F("</body></html>"); 
- server.send(200, "text/html", HTML); 
- server.client().stop();
-
- HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder="";
+ html(F("</body></html>")); 
+ sendPage(PAGE_MQTT);
 }
 
 void tSysConfig::Sysinfo(){ 
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\"><script src=\"sc.js\"></script></head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">");
- HTML+=F("Sysinfo</div><table class=\"w3-table w3-striped w3-border\"><tr><th>Parameter</th><th>Value</th></tr>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("Sysinfo</div><table class=\"w3-table w3-striped w3-border\"><tr><th>Parameter</th><th>Value</th></tr>"));
  sprintf(buffer," <tr><td>ESP 8266 Chip id</td><td>%08X</td></tr>",ESP.getChipId());
- HTML+=buffer;
+ html(buffer);
  
  sprintf(buffer," <tr><td>SDK version</td><td>%s</td></tr>",ESP.getSdkVersion());
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Core version</td><td>%s</td></tr>",ESP.getCoreVersion().c_str());
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Boot version</td><td>%u</td></tr>", ESP.getBootVersion());
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Boot mode</td><td>%u</td></tr>", ESP.getBootMode());
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>CPU frequency</td><td>%u MHz</td></tr>", ESP.getCpuFreqMHz());
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Reset Reason</td><td>%s</td></tr>", ESP.getResetReason().c_str());
- HTML+=buffer;
+ html(buffer);
 
  sprintf(buffer," <tr><td>Flash id</td><td>%08X</td></tr>",ESP.getFlashChipId());
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Flash real size</td><td>%u</td></tr>",realSize);
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Flash real speed</td><td>%u</td></tr>",ideSize);
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Flash IDE speed</td><td>%u Hz</td></tr>",ESP.getFlashChipSpeed());
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Flash IDE size</td><td>%u</td></tr>",ESP.getFlashChipSpeed());
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Flash mode</td><td>%s</td></tr>",(ideMode == FM_QIO ? "QIO" : ideMode == FM_QOUT ? "QOUT" : ideMode == FM_DIO ? "DIO" : ideMode == FM_DOUT ? "DOUT" : "UNKNOWN"));
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Compilation date</td><td>%s @ %s</td></tr>",__DATE__,__TIME__);
- HTML+=F("<tr><td>Flash Chip Configuration</td>");
- if (ideSize != realSize) { HTML+=F("<td class=\"w3-red\">wrong!.</td></tr>");
+ html(F("<tr><td>Flash Chip Configuration</td>"));
+ if (ideSize != realSize) { html(F("<td class=\"w3-red\">wrong!.</td></tr>"));
  } else {
- HTML+=F("<td>ok.</td></tr>");
+ html(F("<td>ok.</td></tr>"));
  } 
  sprintf(buffer," <tr><td>Connected to</td><td>%s</td></tr>",WiFi.SSID().c_str());
- HTML+=buffer;
+ html(buffer);
+ sprintf(buffer," <tr><td>Config writes</td><td>%d, %u avoided</td></tr>",_data.burncount,burnsAvoided);
+ html(buffer);
+ sprintf(buffer," <tr><td>File cache</td><td>%u hits, %u misses, %u bytes</td></tr>",cacheHits,cacheMisses,cacheBytes);
+ html(buffer);
  IPAddress IP = WiFi.localIP();
  IPAddress GW = WiFi.gatewayIP();
- char buf[80];
+ char buf[96]; // three dotted quads and the markup around them
  sprintf(buf, "%d.%d.%d.%d<br><a href=\"http://%d.%d.%d.%d\" target=\"_blank\">%d.%d.%d.%d</a>", IP[0],IP[1],IP[2],IP[3], GW[0],GW[1],GW[2],GW[3], GW[0],GW[1],GW[2],GW[3] );
  sprintf(buffer,"<tr><td>IP address<BR>Gateway</td><td>%s</td></tr>",buf);
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Access point name</td><td>%s</td></tr>",_data.APname);
- HTML+=buffer;
+ html(buffer);
  IP = WiFi.softAPIP();
  sprintf(buf, "%d.%d.%d.%d", IP[0],IP[1],IP[2],IP[3] );
  sprintf(buffer,"<tr><td>IP address</td><td>%s</td></tr>",buf);
- HTML+=buffer;
+ html(buffer);
 
  sprintf(buffer," <tr><td>Time server</td><td>%s</td></tr>",_data.NTPserver);
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer," <tr><td>Compilation date</td><td>%s @ %s</td></tr>",__DATE__,__TIME__);
- HTML+=buffer;
+ html(buffer);
  // uptime
 
- HTML+=F("</body></html>");
- server.send(200, "text/html", HTML);
- server.client().stop();
- HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder=""; 
+ html(F("</body></html>"));
+ sendPage(PAGE_SYSINFO);
 }
 
-void tSysConfig::getIcon(){
- File dataFile = SPIFFS.open("/favicon.ico", "r"); 
- if (dataFile.size()<=0) {Serial.println("icon bad file size");
+void tSysConfig::renderBegin(){
+ renderMicros=micros();
+ renderHeap=ESP.getFreeHeap();
+#ifdef HEAP_ALLOCATIONS
+ renderAllocations=HEAP_ALLOCATIONS();
+#endif
+ pageBegin();
+}
+void tSysConfig::sendPage(byte page){
+ // the page is at its largest here, so the heap it holds is measured before it is sent
+ uint32_t t=micros()-renderMicros;
+ uint32_t heap=ESP.getFreeHeap();
+ tpagestats &p=pagestats[page];
+ p.renders++;
+ p.lastMicros=t;
+ p.totalMicros+=t;
+ if (t>p.maxMicros){p.maxMicros=t;}
+ p.lastBytes=pageBytes;
+ if (p.lastBytes>p.maxBytes){p.maxBytes=p.lastBytes;}
+ if ((renderHeap>heap)&&(renderHeap-heap>p.maxHeap)){p.maxHeap=renderHeap-heap;}
+#ifdef HEAP_ALLOCATIONS
+ uint32_t allocations=HEAP_ALLOCATIONS()-renderAllocations;
+ p.allocations+=allocations;
+ if (allocations>p.maxAllocations){p.maxAllocations=allocations;}
+#endif
+ pageEnd();
+}
+void tSysConfig::pageBegin(){
+ chunkLen=0;
+ pageBytes=0;
+ HTML="";
+ // a new page never continues the form elements of the previous one
+ inForm=false; inFieldset=false; inSelect=s_none; inOptgroup=false;
+ if (streamPages && !benchmark){
+  // the length is not known in advance, so the page goes out with chunked transfer encoding
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/html", "");
  }
- if (server.streamFile(dataFile, "image/vnd") != dataFile.size()) {Serial.println(F("icon streaming error"));
+}
+void tSysConfig::pageEnd(){
+ if (!benchmark){
+  if (streamPages){
+   flushHTML();
+   server.sendContent(""); // the empty chunk terminates the response
+  } else {
+   server.send(200, "text/html", HTML);
+  }
  }
- dataFile.close(); 
- server.client().stop();
+ chunkLen=0;
+ HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder="";
 }
-void tSysConfig::getLogo(){
- File dataFile = SPIFFS.open("/logo.png", "r"); 
- if (dataFile.size()<=0) {Serial.println("logo bad file size");
+void tSysConfig::html(const char *text){
+ size_t len=strlen(text);
+ pageBytes+=len;
+ if (!streamPages){ HTML+=text; return; }
+ while (len){
+  size_t n=HTML_CHUNK-chunkLen;
+  if (n>len){n=len;}
+  memcpy(chunk+chunkLen,text,n);
+  chunkLen+=n; text+=n; len-=n;
+  if (chunkLen==HTML_CHUNK){ flushHTML(); }
  }
- if (server.streamFile(dataFile, "image/png") != dataFile.size()) {Serial.println(F("Logo streaming error"));
+}
+void tSysConfig::html(const __FlashStringHelper *text){
+ PGM_P p=reinterpret_cast<PGM_P>(text);
+ size_t len=strlen_P(p);
+ pageBytes+=len;
+ if (!streamPages){ HTML+=text; return; }
+ while (len){
+  size_t n=HTML_CHUNK-chunkLen;
+  if (n>len){n=len;}
+  memcpy_P(chunk+chunkLen,p,n);
+  chunkLen+=n; p+=n; len-=n;
+  if (chunkLen==HTML_CHUNK){ flushHTML(); }
  }
- dataFile.close(); 
- server.client().stop();
+}
+void tSysConfig::flushHTML(){
+ if (chunkLen && streamPages && !benchmark){ server.sendContent(chunk, chunkLen); }
+ chunkLen=0;
+}
+bool tSysConfig::isPost(){
+ // the benchmark must never save the configuration, even if the last request was a post
+ return (!benchmark)&&(server.method() == HTTP_POST);
+}
+void tSysConfig::benchPages(uint32_t loops){
+ memset(pagestats,0,sizeof(pagestats));
+ benchmark=true;
+ for (uint32_t i=0;i<loops;i++){
+  Config(); Time(); OTA(); Sensors(); Timers(); ACL(); Register(); MQTT(); Sysinfo(); getCharts();
+  yield(); // keeps the watchdog fed on long runs
+ }
+ benchmark=false;
+ Serial.printf("Page benchmark, %u loops\r\n", loops);
+ for (byte i=0;i<PAGE_COUNT;i++){
+  uint32_t renders=pagestats[i].renders ? pagestats[i].renders : 1;
+#ifdef HEAP_ALLOCATIONS
+  Serial.printf("%-9s %8llu ns/page %6u bytes %6u heap %6u allocs/page\r\n", pageNames[i], (unsigned long long)((uint64_t)pagestats[i].totalMicros*1000/renders), pagestats[i].maxBytes, pagestats[i].maxHeap, pagestats[i].allocations/renders);
+#else
+  Serial.printf("%-9s %8llu ns/page %6u bytes %6u heap\r\n", pageNames[i], (unsigned long long)((uint64_t)pagestats[i].totalMicros*1000/renders), pagestats[i].maxBytes, pagestats[i].maxHeap);
+#endif
+ }
+}
+void tSysConfig::Bench(){
+ // runs the page benchmark, the number of loops is taken from the query string, e.g. /bench.html?loops=100
+ uint32_t loops=10;
+ if (server.hasArg("loops") && isinteger(server.arg("loops"))){ loops=server.arg("loops").toInt(); }
+ if (loops<1){loops=1;}
+ if (loops>BENCH_MAX_LOOPS){loops=BENCH_MAX_LOOPS;}
+ benchPages(loops);
+ pageBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Benchmark Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("Page benchmark</div><table class=\"w3-table w3-striped w3-border\"><tr><th>Page</th><th>ns/page</th><th>max ns</th><th>bytes/page</th><th>peak heap</th>"));
+#ifdef HEAP_ALLOCATIONS
+ html(F("<th>allocs/page</th><th>max allocs</th>"));
+#endif
+ html(F("</tr>"));
+ for (byte i=0;i<PAGE_COUNT;i++){
+  uint32_t renders=pagestats[i].renders ? pagestats[i].renders : 1;
+  sprintf(buffer,"<tr><td>%s</td><td>%llu</td><td>%llu</td><td>%u</td><td>%u</td>", pageNames[i], (unsigned long long)((uint64_t)pagestats[i].totalMicros*1000/renders), (unsigned long long)((uint64_t)pagestats[i].maxMicros*1000), pagestats[i].maxBytes, pagestats[i].maxHeap);
+  html(buffer);
+#ifdef HEAP_ALLOCATIONS
+  sprintf(buffer,"<td>%u</td><td>%u</td>", pagestats[i].allocations/renders, pagestats[i].maxAllocations);
+  html(buffer);
+#endif
+  html(F("</tr>"));
+ }
+ html(F("</table><div class=\"w3-container w3-blue\">Routes</div><table class=\"w3-table w3-striped w3-border\"><tr><th>Route</th><th>requests</th><th>us/request</th><th>max us</th></tr>"));
+ for (byte i=0;i<ROUTES;i++){
+  sprintf(buffer,"<tr><td>%s</td><td>%u</td><td>%u</td><td>%u</td></tr>", routes[i].uri, routeStats[i].hits, routeStats[i].totalMicros/(routeStats[i].hits ? routeStats[i].hits : 1), routeStats[i].maxMicros);
+  html(buffer);
+ }
+ html(F("</table></body></html>"));
+ pageEnd();
+}
+
+void tSysConfig::getIcon(){
+ sendAsset(a_icon);
+}
+void tSysConfig::getLogo(){
+ sendAsset(a_logo);
 }
 void tSysConfig::getCSS(){
- File dataFile = SPIFFS.open("/w3.css", "r"); 
- if (dataFile.size()<=0) {Serial.println("w3.css bad file size");
+ sendAsset(a_css);
+}
+void tSysConfig::getJS(){
+ sendAsset(a_js);
+}
+void tSysConfig::getSCjs(){
+ sendAsset(a_scjs);
+}
+void tSysConfig::hashAssets(){
+ byte block[128];
+ for (byte i=0;i<ASSETS;i++){
+  assetTags[i]=0;
+  assetFiles[i]=0;
+  String path=assets[i].path;
+  if (SPIFFS.exists(path)){
+   File dataFile = SPIFFS.open(path, "r");
+   size_t n;
+   while ((n=dataFile.read(block, sizeof(block)))>0){ assetTags[i]=crc32(block, n, assetTags[i]);}
+   dataFile.close();
+   assetFiles[i]=ASSET_PLAIN;
+  }
+  path+=".gz";
+  if (!SPIFFS.exists(path)){ continue;}
+  // the gzip trailer is the CRC32 and size of the uncompressed content, the same CRC as the plain copy
+  File dataFile = SPIFFS.open(path, "r");
+  uint32_t crc=0;
+  if ((dataFile.size()>=18)&&dataFile.seek(dataFile.size()-8)&&(dataFile.read(block, 4)==4)){ crc=block[0]|(block[1]<<8)|((uint32_t)block[2]<<16)|((uint32_t)block[3]<<24);}
+  dataFile.close();
+  if (!assetFiles[i]){ assetTags[i]=crc;}
+  else if (crc!=assetTags[i]){ Serial.print(path); Serial.println(F(" is out of date, ignored")); continue;}
+  assetFiles[i]|=ASSET_GZIP;
  }
- if (server.streamFile(dataFile, "text/css") != dataFile.size()) {Serial.println(F("CSS streaming error"));
+}
+void tSysConfig::sendAsset(a_asset asset, int code){
+ const tasset &a=assets[asset];
+ // the gzip copy goes to browsers that accept it, and to all of them when it is the only copy
+ bool gzip=(assetFiles[asset]&ASSET_GZIP)&&(!(assetFiles[asset]&ASSET_PLAIN)||(server.header("Accept-Encoding").indexOf("gzip")>=0));
+ String path=a.path;
+ if (gzip){ path+=".gz";}
+ if (assetFiles[asset]&&(code==200)){
+  char version[9];
+  snprintf(version, sizeof(version), "%08x", assetTags[asset]);
+  String tag="\"" + String(version) + (gzip ? "-gz\"" : "\""); // each encoding is its own representation
+  server.sendHeader("ETag", tag);
+  if (assetFiles[asset]&ASSET_GZIP){ server.sendHeader("Vary", "Accept-Encoding");}
+  // a request naming the current version can keep it, anything else is revalidated on each use
+  if (server.arg("v")==version){ server.sendHeader("Cache-Control", "max-age=" + String(ASSET_MAX_AGE) + ", immutable");}
+  else { server.sendHeader("Cache-Control", "no-cache");}
+  if (server.header("If-None-Match")==tag){
+   server.send(304);
+   return;
+  }
  }
- dataFile.close(); 
- server.client().stop();
+ tcacheentry &c=assetCache[asset*2+gzip];
+ if (c.body){ cacheHits++;}
+ else {
+  cacheMisses++;
+  File dataFile = SPIFFS.open(path, "r"); 
+  if (dataFile.size()<=0) {Serial.print(path); Serial.println(F(" bad file size"));
+  }
+  if (!assetFiles[asset]||!cacheAsset(c, dataFile)){
+   if (asyncFiles&&assetFiles[asset]&&sendAsync(dataFile, a.type, code, gzip)){ return;}
+   // the web server adds Content-Encoding: gzip itself for a file named .gz
+   if (server.streamFile(dataFile, a.type, code) != dataFile.size()) {Serial.print(path); Serial.println(F(" streaming error"));
+   }
+   dataFile.close(); 
+   return;
+  }
+  dataFile.close(); 
+ }
+ c.used=++cacheClock;
+ if (gzip){ server.sendHeader("Content-Encoding", "gzip");}
+ server.setContentLength(c.size);
+ server.send(code, a.type, "");
+ server.sendContent((const char *)c.body, c.size);
 }
-void tSysConfig::getJS(){
- File dataFile = SPIFFS.open("/w3.js", "r");
- if (dataFile.size()<=0) {Serial.println(F("sc.js bad file size"));
+bool tSysConfig::cacheAsset(tcacheentry &c, File &dataFile){
+ size_t size=dataFile.size();
+ if (!size||(size>ASSET_CACHE_FILE)||(size>ASSET_CACHE)){ return false;}
+ while (cacheBytes+size>ASSET_CACHE){
+  // drop the least recently served copy
+  tcacheentry *oldest=nullptr;
+  for (byte i=0;i<ASSETS*2;i++){
+   if (assetCache[i].body&&(!oldest||(assetCache[i].used<oldest->used))){ oldest=&assetCache[i];}
+  }
+  free(oldest->body);
+  oldest->body=nullptr;
+  cacheBytes-=oldest->size;
+ }
+ c.body=(byte *)malloc(size);
+ if (!c.body){ return false;}
+ if (dataFile.read(c.body, size)!=size){
+  free(c.body);
+  c.body=nullptr;
+  dataFile.seek(0);
+  return false;
  }
- if (server.streamFile(dataFile, "text/javascript") != dataFile.size()) {Serial.println(F("JS streaming error"));
+ c.size=size;
+ cacheBytes+=size;
+ return true;
+}
+void tSysConfig::clearCache(){
+ for (byte i=0;i<ASSETS*2;i++){
+  free(assetCache[i].body);
+  assetCache[i].body=nullptr;
  }
- dataFile.close(); 
- server.client().stop();
+ cacheBytes=0;
 }
-void tSysConfig::getSCjs(){
- File dataFile = SPIFFS.open("/sc.js", "r"); 
- if (dataFile.size()<=0) {Serial.println(F("sc.js bad file size"));
+bool tSysConfig::sendAsync(File &dataFile, const char *type, int code, bool gzip){
+ ttransfer *t=nullptr;
+ for (byte i=0;i<ASYNC_TRANSFERS;i++){
+  if (!transfers[i].file){ t=&transfers[i]; break;}
+ }
+ if (!t){ return false;}
+ if (gzip){ server.sendHeader("Content-Encoding", "gzip");}
+ server.setContentLength(dataFile.size());
+ server.keepAlive(false); // the slot closes the connection once the body is out, the headers must say so
+ server.send(code, type, "");
+ t->client=server.detachClient();
+ t->file=dataFile;
+ dataFile=File(); // the slot owns the file now
+ t->lastMillis=millis();
+ return true;
+}
+void tSysConfig::runTransfers(){
+ byte block[ASYNC_BLOCK];
+ uint32_t start=millis();
+ bool sending=true;
+ // each transfer gets a block in turn until none can send more or the time is used up
+ while (sending&&(millis()-start<asyncBudget)){
+  sending=false;
+  for (byte i=0;i<ASYNC_TRANSFERS;i++){
+   ttransfer &t=transfers[i];
+   if (!t.file){ continue;}
+   if (!t.client.connected()||(millis()-t.lastMillis>ASYNC_TIMEOUT)){ endTransfer(t); continue;}
+   size_t room=t.client.availableForWrite(); // the client only takes what fits its send window without waiting
+   if (!room){ continue;}
+   size_t n=t.file.read(block, room<sizeof(block) ? room : sizeof(block));
+   if (!n){ endTransfer(t); continue;} // the file is shorter than it was
+   if (t.client.write(block, n)!=n){ endTransfer(t); continue;}
+   t.lastMillis=millis();
+   sending=true;
+   if (t.file.position()>=t.file.size()){ endTransfer(t);}
+  }
  }
- if (server.streamFile(dataFile, "text/javascript") != dataFile.size()) {Serial.println(F("sc.js streaming error"));
+}
+void tSysConfig::endTransfer(ttransfer &t){
+ t.file.close();
+ t.file=File();
+ t.client=WiFiClient(); // dropping the last reference closes the connection once the data already queued has gone
+}
+void tSysConfig::dropAssets(){
+ for (byte i=0;i<ASYNC_TRANSFERS;i++){
+  if (transfers[i].file){ endTransfer(transfers[i]);}
  }
- dataFile.close(); 
- server.client().stop();
+ clearCache();
+ memset(assetFiles, 0, sizeof(assetFiles));
+}
+void tSysConfig::assetsChanged(){
+ clearCache();
+ hashAssets();
+}
+void tSysConfig::headLinks(){
+ snprintf(buffer, sizeof(buffer), "<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css?v=%08x\"><script type=\"text/javascript\" src=\"sc.js?v=%08x\"></script>", assetTags[a_css], assetTags[a_scjs]);
+ html(buffer);
 }
 void tSysConfig::getCharts(){
- HTML=F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">");
- HTML+=F("<link rel=\"stylesheet\" type=\"text/css\" href=\"w3.css\"><script src=\"sc.js\"></script></head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">");
- HTML+=F("Charts</div>");
+ renderBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Timers Page</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body onload=\"rewrite()\"><div class=\"w3-container w3-blue\">"));
+ html(F("Charts</div>"));
 
- HTML+=F("</body></html>"); 
- server.send(200, "text/html", HTML);
- server.client().stop();
- HTML=""; webobj.name="", webobj.css="";webobj.label=""; webobj.placeholder="";
+ html(F("</body></html>")); 
+ sendPage(PAGE_CHARTS);
 }
 void tSysConfig::drawGraph(){ 
  
@@ -1128,7 +2310,6 @@ void tSysConfig::getAbout(){
  if (server.streamFile(dataFile, "text/html") != dataFile.size()) {Serial.println(F("about.html streaming error"));
  }
  dataFile.close(); 
- server.client().stop();
 }
 void tSysConfig::getHelp(){
  File dataFile = SPIFFS.open("/help.html", "r"); 
@@ -1137,23 +2318,108 @@ void tSysConfig::getHelp(){
  if (server.streamFile(dataFile, "text/html") != dataFile.size()) {Serial.println(F("help.htm streaming error"));
  }
  dataFile.close(); 
- server.client().stop();
 }
 void tSysConfig::handleNotFound(){
   // the 404 page, we want to show the message and give the user a link back to the index page
   // unlike the other pages, this one is entirely self contained, including the CSS it needs
   // one caveat, figure out if its framed or unframed from the uri
- File dataFile = SPIFFS.open("/404.html", "r"); 
- if (dataFile.size()<=0) {Serial.println(F("help.htm bad file size"));
- }
- if (server.streamFile(dataFile, "text/html") != dataFile.size()) {Serial.println(F("404.html streaming error"));
- }
- dataFile.close();  
- server.client().stop();
+ sendAsset(a_notfound, 404);
 }
 bool tSysConfig::webAuth(){
- // used by restricted Configuration pages
- }
+ // used by restricted Configuration pages, a session cookie is checked first as it costs one compare once the session is known
+ if (validSession()){ return true;}
+ return server.hasHeader("Authorization")&&server.authenticate(_data.userName, _data.userPass);
+ }
+void tSysConfig::sessionMAC(uint32_t id, uint32_t expiry, byte *mac){
+ br_hmac_key_context kc;
+ br_hmac_context hc;
+ byte data[8]={(byte)(id>>24), (byte)(id>>16), (byte)(id>>8), (byte)id, (byte)(expiry>>24), (byte)(expiry>>16), (byte)(expiry>>8), (byte)expiry};
+ br_hmac_key_init(&kc, &br_sha256_vtable, sessionKey, sizeof(sessionKey));
+ br_hmac_init(&hc, &kc, sizeof(tsession::mac));
+ br_hmac_update(&hc, data, sizeof(data));
+ br_hmac_out(&hc, mac);
+}
+bool tSysConfig::validSession(){
+ // the cookie is the id, expiry and signature in hex, ESPSESSION=<8 digits><8 digits><32 digits>
+ String cookie=server.header("Cookie");
+ int at=cookie.indexOf(SESSION_COOKIE "=");
+ // the name must start the header or follow the "; " between cookies, not end the name of another cookie
+ while ((at>0)&&!((at>=2)&&(cookie[at-2]==';')&&(cookie[at-1]==' '))){ at=cookie.indexOf(SESSION_COOKIE "=", at+1);}
+ if (at<0){ return false;}
+ const char *p=cookie.c_str()+at+sizeof(SESSION_COOKIE);
+ byte token[8+sizeof(tsession::mac)];
+ for (byte i=0;i<sizeof(token);i++){
+  int high=hexDigit(*p++);
+  if (high<0){ return false;}
+  int low=hexDigit(*p++);
+  if (low<0){ return false;}
+  token[i]=(high<<4)|low;
+ }
+ uint32_t id=((uint32_t)token[0]<<24)|((uint32_t)token[1]<<16)|((uint32_t)token[2]<<8)|token[3];
+ uint32_t expiry=((uint32_t)token[4]<<24)|((uint32_t)token[5]<<16)|((uint32_t)token[6]<<8)|token[7];
+ const byte *mac=token+8;
+ if ((int32_t)(expiry-SESSION_CLOCK())<=0){ return false;}
+ tsession *slot=&sessions[0];
+ for (byte i=0;i<SESSIONS;i++){
+  if (id&&(sessions[i].id==id)&&(sessions[i].expiry==expiry)){ return sameBytes(sessions[i].mac, mac, sizeof(tsession::mac));}
+  if (sessions[i].expiry<slot->expiry){ slot=&sessions[i];}
+ }
+ // a session that is not remembered is checked against its signature, then takes the slot closest to expiring
+ byte check[sizeof(tsession::mac)];
+ sessionMAC(id, expiry, check);
+ if (!sameBytes(check, mac, sizeof(check))){ return false;}
+ slot->id=id;
+ slot->expiry=expiry;
+ memcpy(slot->mac, mac, sizeof(slot->mac));
+ return true;
+}
+void tSysConfig::Login(){
+ // the page to return to comes from the redirect of the restricted page, anything but a plain local path goes to the index
+ String page=server.arg("page");
+ bool local=(page.length()>1)&&(page[0]=='/')&&(page.length()<64);
+ for (size_t i=1;local&&(i<page.length());i++){ local=isalnum(page[i])||(page[i]=='.')||(page[i]=='_')||(page[i]=='-');}
+ if (!local){ page="/";}
+ bool failed=false;
+ if (isPost()){
+  if (sameText(server.arg("userName"), _data.userName, sizeof(_data.userName))&sameText(server.arg("userPass"), _data.userPass, sizeof(_data.userPass))){
+   uint32_t id=ESP.random();
+   if (!id){ id=1;}
+   uint32_t expiry=SESSION_CLOCK()+SESSION_LIFE;
+   tsession *slot=&sessions[0];
+   for (byte i=1;i<SESSIONS;i++){ if (sessions[i].expiry<slot->expiry){ slot=&sessions[i];}}
+   slot->id=id;
+   slot->expiry=expiry;
+   sessionMAC(id, expiry, slot->mac);
+   char *c=buffer+sprintf(buffer, SESSION_COOKIE "=%08x%08x", id, expiry);
+   for (byte i=0;i<sizeof(slot->mac);i++){ c+=sprintf(c, "%02x", slot->mac[i]);}
+   sprintf(c, "; Path=/; HttpOnly; SameSite=Strict; Max-Age=%d", SESSION_LIFE);
+   server.sendHeader("Set-Cookie", buffer);
+   server.sendHeader("Location", page);
+   server.send(303);
+   return;
+  }
+  failed=true;
+ }
+ pageBegin();
+ html(F("<!DOCTYPE html><html><head><meta charset=\"UTF-8\"><title>ESP Login</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"));
+ headLinks();
+ html(F("</head><body><div class=\"w3-container w3-blue\">Login</div>"));
+ if (failed){ html(F("<div class=\"w3-panel w3-red\">Wrong user name or password</div>"));}
+ sprintf(buffer, "<form method=\"post\" action=\"/login.html?page=%s\">", page.c_str());
+ html(buffer);
+ html(F("<input type=\"text\" name=\"userName\" placeholder=\"User name\" autocomplete=\"username\" REQUIRED>"));
+ html(F("<input type=\"password\" name=\"userPass\" placeholder=\"Password\" autocomplete=\"current-password\">"));
+ html(F("<button class=\"w3-button w3-block w3-section w3-blue w3-ripple w3-padding\">Login</button></form></body></html>"));
+ pageEnd();
+}
+void tSysConfig::Logout(){
+ // a new key invalidates every cookie that was issued, so this ends all sessions
+ ESP.random(sessionKey, sizeof(sessionKey));
+ memset(sessions, 0, sizeof(sessions));
+ server.sendHeader("Set-Cookie", SESSION_COOKIE "=; Path=/; Max-Age=0");
+ server.sendHeader("Location", "/");
+ server.send(303);
+}
  // to support a Configuration application, we have the JSON data exchanges, there are no individual pages in the JSON processing
 void tSysConfig::JSON(){
  // format bytes
@@ -1163,39 +2429,42 @@ void tSysConfig::JSON(){
 bool tSysConfig::form(htmlproperties obj){
  if (inForm){form();} // ensures all previous forms are closed before we create another, nested forms are not allowed
  sprintf(buffer, "<form label=\"%s\" name=\"%s\" method=\"post\" autocomplete=\"on\">",obj.css.c_str(), obj.name.c_str());
- HTML+=buffer;
+ html(buffer);
+ return true;
  }
 bool tSysConfig::form(){
  // need to figure out how to autoinclude a submit button
- HTML+=F("<button class=\"w3-button w3-block w3-section w3-blue w3-ripple w3-padding\">Save</button></form>");
+ html(F("<button class=\"w3-button w3-block w3-section w3-blue w3-ripple w3-padding\">Save</button></form>"));
+ return true;
  }
-void tSysConfig::fieldset(char* tag){
+void tSysConfig::fieldset(char const *tag){
  // use to create groupboxes on the form
  if (inFieldset){ fieldset();}
  inFieldset=true;
  sprintf(buffer, "<fieldset id=\"%s\">",tag);
- HTML+=buffer;
+ html(buffer);
 }
 void tSysConfig::fieldset(){
  if (inFieldset){
   inFieldset=false;
-  HTML+=F("</fieldset>");
+  html(F("</fieldset>"));
  }
  }
-void tSysConfig::tab(char* tag){ 
+void tSysConfig::tab(char const *tag){ 
  sprintf(buffer, "<button onclick=\"openTab('%s')\">Updates</button>",tag);
- HTML+=buffer;
+ html(buffer);
 }
 bool tSysConfig::edit(htmlproperties obj, char* data, int32_t size){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
   error=copyval(data,obj.name.c_str(),size);
  }
  sprintf(buffer,"<input type=\"text\" name=\"%s\" label=\"%s\" value=\"%s\" placeholder=\"%s\" size=\"%d\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(),size, (obj.required)?" REQUIRED ":"");
- HTML+=buffer;
+ html(buffer);
+ return true;
 }
 bool tSysConfig::edit(htmlproperties obj, byte &data, byte min, byte max){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
   error=copyval(data,obj.name.c_str(),min,max);
  }
@@ -1204,10 +2473,11 @@ bool tSysConfig::edit(htmlproperties obj, byte &data, byte min, byte max){
  } else {
  sprintf(buffer,"<input type=\"number\" name=\"%s\" label=\"%s\" value=\"%d\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(), (obj.required)?" REQUIRED ":"");  
  }
- HTML+=buffer;
+ html(buffer);
+ return true;
  }
 bool tSysConfig::edit(htmlproperties obj, int32_t &data, int32_t min, int32_t max){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
   error=copyval(data,obj.name.c_str(),min,max);
  }
@@ -1216,10 +2486,11 @@ bool tSysConfig::edit(htmlproperties obj, int32_t &data, int32_t min, int32_t ma
  {
  sprintf(buffer,"<input type=\"number\" name=\"%s\" label=\"%s\" value=\"%d\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(), (obj.required)?" REQUIRED ":"");  
  }
- HTML+=buffer;
+ html(buffer);
+ return true;
  }
 bool tSysConfig::edit(htmlproperties obj, float &data, float min, float max){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
   error=copyval(data,obj.name.c_str(),min,max);
  }
@@ -1228,7 +2499,8 @@ bool tSysConfig::edit(htmlproperties obj, float &data, float min, float max){
  {
  sprintf(buffer,"<input type=\"number\" name=\"%s\" label=\"%s\" value=\"%f\" placeholder=\"%s\" min=\"%f\" max=\"%f\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(),min, max, (obj.required)?" REQUIRED ":"");  
  }
- HTML+=buffer;
+ html(buffer);
+ return true;
  }
 
 bool tSysConfig::password(htmlproperties obj, char* data, int32_t size, int32_t min, int32_t max){
@@ -1236,7 +2508,7 @@ bool tSysConfig::password(htmlproperties obj, char* data, int32_t size, int32_t
  char p1[32];
  char p2[32];
  char field[32];
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
   // min, max are used to check minimum and maximum length of the password
    error=copyval(p1,obj.name.c_str(),size);
@@ -1245,44 +2517,49 @@ bool tSysConfig::password(htmlproperties obj, char* data, int32_t size, int32_t
    if (strcmp(p1,p2)==0){ error=copyval(data,obj.name.c_str(),size); }
 }
  sprintf(buffer,"<input type=\"password\" name=\"%s\" label=\"%s\" value=\"%s\" placeholder=\"password\" %s>",obj.name.c_str(),obj.label.c_str(),data,(obj.required)?" REQUIRED ":"");
- HTML+=buffer;
+ html(buffer);
  sprintf(buffer,"<input type=\"password\" name=\"%s_verify\" value=\"%s\" placeholder=\"verify password\" %s>",obj.name.c_str(),data, (obj.required)?" REQUIRED ":"");
- HTML+=buffer;
+ html(buffer);
+ return true;
 }
 bool tSysConfig::text(htmlproperties obj, char* data, int32_t size, int32_t min, int32_t max){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
   error=copyval(data,obj.name.c_str(),size);
  }
  sprintf(buffer,"<textarea name=\"%s\"value=\"%s\" placeholder=\"%s\" size=\"%d\" %s></textarea>",obj.name.c_str(),data,obj.placeholder.c_str(),size, (obj.required)?" REQUIRED ":"");
- HTML+=buffer;
+ html(buffer);
+ return true;
  }
 bool tSysConfig::editemail(htmlproperties obj, char* data, int32_t size){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str(),size);
 }
  sprintf(buffer,"<input type=\"email\" name=\"%s\" label=\"%s\" value=\"%s\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(),(obj.required)?" REQUIRED ":"");
- HTML+=buffer;
+ html(buffer);
+ return true;
 }
 bool tSysConfig::editurl(htmlproperties obj, char* data, int32_t size){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str(),size);
 }
  sprintf(buffer,"<input type=\"url\" name=\"%s\" label=\"%s\" value=\"%s\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(), (obj.required)?" REQUIRED ":"");
- HTML+=buffer;
+ html(buffer);
+ return true;
 } 
 bool tSysConfig::edittel(htmlproperties obj, char* data, int32_t size){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
   error=copyval(data,obj.name.c_str(),size);
  }
  sprintf(buffer,"<input type=\"tel\" name=\"%s\" label=\"%s\" value=\"%s\" placeholder=\"%s\" %s>",obj.name.c_str(),obj.label.c_str(),data,obj.placeholder.c_str(), (obj.required)?" REQUIRED ":"");
- HTML+=buffer;
+ html(buffer);
+ return true;
 }
 bool tSysConfig::editTime(htmlproperties obj, time_t &data){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str());
  }
@@ -1291,7 +2568,8 @@ bool tSysConfig::editTime(htmlproperties obj, time_t &data){
  //atime.Hour=13;
  //atime.Minute=14;
  sprintf(buffer,"<input type=\"time\" name=\"%s\" label=\"%s\" Value=\"%02d:%02d\" %s>",obj.name.c_str(),obj.label.c_str(),atime.Hour,atime.Minute,(obj.required)?" REQUIRED ":"");
- HTML+=buffer;
+ html(buffer);
+ return true;
 }
 /*  our select methods require some Javascript magic, the <select> element does not normally carry the value but this is carried here to 
  *  enable our Javascript code to pick it up and set the selected parameter on the correct option value
@@ -1300,161 +2578,173 @@ bool tSysConfig::editTime(htmlproperties obj, time_t &data){
 */
 bool tSysConfig::selectList(htmlproperties obj,int32_t &data){
  if (inSelect) {selectList();}
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str());
  }
   inSelect=s_int32_t;
  sprintf(buffer,"<select name=\"%s\" label=\"%s\" Value=\"%d\">",obj.name.c_str(),obj.label.c_str(),data);
- HTML+=buffer;
+ html(buffer);
  return true;
  }
 bool tSysConfig::selectbyte(htmlproperties obj,byte &data){
  if (inSelect) {selectList();}
  inSelect=s_byte;
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str());
  }
   sprintf(buffer,"<select name=\"%s\" label=\"%s\" Value=\"%d\">",obj.name.c_str(),obj.label.c_str(),data);
- HTML+=buffer;
+ html(buffer);
  return true;
  }
 bool tSysConfig::selectList(htmlproperties obj,float &data){
  if (inSelect) {selectList();}
  inSelect=s_float; 
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str());
  }
   sprintf(buffer,"<select name=\"%s\" label=\"%s\" Value=\"%f\">",obj.name.c_str(),obj.label.c_str(),data);
- HTML+=buffer;
+ html(buffer);
  return true;
  }
 bool tSysConfig::selectList(htmlproperties obj,char* data, int32_t size){
  if (inSelect) {selectList();}
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str(), size);
  }
  inSelect=s_text;
  sprintf(buffer,"<select name=\"%s\" label=\"%s\" Value=\"%s\">",obj.name.c_str(),obj.label.c_str(),data);
- HTML+=buffer; 
+ html(buffer); 
  return true;
 }
 bool tSysConfig::selectList(){
  optiongroup();// ensures option groups are closed
- HTML+=F("</select>"); 
+ html(F("</select>")); 
+ return true;
  }
 void tSysConfig::label(htmlproperties obj){
  if (obj.label.length()>0){ 
  sprintf(buffer,"<label for=\"%s\" >%s</label><br>",obj.name.c_str(), obj.label.c_str()); 
- HTML+=buffer; 
+ html(buffer); 
  }
  }
 bool tSysConfig::optiongroup(char const *name){
  optiongroup();// close any previous group
  inOptgroup=true;
  sprintf(buffer,"<optgroup label=\"%s\">",name); 
- HTML+=buffer; 
+ html(buffer); 
+ return true;
  }
 bool tSysConfig::optiongroup(){
  if (inOptgroup){
  inOptgroup=false;
- HTML+=F("</optgroup>");} 
+ html(F("</optgroup>"));} 
+ return true;
  }
-bool tSysConfig::option(char *data, char *name){
+bool tSysConfig::option(char *data, char const *name){
  sprintf(buffer,"<option value=\"%s\" >%s</option>",data,name); 
- HTML+=buffer; 
+ html(buffer); 
+ return true;
  }
-bool tSysConfig::option(float data, char *name){
+bool tSysConfig::option(float data, char const *name){
  sprintf(buffer,"<option value=\"%f\" >%s</option>",data,name); 
- HTML+=buffer; 
+ html(buffer); 
+ return true;
  }
-bool tSysConfig::option(int32_t data, char *name){
+bool tSysConfig::option(int32_t data, char const *name){
  sprintf(buffer,"<option value=\"%d\" >%s</option>",data,name); 
- HTML+=buffer; 
+ html(buffer); 
+ return true;
  }
- bool tSysConfig::option(byte data, char *name){
+ bool tSysConfig::option(byte data, char const *name){
  sprintf(buffer,"<option value=\"%d\" >%s</option>",data,name); 
- HTML+=buffer; 
+ html(buffer); 
+ return true;
  }
 bool tSysConfig::checkbox(htmlproperties obj, bool &data){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str());
  }
  sprintf(buffer,"<input type=\"checkbox\" name=\"%s\" value=\"%d\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
- HTML+=buffer;  
+ html(buffer);  
+ return true;
  }
 bool tSysConfig::checkbox(htmlproperties obj, int32_t &data){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str());
  }
  sprintf(buffer,"<input type=\"checkbox\" name=\"%s\" value=\"%d\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
- HTML+=buffer;  
+ html(buffer);  
+ return true;
  }
 bool tSysConfig::checkbox(htmlproperties obj, char* data, int32_t size){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str(),size);
  }
- sprintf(buffer,"<input type=\"checkbox\" name=\"%s\" value=\"%d\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
- HTML+=buffer;  
+ sprintf(buffer,"<input type=\"checkbox\" name=\"%s\" value=\"%s\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
+ html(buffer);  
+ return true;
  }
 bool tSysConfig::radio(htmlproperties obj, int32_t &data){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str());
  }
  sprintf(buffer,"<input type=\"radio\" name=\"%s\" value=\"%d\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
- HTML+=buffer;  
+ html(buffer);  
+ return true;
  }
 bool tSysConfig::radio(htmlproperties obj, char *data, int32_t size){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str(), size);
  }
  sprintf(buffer,"<input type=\"radio\" name=\"%s\" value=\"%s\" label=\"%s\">",obj.name.c_str(),data,obj.label.c_str());
- HTML+=buffer;  
+ html(buffer);  
+ return true;
  }
  // additional html elements of significant use to us
 void tSysConfig::meter(htmlproperties obj, int32_t value, int32_t min, int32_t max){
  // name is not required as this item does not return information
  if (obj.label.length()>0){
- sprintf(buffer,"<meter id=\"%s\" label=\"%s\" value=\"%d\" max=\"%d\"> %d% </meter>",obj.name.c_str(), obj.label.c_str(), value, min, max );} else {
- sprintf(buffer,"<meter id=\"%s\" value=\"%d\" max=\"%d\"> %d% </meter>",obj.name.c_str(), value, min, max );} 
- HTML+=buffer; 
+ sprintf(buffer,"<meter id=\"%s\" label=\"%s\" value=\"%d\" max=\"%d\"> %d%% </meter>",obj.name.c_str(), obj.label.c_str(), value, min, max );} else {
+ sprintf(buffer,"<meter id=\"%s\" value=\"%d\" max=\"%d\"> %d%% </meter>",obj.name.c_str(), value, min, max );} 
+ html(buffer); 
  }
 void tSysConfig::meter(htmlproperties obj, float value, float min, float max){
  // name is not required as this item does not return information
  if (obj.label.length()>0){
- sprintf(buffer,"<meter id=\"%s\" label=\"%s\" value=\"%f\" max=\"%f\"> %f% </meter>",obj.name.c_str(), obj.label.c_str(),value, min, max );} else {
- sprintf(buffer,"<meter id=\"%s\" value=\"%f\" max=\"%f\"> %f% </meter>", obj.name.c_str(), value, min, max );}
- HTML+=buffer; 
+ sprintf(buffer,"<meter id=\"%s\" label=\"%s\" value=\"%f\" max=\"%f\"> %f%% </meter>",obj.name.c_str(), obj.label.c_str(),value, min, max );} else {
+ sprintf(buffer,"<meter id=\"%s\" value=\"%f\" max=\"%f\"> %f%% </meter>", obj.name.c_str(), value, min, max );}
+ html(buffer); 
  }
 void tSysConfig::progress(htmlproperties obj, int32_t value, int32_t min, int32_t max){
  // name is not required as this item does not return information
  if (obj.label.length()>0){
- sprintf(buffer,"<progress id=\"%s\" label=\"%s\"value=\"%d\" max=\"%d\"> %d% </progress>",obj.name.c_str(), obj.label.c_str(),value, min, max );} else {
- sprintf(buffer,"<progress id=\"%s\" value=\"%d\" max=\"%d\"> %d% </progress>", obj.name.c_str(), value, min, max );}
- HTML+=buffer; 
+ sprintf(buffer,"<progress id=\"%s\" label=\"%s\"value=\"%d\" max=\"%d\"> %d%% </progress>",obj.name.c_str(), obj.label.c_str(),value, min, max );} else {
+ sprintf(buffer,"<progress id=\"%s\" value=\"%d\" max=\"%d\"> %d%% </progress>", obj.name.c_str(), value, min, max );}
+ html(buffer); 
  }
 void tSysConfig::progress(htmlproperties obj, float value, float min, float max){
  // name is not required as this item does not return information
  if (obj.label.length()>0){
- sprintf(buffer,"<progress id=\"%s\" label=\"%s\" value=\"%f\" max=\"%f\"> %f% </progress>",obj.name.c_str(), obj.label.c_str(), value, min, max );} else {
- sprintf(buffer,"<progress id=\"%s\" value=\"%f\" max=\"%f\"> %f% </progress>",obj.name.c_str(), value, min, max );}
- HTML+=buffer; 
+ sprintf(buffer,"<progress id=\"%s\" label=\"%s\" value=\"%f\" max=\"%f\"> %f%% </progress>",obj.name.c_str(), obj.label.c_str(), value, min, max );} else {
+ sprintf(buffer,"<progress id=\"%s\" value=\"%f\" max=\"%f\"> %f%% </progress>",obj.name.c_str(), value, min, max );}
+ html(buffer); 
  }
 void tSysConfig::details(htmlproperties obj){
  // name is not required as this item does not return information https://www.w3schools.com/tags/tag_button.asp
  sprintf(buffer,"<details><summary>%s</summary><p>%s</p></details>", obj.label.c_str(), obj.value.c_str() );
- HTML+=buffer; 
+ html(buffer); 
  }
 bool tSysConfig::editrange(htmlproperties obj, int32_t &data, int32_t min, int32_t max){
- if ( server.method() == HTTP_POST ){
+ if ( isPost() ){
   // POST functionality here, includes error handling
    error=copyval(data,obj.name.c_str(), min, max);
  }
@@ -1462,7 +2752,8 @@ bool tSysConfig::editrange(htmlproperties obj, int32_t &data, int32_t min, int32
   sprintf(buffer,"<input type=\"range\" nam\"%s\" value=\"%d\" min=\"%d\" max=\"%d\">", obj.name.c_str(), data, min, max );} else {
   sprintf(buffer,"<input type=\"range\" nam\"%s\" value=\"%d\">", obj.name.c_str(), data); 
  }
- HTML+=buffer; 
+ html(buffer); 
+ return true;
 }
 // format bytes
 String tSysConfig::formatbytes(size_t bytes) {
@@ -1477,76 +2768,40 @@ String tSysConfig::formatbytes(size_t bytes) {
  }
 }
 
-boolean tSysConfig::isinteger(String str){ // check the input is an integer
- for(byte i=0;i<str.length();i++){
-  if(!isDigit(str.charAt(i))) {
-  return false;
-  }
- }
- return true;
-} 
-boolean tSysConfig::isFloat(String str){ // check that the input is a floating point number
- String s;
- String x;
- int32_t pos = str.indexOf(".");
- if (pos==-1){ Serial.println("simple integer"); return isinteger(str); } else {
- s=str.substring(0,pos);
- x=str.substring(pos+1);
- if (isinteger(s)){return isinteger(x);} 
- }
- return false;
-} 
-boolean tSysConfig::isTime(String str){ // check that the input is a floating point number
- String s;
- String x;
- int32_t pos = str.indexOf(":");
- if (pos==-1){ Serial.println("simple integer"); return false; } else {
- s=str.substring(0,pos);
- x=str.substring(pos+1);
- if (isinteger(s)){return isinteger(x);} 
- }
- return false;
-} 
-boolean tSysConfig::isIP(String str){// check that the input is an IP4 class address string
- String a; // 4 substrings to define the 4 quadrants of an IP string
- String b;
- String c;
- String d;
- // check for the . character, there needs to be 3 to be a valid ip4 address
- int32_t pos = str.indexOf(".");
- if (pos==-1){ return false;}
- a=str.substring(0,pos);
- int32_t pos2 = str.indexOf(".", pos);
- if (pos2==-1){ return false;}
- b=str.substring(pos+1,pos2);
- pos = str.indexOf(".", pos2);
- if (pos==-1){ return false;}
- c=str.substring(pos2+1,pos);
- d=str.substring(pos+1);
- // check is the substrings are numeric, if not then its not a valid ip
- if (!isinteger(a)){ return false;}
- if (!isinteger(b)){ return false;}
- if (!isinteger(c)){ return false;}
- if (!isinteger(d)){ return false;}
- if (a.toInt()>255){ return false;}
- if (b.toInt()>255){ return false;}
- if (c.toInt()>255){ return false;}
- if (d.toInt()>255){ return false;}
- return true;
+boolean tSysConfig::isinteger(const String &str){ // check the input is an integer
+ uint32_t v=0;
+ const char *last=str.c_str()+str.length();
+ return scanUnsigned(str.c_str(),last,v)==last;
+}
+boolean tSysConfig::isFloat(const String &str){ // check that the input is a floating point number
+ float v;
+ const char *last=str.c_str()+str.length();
+ return scanFloat(str.c_str(),last,v)==last;
+}
+boolean tSysConfig::isTime(const String &str){ // check that the input is a time of day
+ uint32_t h=0,m=0;
+ const char *last=str.c_str()+str.length();
+ return scanTime(str.c_str(),last,h,m)==last;
+}
+boolean tSysConfig::isIP(const String &str){// check that the input is an IP4 class address string
+ IPAddress ip;
+ const char *last=str.c_str()+str.length();
+ return scanIP(str.c_str(),last,ip)==last;
 }
  // copy values from post function is overloaded and has default parameters, if min-max are equal, range is ignored otherwise range checking is used
 
 int32_t tSysConfig::copyval(byte &var, char const *name, byte min, byte max){
- String V;
  error = 0;
  if (server.hasArg(name)) {
- V=server.arg(name);
- if ((V.length()<1)|(!isinteger(V))){
+ const String &V=server.arg(name);
+ uint32_t v=0;
+ const char *last=V.c_str()+V.length();
+ if ((scanUnsigned(V.c_str(),last,v)!=last)||(v>255)){
  errorcount++;
  error=NaN;
  return NaN;
  }
- var=(byte)V.toInt();
+ var=v;
  if(max!=min){
  if ((var<=max)&&(var>=min)){
   error = OK;
@@ -1565,16 +2820,17 @@ int32_t tSysConfig::copyval(byte &var, char const *name, byte min, byte max){
 }
 
 int32_t tSysConfig::copyval(int32_t &var, char const *name, int32_t min, int32_t max){
- String V;
  error = 0;
  if (server.hasArg(name)) {
- V=server.arg(name);
- if ((V.length()<1)|(!isinteger(V))){
+ const String &V=server.arg(name);
+ uint32_t v=0;
+ const char *last=V.c_str()+V.length();
+ if ((scanUnsigned(V.c_str(),last,v)!=last)||(v>0x7FFFFFFF)){
  errorcount++;
  error=NaN;
  return NaN;
  }
- var=V.toInt();
+ var=v;
  if(max!=min){
  if ((var<=max)&&(var>=min)){
   error = OK;
@@ -1593,16 +2849,17 @@ int32_t tSysConfig::copyval(int32_t &var, char const *name, int32_t min, int32_t
  }
 }
 int32_t tSysConfig::copyval(float &var, char const *name, float min, float max){
- String V;
  error = 0;
  if (server.hasArg(name)) {
- V=server.arg(name);
- if ((V.length()<1)|(!isFloat(V))){
+ const String &V=server.arg(name);
+ float v=0;
+ const char *last=V.c_str()+V.length();
+ if (scanFloat(V.c_str(),last,v)!=last){
  errorcount++;
  error=NaN;
  return NaN;
  }
- var=V.toFloat();
+ var=v;
  if(max!=min){
  if ((var<=max)&&(var>=min)){
   error = OK;
@@ -1622,29 +2879,17 @@ int32_t tSysConfig::copyval(float &var, char const *name, float min, float max){
 }
 
 int32_t tSysConfig::copyval(time_t &var, char const *name){
- String V;
- String H;
- String M;
+ uint32_t h=0,m=0;
  error = 0;
  tmElements_t timeVal; 
- time_t t;
- 
-if (server.hasArg(name)) {
- V=server.arg(name);
- if (!V.length()) {
-  error = InvalidTime;
-  return error;
- }
-  int pos = V.indexOf(":");
-  if (pos==-1){ error=InvalidTime; return error; } else {
-  H=V.substring(0,pos);
-  M=V.substring(pos+1);
 
-  if (!isinteger(H) || !isinteger(M)){ error=InvalidTime; return error; }
- }
+if (server.hasArg(name)) {
+ const String &V=server.arg(name);
+ const char *last=V.c_str()+V.length();
+ if (scanTime(V.c_str(),last,h,m)!=last){ error=InvalidTime; return error; }
   timeVal.Second=0;
-  timeVal.Hour=(uint8_t)H.toInt();
-  timeVal.Minute=(uint8_t)M.toInt();
+  timeVal.Hour=(uint8_t)h;
+  timeVal.Minute=(uint8_t)m;
   timeVal.Wday=0;
   timeVal.Day=0;
   timeVal.Month=0;
@@ -1652,6 +2897,7 @@ if (server.hasArg(name)) {
   // the date variable is offset to 1970 consequently we must compensate to maintain the correct values
   // without the correction, significant time errors occur
   var=86400+makeTime(timeVal);
+  return OK;
  } 
  else{
  errorcount++;
@@ -1661,20 +2907,18 @@ if (server.hasArg(name)) {
 }
 
 int32_t tSysConfig::copyval(char* var, char const *name, int32_t size, int32_t min){
- ///char buf[128]=""; 
- String V;
  int32_t bytes=0;
  if (server.hasArg(name)) {
-  V=server.arg(name);
-  if (min>0){if (V.length()<min){
+  const String &V=server.arg(name);
+  if (min>0){if ((int32_t)V.length()<min){
     errorcount++;
     error = RangeLow;
     return RangeLow;}
   }
-  if ((V.length()+1)<=size){
+  if ((int32_t)V.length()+1<=size){
   bytes=V.length()+1;} else {bytes=size;}
   bytes=strlcpy(var,V.c_str(), bytes); 
-  if (bytes<V.length()){
+  if (bytes<(int32_t)V.length()){
     errorcount++;
   }
   return bytes; } 
@@ -1684,19 +2928,26 @@ int32_t tSysConfig::copyval(char* var, char const *name, int32_t size, int32_t m
  }
 }
 
+int32_t tSysConfig::copyval(bool &var, char const *name){
+ // an unchecked checkbox is not posted at all, so a missing field is a valid false rather than an error
+ error = OK;
+ var=server.hasArg(name);
+ return OK;
+}
+
 int32_t tSysConfig::copyIP(IPAddress &var, char const *name){
- String V;
  error = 0;
  if (server.hasArg(name)) {
- V=server.arg(name);
- if ((V.length()<1)|(!isTime(V))){
- errorcount++;
- error=NaN;
- return NaN;
- }
- if ( var.fromString(V) ){
+ const String &V=server.arg(name);
+ IPAddress ip;
+ const char *last=V.c_str()+V.length();
+ if (scanIP(V.c_str(),last,ip)==last){
+ var=ip;
  return OK;
- } 
+ }
+ errorcount++;
+ error = BadAddress;
+ return BadAddress;
  }
  else {
  errorcount++;
@@ -1705,26 +2956,8 @@ int32_t tSysConfig::copyIP(IPAddress &var, char const *name){
  }
 }
 void tSysConfig::scanWiFi(){
- bool isConnected=WiFi.status() == WL_CONNECTED;
- int32_t retries=0;
- WiFi.mode(WIFI_AP_STA);
- WiFi.disconnect();
- // scan for available networks
- n = WiFi.scanNetworks(); 
- for (int32_t i = 0; i < n; i++)
- {
- WiFi.getNetworkInfo(i, ssid, encryptionType, RSSI, BSSID, channel, isHidden);
- Serial.printf("%d: %s, Ch:%d (%ddBm) %s %s\r\n", i + 1, ssid.c_str(), channel, RSSI, encryptionType == ENC_TYPE_NONE ? "open" : "", isHidden ? "hidden" : "");
- }
- if (isConnected){ 
- WiFi.begin(_data.AccessPoints[0].WiFiname, _data.AccessPoints[0].WiFipassword); 
- // wait for connection here
- while ((WiFi.status() != WL_CONNECTED) && (retries<10)) {
- delay(1500);
- Serial.print(".");
- ++retries;
- } 
- }
+ setWiFiState(w_scan);
+ stepWiFi(); // the scan starts now, the WiFi job collects it
 }
 
 tSysConfig sysConfig;
@@ -0,0 +1,14 @@
+/* the page benchmark of the ESP8266 on the host clock, pages [loops], each page is built loops times without being sent
+ * and the cost of each is printed as /bench.html shows it on the device, with the heap allocations each page makes
+ */
+#include "harness.h"
+
+int main(int argc, char **argv){
+ uint32_t loops=argc>1 ? atol(argv[1]) : 100;
+ uploadAssets();
+ sysConfig.init();
+ host::realTime=true;
+ host::serialEcho=true;
+ sysConfig.benchPages(loops);
+ return 0;
+}
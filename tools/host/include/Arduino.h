@@ -0,0 +1,272 @@
+/* host stand-in for the Arduino core, just enough of String, Print, Serial, IPAddress and ESP for sysconfig32.h and sysconfig8266.h
+ * to compile and run on Linux, the behaviour the tests steer (clock, radio, flash, heap) is set through host.h
+ */
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdarg>
+#include <cstddef>
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+#include <functional>
+#include <sys/time.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// program memory is ordinary memory on the host
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper*>(p))
+#define PSTR(s) (s)
+#define PROGMEM
+typedef const char *PGM_P;
+inline char *strncpy_P(char *d, const char *s, size_t n){ return strncpy(d, s, n);}
+inline size_t strlen_P(const char *s){ return strlen(s);}
+inline void *memcpy_P(void *d, const void *s, size_t n){ return memcpy(d, s, n);}
+inline int strcmp_P(const char *a, const char *b){ return strcmp(a, b);}
+inline int strncmp_P(const char *a, const char *b, size_t n){ return strncmp(a, b, n);}
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_ptr(p) (*(void* const*)(p))
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char *d, const char *s, size_t n){
+ size_t l=strlen(s);
+ if (n){ size_t c=l<n-1 ? l : n-1; memcpy(d, s, c); d[c]=0;}
+ return l;
+}
+#endif
+
+inline bool isDigit(char c){ return (c>='0')&&(c<='9');}
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class String {
+ public:
+  String(){}
+  String(const char *c){ if (c){ s=c;}}
+  String(const std::string &c):s(c){}
+  String(const __FlashStringHelper *c){ if (c){ s=(const char*)c;}}
+  explicit String(char c){ s=c;}
+  explicit String(int v, unsigned char base=DEC){ number(v<0, v<0 ? -(unsigned long long)v : v, base);}
+  explicit String(unsigned v, unsigned char base=DEC){ number(false, v, base);}
+  explicit String(long v, unsigned char base=DEC){ number(v<0, v<0 ? -(unsigned long long)v : v, base);}
+  explicit String(unsigned long v, unsigned char base=DEC){ number(false, v, base);}
+  explicit String(double v, unsigned char decimals=2){ char b[48]; snprintf(b, sizeof(b), "%.*f", decimals, v); s=b;}
+  const char *c_str() const { return s.c_str();}
+  unsigned length() const { return s.size();}
+  bool isEmpty() const { return s.empty();}
+  char charAt(unsigned i) const { return i<s.size() ? s[i] : 0;}
+  char operator[](unsigned i) const { return charAt(i);}
+  int indexOf(char c, unsigned from=0) const { return found(s.find(c, from));}
+  int indexOf(const char *c, unsigned from=0) const { return found(s.find(c, from));}
+  int indexOf(const String &c, unsigned from=0) const { return found(s.find(c.s, from));}
+  int lastIndexOf(char c) const { return found(s.rfind(c));}
+  String substring(unsigned a) const { return a<s.size() ? String(s.substr(a)) : String();}
+  String substring(unsigned a, unsigned b) const { if (a>b){ std::swap(a, b);} return a<s.size() ? String(s.substr(a, b-a)) : String();}
+  long toInt() const { return atol(s.c_str());}
+  float toFloat() const { return atof(s.c_str());}
+  bool startsWith(const char *p) const { return s.rfind(p, 0)==0;}
+  bool startsWith(const String &p) const { return s.rfind(p.s, 0)==0;}
+  bool endsWith(const char *p) const { size_t n=strlen(p); return (s.size()>=n)&&(s.compare(s.size()-n, n, p)==0);}
+  bool equals(const String &o) const { return s==o.s;}
+  void toLowerCase(){ for (auto &c:s){ c=tolower(c);}}
+  void trim(){ s.erase(0, s.find_first_not_of(" \t\r\n")); s.erase(s.find_last_not_of(" \t\r\n")+1);}
+  void replace(const char *from, const char *to){ size_t n=strlen(from), m=strlen(to); for (size_t p=s.find(from); n&&(p!=std::string::npos); p=s.find(from, p+m)){ s.replace(p, n, to);}}
+  void remove(unsigned index, unsigned count=(unsigned)-1){ if (index<s.size()){ s.erase(index, count);}}
+  bool reserve(unsigned n){ s.reserve(n); return true;}
+  bool concat(const char *c, unsigned n){ s.append(c, n); return true;}
+  bool concat(const String &c){ s+=c.s; return true;}
+  bool concat(const char *c){ if (c){ s+=c;} return true;}
+  bool concat(char c){ s+=c; return true;}
+  String &operator=(const char *o){ s=o ? o : ""; return *this;}
+  String &operator=(const __FlashStringHelper *o){ s=o ? (const char*)o : ""; return *this;}
+  String &operator+=(const String &o){ s+=o.s; return *this;}
+  String &operator+=(const char *o){ if (o){ s+=o;} return *this;}
+  String &operator+=(const __FlashStringHelper *o){ if (o){ s+=(const char*)o;} return *this;}
+  String &operator+=(char c){ s+=c; return *this;}
+  String &operator+=(int v){ s+=std::to_string(v); return *this;}
+  String &operator+=(unsigned v){ s+=std::to_string(v); return *this;}
+  String &operator+=(long v){ s+=std::to_string(v); return *this;}
+  String &operator+=(unsigned long v){ s+=std::to_string(v); return *this;}
+  bool operator==(const char *o) const { return s==(o ? o : "");}
+  bool operator==(const String &o) const { return s==o.s;}
+  bool operator!=(const char *o) const { return !(*this==o);}
+  bool operator!=(const String &o) const { return s!=o.s;}
+  bool operator<(const String &o) const { return s<o.s;}
+  std::string s;
+ private:
+  static int found(size_t p){ return p==std::string::npos ? -1 : (int)p;}
+  void number(bool negative, unsigned long long v, unsigned char base){
+   char b[72]; int i=sizeof(b)-1; b[i]=0;
+   do { b[--i]="0123456789abcdef"[v%base]; v/=base;} while (v);
+   if (negative){ b[--i]='-';}
+   s=b+i;
+  }
+};
+inline String operator+(const String &a, const String &b){ return String(a.s+b.s);}
+inline String operator+(const String &a, const char *b){ return String(a.s+(b ? b : ""));}
+inline String operator+(const char *a, const String &b){ return String(std::string(a ? a : "")+b.s);}
+inline String operator+(const String &a, char b){ return String(a.s+b);}
+inline String operator+(const String &a, const __FlashStringHelper *b){ return String(a.s+(const char*)b);}
+
+class Print;
+class Printable {
+ public:
+  virtual size_t printTo(Print &p) const=0;
+  virtual ~Printable(){}
+};
+
+class Print {
+ public:
+  virtual ~Print(){}
+  virtual size_t write(uint8_t c){ return write(&c, 1);}
+  virtual size_t write(const uint8_t *b, size_t n){ return n;}
+  size_t write(const char *s){ return s ? write((const uint8_t*)s, strlen(s)) : 0;}
+  size_t write(const char *s, size_t n){ return write((const uint8_t*)s, n);}
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))){
+   char b[512];
+   va_list a;
+   va_start(a, format);
+   int n=vsnprintf(b, sizeof(b), format, a);
+   va_end(a);
+   return n>0 ? write((const uint8_t*)b, std::min((size_t)n, sizeof(b)-1)) : 0;
+  }
+  size_t print(const char *s){ return write(s);}
+  size_t print(const String &s){ return write(s.c_str());}
+  size_t print(const __FlashStringHelper *s){ return write((const char*)s);}
+  size_t print(char c){ return write((uint8_t)c);}
+  size_t print(unsigned char v, int base=DEC){ return print((unsigned long)v, base);}
+  size_t print(int v, int base=DEC){ return print((long)v, base);}
+  size_t print(unsigned v, int base=DEC){ return print((unsigned long)v, base);}
+  size_t print(long v, int base=DEC){ return print(String(v, (unsigned char)base));}
+  size_t print(unsigned long v, int base=DEC){ return print(String(v, (unsigned char)base));}
+  size_t print(long long v, int base=DEC){ return print((long)v, base);}
+  size_t print(unsigned long long v, int base=DEC){ return print((unsigned long)v, base);}
+  size_t print(double v, int digits=2){ return print(String(v, (unsigned char)digits));}
+  size_t print(const Printable &p){ return p.printTo(*this);}
+  size_t println(){ return write("\r\n");}
+  template<typename T> size_t println(const T &v){ size_t n=print(v); return n+println();}
+  template<typename T> size_t println(const T &v, int format){ size_t n=print(v, format); return n+println();}
+};
+
+class Stream : public Print {
+ public:
+  virtual int available(){ return 0;}
+  virtual int read(){ return -1;}
+  virtual int peek(){ return -1;}
+  size_t readBytes(char *b, size_t n){ size_t i=0; for (int c; (i<n)&&((c=read())>=0); i++){ b[i]=c;} return i;}
+  String readStringUntil(char end){ String r; for (int c; ((c=read())>=0)&&(c!=end);){ r+=(char)c;} return r;}
+};
+
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long){}
+  operator bool(){ return true;}
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(const uint8_t *b, size_t n) override;
+  using Print::write;
+};
+extern HardwareSerial Serial;
+
+class IPAddress : public Printable {
+ public:
+  IPAddress(){}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d){ bytes[0]=a; bytes[1]=b; bytes[2]=c; bytes[3]=d;}
+  IPAddress(uint32_t v){ memcpy(bytes, &v, 4);}
+  operator uint32_t() const { uint32_t v; memcpy(&v, bytes, 4); return v;}
+  uint8_t operator[](int i) const { return bytes[i];}
+  uint8_t &operator[](int i){ return bytes[i];}
+  bool operator==(const IPAddress &o) const { return (uint32_t)*this==(uint32_t)o;}
+  bool operator!=(const IPAddress &o) const { return !(*this==o);}
+  bool isSet() const { return (uint32_t)*this!=0;}
+  bool fromString(const char *text){
+   unsigned v[4];
+   char tail;
+   if (sscanf(text, "%u.%u.%u.%u%c", &v[0], &v[1], &v[2], &v[3], &tail)!=4){ return false;}
+   for (byte i=0;i<4;i++){ if (v[i]>255){ return false;} bytes[i]=v[i];}
+   return true;
+  }
+  bool fromString(const String &text){ return fromString(text.c_str());}
+  String toString() const { char b[16]; snprintf(b, sizeof(b), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]); return String(b);}
+  size_t printTo(Print &p) const override { return p.print(toString());}
+ private:
+  uint8_t bytes[4]={0, 0, 0, 0};
+};
+#define INADDR_NONE IPAddress(0, 0, 0, 0)
+#define IPADDR_NONE ((uint32_t)0xffffffffUL)
+
+// time, millis() runs on the host clock of host.h
+unsigned long millis();
+unsigned long micros();
+uint64_t micros64();
+int64_t esp_timer_get_time();
+void delay(unsigned long ms);
+void yield();
+uint32_t esp_random();
+void configTime(long gmtOffset, int daylightOffset, const char *server1, const char *server2=nullptr, const char *server3=nullptr);
+
+// heap allocations of the whole process so far, the page statistics of sysconfig8266.h count them per page with this hook
+namespace host { uint64_t allocations();}
+#define HEAP_ALLOCATIONS() ((uint32_t)host::allocations())
+
+#define OUTPUT 1
+#define INPUT 0
+#define INPUT_PULLUP 2
+#define HIGH 1
+#define LOW 0
+#ifndef LED_BUILTIN
+#define LED_BUILTIN 2
+#endif
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+enum FlashMode_t {FM_QIO, FM_QOUT, FM_DIO, FM_DOUT, FM_UNKNOWN};
+class EspClass {
+ public:
+  uint32_t getCycleCount();
+  uint8_t getCpuFreqMHz();
+  uint32_t getFreeHeap();
+  uint32_t getMaxFreeBlockSize(){ return getFreeHeap();}
+  uint32_t getMaxAllocHeap(){ return getFreeHeap();}
+  uint8_t getHeapFragmentation(){ return 0;}
+  uint32_t random(){ return esp_random();}
+  void random(uint8_t *b, size_t n){ for (size_t i=0;i<n;i++){ b[i]=esp_random();}}
+  uint32_t getChipId(){ return 0x00c0ffee;}
+  uint8_t getChipRevision(){ return 1;}
+  const char *getSdkVersion(){ return "host";}
+  String getCoreVersion(){ return String("host");}
+  uint8_t getBootVersion(){ return 0;}
+  uint8_t getBootMode(){ return 0;}
+  String getResetReason(){ return String("Power on");}
+  uint32_t getFlashChipId(){ return 0x1640ef;}
+  uint32_t getFlashChipRealSize(){ return 4*1024*1024;}
+  uint32_t getFlashChipSize(){ return 4*1024*1024;}
+  uint32_t getFlashChipSpeed(){ return 40000000;}
+  FlashMode_t getFlashChipMode(){ return FM_DIO;}
+  uint32_t getSketchSize(){ return 0;}
+  uint32_t getFreeSketchSpace(){ return 1024*1024;}
+  void restart();
+};
+extern EspClass ESP;
+
+// FreeRTOS, a task is a thread and a tick a real millisecond
+typedef void *TaskHandle_t;
+typedef int BaseType_t;
+typedef void (*TaskFunction_t)(void*);
+#define pdPASS 1
+#define portTICK_PERIOD_MS 1
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, unsigned priority, TaskHandle_t *handle, int core);
+void vTaskDelay(uint32_t ticks);
+inline int xPortGetCoreID(){ return 1;}
@@ -0,0 +1,24 @@
+// host stand-in, no updates arrive
+#pragma once
+#include <Arduino.h>
+
+typedef enum {OTA_AUTH_ERROR, OTA_BEGIN_ERROR, OTA_CONNECT_ERROR, OTA_RECEIVE_ERROR, OTA_END_ERROR} ota_error_t;
+#define U_FLASH 0
+#define U_SPIFFS 100
+#define U_FS U_SPIFFS
+
+class ArduinoOTAClass {
+ public:
+  typedef std::function<void()> THandlerFunction;
+  void onStart(THandlerFunction fn){}
+  void onEnd(THandlerFunction fn){}
+  void onProgress(std::function<void(unsigned int, unsigned int)> fn){}
+  void onError(std::function<void(ota_error_t)> fn){}
+  void setHostname(const char *name){}
+  void setPassword(const char *password){}
+  void setPort(uint16_t port){}
+  void begin(bool useMDNS=true){}
+  void handle(){}
+  int getCommand(){ return U_FLASH;}
+};
+extern ArduinoOTAClass ArduinoOTA;
@@ -0,0 +1,3 @@
+// host stand-in
+#pragma once
+#include <ESPmDNS.h>
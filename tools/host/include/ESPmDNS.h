@@ -0,0 +1,14 @@
+// host stand-in, nothing is announced
+#pragma once
+#include <Arduino.h>
+
+class MDNSResponder {
+ public:
+  bool begin(const char *hostName){ return true;}
+  bool begin(const String &hostName){ return true;}
+  void end(){}
+  bool update(){ return true;}
+  void addService(const char *service, const char *proto, uint16_t port){}
+  void addService(const String &service, const String &proto, uint16_t port){}
+};
+extern MDNSResponder MDNS;
@@ -0,0 +1,74 @@
+// host stand-in, SPIFFS is a directory of the host, see host::fsRoot()
+#pragma once
+#include <host.h>
+#include <cstdio>
+
+enum SeekMode {SeekSet=0, SeekCur=1, SeekEnd=2};
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File : public Stream {
+ public:
+  File(){}
+  File(std::shared_ptr<FILE> f, const std::string &path):f(f), path(path){}
+  size_t write(const uint8_t *b, size_t n) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t *b, size_t n);
+  bool seek(uint32_t pos, SeekMode mode=SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void flush(){ if (f){ fflush(f.get());}}
+  void close(){ f.reset();}
+  const char *name() const { return path.c_str();}
+  bool isDirectory(){ return false;}
+  File openNextFile(){ return File();}
+  operator bool() const { return (bool)f;}
+ private:
+  std::shared_ptr<FILE> f;
+  std::string path;
+};
+
+class Dir {
+ public:
+  Dir(){}
+  Dir(std::vector<std::pair<std::string, size_t>> entries):entries(entries){}
+  bool next(){ return ++at<(int)entries.size();}
+  String fileName(){ return String(entries[at].first);}
+  size_t fileSize(){ return entries[at].second;}
+ private:
+  std::vector<std::pair<std::string, size_t>> entries;
+  int at=-1;
+};
+
+class FS {
+ public:
+  bool begin(bool formatOnFail=false){ mounted=host::fsMountable; return mounted;}
+  void end(){ mounted=false;}
+  File open(const char *path, const char *mode="r");
+  File open(const String &path, const char *mode="r"){ return open(path.c_str(), mode);}
+  bool exists(const char *path);
+  bool exists(const String &path){ return exists(path.c_str());}
+  bool remove(const char *path);
+  bool remove(const String &path){ return remove(path.c_str());}
+  bool rename(const char *from, const char *to);
+  bool rename(const String &from, const String &to){ return rename(from.c_str(), to.c_str());}
+  Dir openDir(const char *path); // every file whose name starts with path
+  size_t totalBytes(){ return 1024*1024;}
+  size_t usedBytes();
+  bool format(){ host::fsClear(); return true;}
+ private:
+  bool mounted=false;
+};
+
+}
+
+using fs::File;
+using fs::Dir;
+using fs::FS;
+extern FS SPIFFS;
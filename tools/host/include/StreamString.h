@@ -0,0 +1,12 @@
+// host stand-in
+#pragma once
+#include <Arduino.h>
+
+class StreamString : public String, public Stream {
+ public:
+  size_t write(const uint8_t *b, size_t n) override { concat((const char*)b, n); return n;}
+  using Print::write;
+  int available() override { return length();}
+  int read() override { if (!length()){ return -1;} char c=charAt(0); remove(0, 1); return (uint8_t)c;}
+  int peek() override { return length() ? (uint8_t)charAt(0) : -1;}
+};
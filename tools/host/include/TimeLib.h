@@ -0,0 +1,15 @@
+// host stand-in for the parts of the Time library the 8266 config uses, years count from 1970
+#pragma once
+#include <Arduino.h>
+
+typedef struct {
+ uint8_t Second;
+ uint8_t Minute;
+ uint8_t Hour;
+ uint8_t Wday; // day of week, sunday is day 1
+ uint8_t Day;
+ uint8_t Month;
+ uint8_t Year; // offset from 1970
+} tmElements_t;
+void breakTime(time_t time, tmElements_t &tm);
+time_t makeTime(const tmElements_t &tm);
@@ -0,0 +1,91 @@
+/* host stand-in for the WebServer of both cores, requests arrive on the connections a test opens with host::connect()
+ * and are parsed, routed and answered in handleClient() as the cores do, with the same protected state the config
+ * subclasses reach into, responses are written raw to the connection, chunked when the length is not known
+ */
+#pragma once
+#include <host.h>
+#include <WiFiClient.h>
+#include <FS.h>
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+#define HTTP_MAX_DATA_WAIT 5000 // ms to wait for the rest of a request
+#define HTTP_MAX_CLOSE_WAIT 2000 // ms an idle kept alive connection stays open
+
+class WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+  WebServer(int port=80):_server(port){}
+  virtual ~WebServer(){}
+  void begin(){ _server.begin();}
+  void close(){ _server.close();}
+  void stop(){ close();}
+  void handleClient();
+  void on(const String &uri, THandlerFunction handler){ on(uri, HTTP_ANY, handler);}
+  void on(const String &uri, HTTPMethod method, THandlerFunction handler){ _handlers.push_back({uri, method, handler});}
+  void onNotFound(THandlerFunction fn){ _notFoundHandler=fn;}
+  void collectHeaders(const char *headerKeys[], const size_t headerKeysCount){} // every header is kept
+  bool authenticate(const char *username, const char *password); // Basic only
+  void requestAuthentication();
+  // the request
+  HTTPMethod method(){ return _currentMethod;}
+  String uri(){ return _currentUri;}
+  WiFiClient &client(){ return _currentClient;}
+#ifdef ESP8266
+  const String &arg(const String &name); // the ESP8266 core hands out the stored value, the ESP32 one a copy
+#else
+  String arg(const String &name);
+#endif
+  String arg(int i){ return i<_currentArgCount ? _currentArgs[i].value : String();}
+  String argName(int i){ return i<_currentArgCount ? _currentArgs[i].key : String();}
+  int args(){ return _currentArgCount;}
+  bool hasArg(const String &name);
+  String header(const String &name);
+  String header(int i){ return i<(int)_headers.size() ? _headers[i].value : String();}
+  String headerName(int i){ return i<(int)_headers.size() ? _headers[i].key : String();}
+  int headers(){ return _headers.size();}
+  bool hasHeader(const String &name);
+  // the response
+  void keepAlive(bool keepAlive){ _keepAlive=keepAlive;}
+  void sendHeader(const String &name, const String &value, bool first=false);
+  void setContentLength(const size_t contentLength){ _contentLength=contentLength;}
+  void send(int code, const char *content_type=nullptr, const String &content=String());
+  void send(int code, const char *content_type, const char *content){ send(code, content_type, String(content));}
+  void send(int code, const String &content_type, const String &content){ send(code, content_type.c_str(), content);}
+  void send_P(int code, PGM_P content_type, PGM_P content){ send(code, content_type, String(content));}
+  void sendContent(const String &content){ sendContent(content.c_str(), content.length());}
+  void sendContent(const char *content, size_t size);
+  void sendContent_P(PGM_P content){ sendContent(content, strlen(content));}
+  size_t streamFile(fs::File &file, const String &contentType, int code=200);
+ protected:
+  struct RequestArgument {
+   String key;
+   String value;
+  };
+  enum HTTPClientStatus {HC_NONE, HC_WAIT_READ, HC_WAIT_CLOSE};
+  bool _parseRequest(); // false while the request is incomplete
+  void _handleRequest();
+  void _endConnection(){ _currentClient.stop(); _currentClient=WiFiClient(); _currentStatus=HC_NONE;}
+  WiFiServer _server;
+  WiFiClient _currentClient;
+  HTTPMethod _currentMethod=HTTP_GET;
+  String _currentUri;
+  HTTPClientStatus _currentStatus=HC_NONE;
+  unsigned long _statusChange=0;
+  bool _keepAlive=false;
+  RequestArgument *_currentArgs=nullptr;
+  int _currentArgCount=0;
+ private:
+  struct RequestHandler {
+   String uri;
+   HTTPMethod method;
+   THandlerFunction fn;
+  };
+  std::vector<RequestHandler> _handlers;
+  THandlerFunction _notFoundHandler;
+  std::vector<RequestArgument> _args, _headers;
+  std::string _responseHeaders;
+  size_t _contentLength=CONTENT_LENGTH_NOT_SET;
+  bool _chunked=false;
+};
+typedef WebServer ESP8266WebServer;
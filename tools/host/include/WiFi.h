@@ -0,0 +1,88 @@
+// host stand-in, the station radio runs against host::accessPoints and the clock, the soft AP always comes up
+#pragma once
+#include <host.h>
+#include <WiFiClient.h>
+#include <WiFiUdp.h>
+
+typedef int8_t err_t;
+#define ERR_OK 0
+#define STATION_IF 0
+#define SOFTAP_IF 1
+
+typedef enum {
+ WL_NO_SHIELD=255, WL_IDLE_STATUS=0, WL_NO_SSID_AVAIL=1, WL_SCAN_COMPLETED=2, WL_CONNECTED=3, WL_CONNECT_FAILED=4, WL_CONNECTION_LOST=5, WL_DISCONNECTED=6
+} wl_status_t;
+typedef enum {WIFI_OFF=0, WIFI_STA=1, WIFI_AP=2, WIFI_AP_STA=3} WiFiMode_t;
+#define WIFI_MODE_NULL WIFI_OFF
+#define WIFI_MODE_STA WIFI_STA
+#define WIFI_MODE_AP WIFI_AP
+#define WIFI_MODE_APSTA WIFI_AP_STA
+#define ENC_TYPE_NONE 7
+#define ENC_TYPE_CCMP 4
+#define WIFI_AUTH_OPEN 0
+#define WIFI_AUTH_WPA2_PSK 3
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+class WiFiClass {
+ public:
+  void persistent(bool){}
+  bool mode(WiFiMode_t m){ _mode=m; return true;}
+  WiFiMode_t getMode(){ return _mode;}
+  bool setAutoReconnect(bool){ return true;}
+  bool setHostname(const char*){ return true;}
+  bool hostname(const char*){ return true;}
+  // station
+  wl_status_t begin(const char *ssid, const char *passphrase=nullptr, int32_t channel=0, const uint8_t *bssid=nullptr, bool connect=true);
+  wl_status_t begin(){ return WL_DISCONNECTED;}
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1=IPAddress(), IPAddress dns2=IPAddress());
+  bool disconnect(bool wifioff=false, bool eraseap=false);
+  bool reconnect(){ return true;}
+  wl_status_t status();
+  bool isConnected(){ return status()==WL_CONNECTED;}
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t i=0);
+  String SSID();
+  String psk();
+  uint8_t *BSSID();
+  int32_t RSSI();
+  int32_t channel();
+  String macAddress(){ return String("24:0A:C4:00:00:01");}
+  // scans
+  int8_t scanNetworks(bool async=false, bool show_hidden=false);
+  int8_t scanComplete();
+  void scanDelete();
+  bool getNetworkInfo(uint8_t i, String &ssid, uint8_t &encryptionType, int32_t &RSSI, uint8_t *&BSSID, int32_t &channel, bool &isHidden);
+  String SSID(uint8_t i);
+  int32_t RSSI(uint8_t i);
+  uint8_t *BSSID(uint8_t i);
+  int32_t channel(uint8_t i);
+  uint8_t encryptionType(uint8_t i);
+  // soft AP
+  bool softAP(const char *ssid, const char *passphrase=nullptr, int channel=1, int ssid_hidden=0, int max_connection=4){ return true;}
+  bool softAPConfig(IPAddress local, IPAddress gateway, IPAddress subnet){ apIP=local; return true;}
+  bool softAPdisconnect(bool wifioff=false){ return true;}
+  IPAddress softAPIP(){ return apIP;}
+  uint8_t softAPgetStationNum(){ return 0;}
+  // neither WPS nor SmartConfig finds anything on the host
+  bool beginWPSConfig(){ return false;}
+  bool beginSmartConfig(){ return true;}
+  bool smartConfigDone(){ return false;}
+ private:
+  const host::AccessPoint *linked(); // the access point the station is associated with, if any
+  WiFiMode_t _mode=WIFI_OFF;
+  std::string target, passphrase;
+  int32_t targetChannel=0;
+  bool haveBSSID=false;
+  uint8_t targetBSSID[6];
+  bool connecting=false;
+  unsigned long beginMillis=0;
+  IPAddress staticIP, apIP;
+  int scanState=WIFI_SCAN_FAILED;
+  unsigned long scanStart=0;
+  std::vector<host::AccessPoint> results;
+  uint8_t bssid[6]={0, 0, 0, 0, 0, 0};
+};
+extern WiFiClass WiFi;
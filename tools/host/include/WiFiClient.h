@@ -0,0 +1,46 @@
+// host stand-in, a client is one end of a host::Connection, the test holds the other
+#pragma once
+#include <host.h>
+
+class WiFiClient : public Stream {
+ public:
+  WiFiClient(){}
+  WiFiClient(std::shared_ptr<host::Connection> c):c(c){}
+  int available() override { return (c&&!c->closed) ? (int)(c->in.size()-c->readPos) : 0;}
+  int read() override { return available() ? (uint8_t)c->in[c->readPos++] : -1;}
+  int read(uint8_t *b, size_t n){ size_t k=std::min(n, (size_t)available()); if (k){ memcpy(b, c->in.data()+c->readPos, k); c->readPos+=k;} return k;}
+  int peek() override { return available() ? (uint8_t)c->in[c->readPos] : -1;}
+  size_t peekBytes(uint8_t *b, size_t n){ size_t k=std::min(n, (size_t)available()); if (k){ memcpy(b, c->in.data()+c->readPos, k);} return k;}
+  size_t write(const uint8_t *b, size_t n) override;
+  using Print::write;
+  int availableForWrite(); // the free space of the send buffer
+  uint8_t connected(){ return c&&!c->closed&&(!c->peerClosed||available());}
+  void stop(){ if (c){ c->closed=true;}}
+  void flush(){}
+  void setNoDelay(bool){}
+  void setTimeout(unsigned long){}
+  void keepAlive(uint16_t idle=7200, uint16_t interval=75, uint8_t count=9){}
+  int fd() const { return c ? c->fd : -1;}
+  IPAddress remoteIP(){ return IPAddress(192, 168, 4, 2);}
+  IPAddress localIP(){ return IPAddress(192, 168, 4, 1);}
+  operator bool(){ return (bool)c;}
+  bool operator==(const WiFiClient &o) const { return c==o.c;}
+ private:
+  std::shared_ptr<host::Connection> c;
+};
+
+class WiFiServer {
+ public:
+  WiFiServer(uint16_t port=80):port(port){}
+  WiFiServer(IPAddress, uint16_t port=80):port(port){}
+  void begin(uint16_t p=0){ if (p){ port=p;} listening=true;}
+  void close(){ listening=false;}
+  void stop(){ close();}
+  bool hasClient();
+  WiFiClient available(); // the next connection to accept
+  WiFiClient accept(){ return available();}
+  void setNoDelay(bool){}
+ private:
+  uint16_t port;
+  bool listening=false;
+};
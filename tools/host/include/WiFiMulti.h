@@ -0,0 +1,13 @@
+// host stand-in, the access points are kept but the list is never run
+#pragma once
+#include <WiFi.h>
+
+class WiFiMulti {
+ public:
+  bool addAP(const char *ssid, const char *passphrase=nullptr){ aps.push_back({ssid, passphrase ? passphrase : ""}); return true;}
+  void cleanAPlist(){ aps.clear();}
+  wl_status_t run(uint32_t connectTimeout=5000){ return WiFi.status();}
+ private:
+  std::vector<std::pair<std::string, std::string>> aps;
+};
+typedef WiFiMulti ESP8266WiFiMulti;
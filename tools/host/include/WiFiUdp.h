@@ -0,0 +1,13 @@
+// host stand-in, the sockets are never used for traffic
+#pragma once
+#include <Arduino.h>
+
+class WiFiUDP : public Stream {
+ public:
+  uint8_t begin(uint16_t port){ _port=port; return 1;}
+  void stop(){ _port=0;}
+  uint16_t localPort(){ return _port;}
+  int parsePacket(){ return 0;}
+ private:
+  uint16_t _port=0;
+};
@@ -0,0 +1,5 @@
+// host stand-in
+#pragma once
+#include <Arduino.h>
+
+void settimeofday_cb(std::function<void()> cb);
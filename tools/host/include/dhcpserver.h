@@ -0,0 +1,5 @@
+// host stand-in
+#pragma once
+#include <WiFi.h>
+
+inline void dhcps_set_dns(int num, const IPAddress &dns){}
@@ -0,0 +1,24 @@
+// host stand-in, the one data partition is host::flash, erased to 0xFF and written as NOR flash is, by clearing bits
+#pragma once
+#include <host.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+typedef enum {ESP_PARTITION_TYPE_APP=0x00, ESP_PARTITION_TYPE_DATA=0x01} esp_partition_type_t;
+typedef enum {ESP_PARTITION_SUBTYPE_ANY=0xff} esp_partition_subtype_t;
+typedef struct {
+ esp_partition_type_t type;
+ int subtype;
+ uint32_t address;
+ uint32_t size;
+ char label[17];
+ bool encrypted;
+} esp_partition_t;
+#define SPI_FLASH_SEC_SIZE 4096
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, int subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
@@ -0,0 +1,3 @@
+// host stand-in, only the include is needed
+#pragma once
+#include <Arduino.h>
@@ -0,0 +1,3 @@
+// host stand-in
+#pragma once
+typedef enum {WPS_TYPE_DISABLE=0, WPS_TYPE_PBC, WPS_TYPE_PIN} wps_type_t;
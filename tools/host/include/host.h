@@ -0,0 +1,87 @@
+/* control side of the host build, the tests steer the clock, the access points, the config partition and the connections
+ * to the web server from here while the real tSysConfig runs against the stand-ins
+ */
+#pragma once
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <utility>
+
+enum HTTPMethod {HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS};
+
+namespace host {
+ // clock, virtual unless realTime is set, then millis() and micros() follow the monotonic clock
+ extern bool realTime;
+ void advance(unsigned long ms);
+
+ // heap, every malloc of the process is counted, getFreeHeap() is heapSize less what is live beyond the first call
+ extern uint32_t heapSize;
+ uint64_t allocations();
+ size_t heapInUse();
+
+ // SPIFFS lives in a directory, ESPCONFIG_FS or a temporary one removed at exit
+ extern bool fsMountable;
+ const std::string &fsRoot();
+ void fsClear();
+ void putFile(const std::string &path, const std::string &content);
+ std::string getFile(const std::string &path);
+
+ // the config partition, empty when the partition table has none
+ extern std::vector<uint8_t> flash;
+ extern long flashBudget; // bytes that may be erased or written before the power is cut, -1 for no cut
+ extern long flashErases;
+
+ // access points in range of the radio, up may be cleared to take one away
+ struct AccessPoint {
+  std::string ssid, password;
+  int32_t RSSI;
+  int32_t channel;
+  uint8_t BSSID[6];
+  bool up;
+ };
+ extern std::vector<AccessPoint> accessPoints;
+ extern unsigned long scanTime; // an asynchronous scan
+ extern unsigned long probeTime; // associating when channel and BSSID are given
+ extern unsigned long searchTime; // associating when the radio has to look for the SSID first
+ extern unsigned long dhcpTime; // the lease, skipped with a static address
+ extern int begins, scans, configs;
+
+ // a TCP connection to a WiFiServer, in is what the peer sent, out what the device wrote
+ struct Connection {
+  std::string in, out;
+  size_t readPos=0; // of in, what the device has read
+  size_t responsePos=0; // of out, what fetch has taken
+  size_t window=(size_t)-1; // bytes the peer still takes before the send buffer is full
+  bool peerClosed=false;
+  bool closed=false;
+  int fd=-1;
+ };
+ std::shared_ptr<Connection> connect(uint16_t port=80); // queued until the server accepts it
+
+ struct Request {
+  HTTPMethod method=HTTP_GET;
+  std::string uri;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+  std::string text() const; // the request as it goes on the wire
+ };
+ struct Response {
+  int code=0;
+  std::map<std::string, std::string> headers; // lower case names
+  std::string body; // with the chunking removed
+  bool chunked=false;
+  std::string header(const std::string &name) const;
+ };
+ // decodes the first response in raw, false while it is incomplete, used is set to its length on the wire
+ bool parseResponse(const std::string &raw, Response &r, size_t *used=nullptr, bool closed=false);
+ // sends the request on c and steps until the whole response is back or timeout virtual ms have passed
+ bool fetch(Connection &c, const Request &q, Response &r, const std::function<void()> &step, unsigned long timeout=10000);
+ std::string basicAuth(const std::string &user, const std::string &password);
+
+ // serial console
+ extern std::string serialIn;
+ extern bool serialEcho; // copies the console to stdout
+ extern std::string serialOut;
+}
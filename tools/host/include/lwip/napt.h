@@ -0,0 +1,13 @@
+// host stand-in, the table stays empty
+#pragma once
+#include <WiFi.h>
+
+#define IP_NAPT 1
+struct stats_ip_napt {
+ uint32_t nr_active_tcp, nr_active_udp, nr_active_icmp;
+ uint32_t max_active_tcp, max_active_udp, max_active_icmp;
+ uint32_t nr_forced_evictions;
+};
+inline err_t ip_napt_init(uint16_t max_nat, uint16_t max_portmap){ return ERR_OK;}
+inline err_t ip_napt_enable_no(uint8_t number, int enable){ return ERR_OK;}
+inline void ip_napt_get_stats(struct stats_ip_napt *stats){ *stats={0, 0, 0, 0, 0, 0, 0};}
@@ -0,0 +1,10 @@
+// host stand-in, a socket is the fd of a host::Connection
+#pragma once
+#include <errno.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT 0x40
+#endif
+ssize_t lwip_send(int s, const void *data, size_t size, int flags); // EAGAIN once the window of the peer is used up
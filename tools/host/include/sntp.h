@@ -0,0 +1,5 @@
+// host stand-in
+#pragma once
+#include <Arduino.h>
+
+inline void sntp_servermode_dhcp(int enable){}
@@ -0,0 +1,98 @@
+// the Arduino core of the host build, clock, console, pins, tasks and time
+#include <Arduino.h>
+#include <host.h>
+#include <TimeLib.h>
+#include <coredecls.h>
+#include <thread>
+#include <chrono>
+#include <random>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace host {
+ bool realTime=false;
+ std::string serialIn, serialOut;
+ bool serialEcho=getenv("ESPCONFIG_SERIAL")!=nullptr;
+ static uint64_t virtualMicros=0;
+ void advance(unsigned long ms){ virtualMicros+=(uint64_t)ms*1000;}
+}
+
+static uint64_t monotonicMicros(){
+ static const auto start=std::chrono::steady_clock::now();
+ return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-start).count();
+}
+uint64_t micros64(){ return host::realTime ? monotonicMicros() : host::virtualMicros;}
+unsigned long micros(){ return (uint32_t)micros64();}
+unsigned long millis(){ return (uint32_t)(micros64()/1000);}
+int64_t esp_timer_get_time(){ return micros64();}
+void delay(unsigned long ms){
+ if (host::realTime){ std::this_thread::sleep_for(std::chrono::milliseconds(ms));}
+ else { host::advance(ms);}
+}
+void yield(){}
+
+uint32_t esp_random(){
+ static std::mt19937 generator(0x5eed);
+ return generator();
+}
+
+uint32_t EspClass::getCycleCount(){ return (uint32_t)(micros64()*getCpuFreqMHz());}
+uint8_t EspClass::getCpuFreqMHz(){ return 160;}
+void EspClass::restart(){
+ fflush(stdout);
+ exit(0);
+}
+
+int HardwareSerial::available(){ return host::serialIn.size();}
+int HardwareSerial::read(){
+ if (host::serialIn.empty()){ return -1;}
+ uint8_t c=host::serialIn[0];
+ host::serialIn.erase(0, 1);
+ return c;
+}
+int HardwareSerial::peek(){ return host::serialIn.empty() ? -1 : (uint8_t)host::serialIn[0];}
+size_t HardwareSerial::write(const uint8_t *b, size_t n){
+ host::serialOut.append((const char*)b, n);
+ if (host::serialEcho){ fwrite(b, 1, n, stdout);}
+ return n;
+}
+
+static uint8_t pins[64];
+void pinMode(uint8_t pin, uint8_t mode){ if ((pin<sizeof(pins))&&(mode==INPUT_PULLUP)){ pins[pin]=HIGH;}}
+void digitalWrite(uint8_t pin, uint8_t value){ if (pin<sizeof(pins)){ pins[pin]=value;}}
+int digitalRead(uint8_t pin){ return pin<sizeof(pins) ? pins[pin] : LOW;}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, unsigned priority, TaskHandle_t *handle, int core){
+ std::thread *task=new std::thread(fn, arg);
+ task->detach();
+ if (handle){ *handle=task;}
+ return pdPASS;
+}
+void vTaskDelay(uint32_t ticks){ std::this_thread::sleep_for(std::chrono::milliseconds(ticks*portTICK_PERIOD_MS));}
+
+// SNTP never answers on the host, the clock of the process is the time of day
+void configTime(long gmtOffset, int daylightOffset, const char *server1, const char *server2, const char *server3){}
+void settimeofday_cb(std::function<void()> cb){}
+
+void breakTime(time_t time, tmElements_t &tm){
+ struct tm t;
+ gmtime_r(&time, &t);
+ tm.Second=t.tm_sec;
+ tm.Minute=t.tm_min;
+ tm.Hour=t.tm_hour;
+ tm.Wday=t.tm_wday+1;
+ tm.Day=t.tm_mday;
+ tm.Month=t.tm_mon+1;
+ tm.Year=t.tm_year-70;
+}
+// the arithmetic of the Time library, it makes no allocation where timegm() loads the time zone, and a day or month of 0 counts back as it does there
+time_t makeTime(const tmElements_t &tm){
+ static const uint8_t monthDays[]={31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+ auto leap=[](int year){ year+=1970; return (year%4==0)&&((year%100!=0)||(year%400==0));};
+ time_t seconds=tm.Year*365*86400L;
+ for (int i=0;i<tm.Year;i++){ if (leap(i)){ seconds+=86400;}}
+ for (int i=1;i<tm.Month;i++){ seconds+=((i==2)&&leap(tm.Year) ? 29 : monthDays[i-1])*86400L;}
+ seconds+=(tm.Day-1)*86400L;
+ return seconds+tm.Hour*3600+tm.Minute*60+tm.Second;
+}
@@ -0,0 +1,46 @@
+// the config partition, erase sets bytes to 0xFF and a write can only clear bits, both stop when host::flashBudget runs out
+#include <esp_partition.h>
+
+namespace host {
+ std::vector<uint8_t> flash;
+ long flashBudget=-1;
+ long flashErases=0;
+}
+
+static esp_partition_t configPartition={ESP_PARTITION_TYPE_DATA, 0x99, 0x3F0000, 0, "config", false};
+
+// false once the power is cut, each byte erased or written costs one
+static bool spend(){
+ if (host::flashBudget==0){ return false;}
+ if (host::flashBudget>0){ host::flashBudget--;}
+ return true;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, int subtype, const char *label){
+ if (host::flash.empty()||(type!=ESP_PARTITION_TYPE_DATA)||(label&&strcmp(label, configPartition.label))){ return nullptr;}
+ configPartition.size=host::flash.size();
+ return &configPartition;
+}
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size){
+ if (src_offset+size>host::flash.size()){ return ESP_ERR_INVALID_SIZE;}
+ memcpy(dst, &host::flash[src_offset], size);
+ return ESP_OK;
+}
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size){
+ if (dst_offset+size>host::flash.size()){ return ESP_ERR_INVALID_SIZE;}
+ const uint8_t *s=(const uint8_t*)src;
+ for (size_t i=0;i<size;i++){
+  if (!spend()){ return ESP_FAIL;}
+  host::flash[dst_offset+i]&=s[i];
+ }
+ return ESP_OK;
+}
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size){
+ if ((offset+size>host::flash.size())||(offset%SPI_FLASH_SEC_SIZE)||(size%SPI_FLASH_SEC_SIZE)){ return ESP_ERR_INVALID_ARG;}
+ host::flashErases++;
+ for (size_t i=0;i<size;i++){
+  if (!spend()){ return ESP_FAIL;}
+  host::flash[offset+i]=0xFF;
+ }
+ return ESP_OK;
+}
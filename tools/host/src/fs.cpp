@@ -0,0 +1,108 @@
+// SPIFFS on a directory of the host, names keep their leading slash and may hold more slashes as on SPIFFS
+#include <FS.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace stdfs=std::filesystem;
+FS SPIFFS;
+
+namespace host {
+ bool fsMountable=true;
+ static bool fsTemporary=false;
+ const std::string &fsRoot(){
+  static std::string root;
+  if (root.empty()){
+   if (getenv("ESPCONFIG_FS")){ root=getenv("ESPCONFIG_FS");}
+   else {
+    char dir[]="/tmp/espconfig-XXXXXX";
+    root=mkdtemp(dir);
+    fsTemporary=true;
+    atexit([](){ if (fsTemporary){ std::error_code e; stdfs::remove_all(fsRoot(), e);}});
+   }
+   stdfs::create_directories(root);
+  }
+  return root;
+ }
+ static std::string hostPath(const std::string &path){ return fsRoot()+(path.empty()||(path[0]!='/') ? "/" : "")+path;}
+ void fsClear(){
+  for (auto &entry:stdfs::directory_iterator(fsRoot())){ stdfs::remove_all(entry.path());}
+ }
+ void putFile(const std::string &path, const std::string &content){
+  stdfs::path p=hostPath(path);
+  stdfs::create_directories(p.parent_path());
+  std::ofstream(p, std::ios::binary)<<content;
+ }
+ std::string getFile(const std::string &path){
+  std::ifstream f(hostPath(path), std::ios::binary);
+  std::stringstream s;
+  s<<f.rdbuf();
+  return s.str();
+ }
+}
+
+namespace fs {
+
+size_t File::write(const uint8_t *b, size_t n){ return f ? fwrite(b, 1, n, f.get()) : 0;}
+int File::available(){ return f ? (int)(size()-position()) : 0;}
+int File::read(){ return f ? fgetc(f.get()) : -1;}
+int File::peek(){
+ if (!f){ return -1;}
+ int c=fgetc(f.get());
+ if (c!=EOF){ ungetc(c, f.get());}
+ return c;
+}
+size_t File::read(uint8_t *b, size_t n){ return f ? fread(b, 1, n, f.get()) : 0;}
+bool File::seek(uint32_t pos, SeekMode mode){
+ if (!f){ return false;}
+ long to=mode==SeekSet ? (long)pos : (mode==SeekCur ? (long)position()+pos : (long)size()+pos);
+ if ((to<0)||((size_t)to>size())){ return false;}
+ return fseek(f.get(), to, SEEK_SET)==0;
+}
+size_t File::position() const { return f ? ftell(f.get()) : 0;}
+size_t File::size() const {
+ if (!f){ return 0;}
+ fflush(f.get());
+ struct stat s;
+ return fstat(fileno(f.get()), &s)==0 ? s.st_size : 0;
+}
+
+File FS::open(const char *path, const char *mode){
+ if (!mounted){ return File();}
+ stdfs::path p=host::hostPath(path);
+ if (mode[0]!='r'){ stdfs::create_directories(p.parent_path());}
+ // the modes of SPIFFS, always binary
+ const char *m=mode[0]=='r' ? (mode[1]=='+' ? "r+b" : "rb") : (mode[0]=='w' ? (mode[1]=='+' ? "w+b" : "wb") : (mode[1]=='+' ? "a+b" : "ab"));
+ FILE *f=fopen(p.c_str(), m);
+ if (!f){ return File();}
+ return File(std::shared_ptr<FILE>(f, fclose), path);
+}
+bool FS::exists(const char *path){ return mounted&&stdfs::is_regular_file(host::hostPath(path));}
+bool FS::remove(const char *path){ std::error_code e; return mounted&&stdfs::remove(host::hostPath(path), e);}
+bool FS::rename(const char *from, const char *to){
+ if (!exists(from)){ return false;}
+ std::error_code e;
+ stdfs::rename(host::hostPath(from), host::hostPath(to), e);
+ return !e;
+}
+Dir FS::openDir(const char *path){
+ std::vector<std::pair<std::string, size_t>> entries;
+ if (!mounted){ return Dir(entries);}
+ std::string prefix=path;
+ for (auto &entry:stdfs::recursive_directory_iterator(host::fsRoot())){
+  if (!entry.is_regular_file()){ continue;}
+  std::string name="/"+stdfs::relative(entry.path(), host::fsRoot()).string();
+  if (name.rfind(prefix, 0)==0){ entries.push_back({name, (size_t)entry.file_size()});}
+ }
+ std::sort(entries.begin(), entries.end());
+ return Dir(entries);
+}
+size_t FS::usedBytes(){
+ size_t used=0;
+ for (auto &entry:stdfs::recursive_directory_iterator(host::fsRoot())){ if (entry.is_regular_file()){ used+=entry.file_size();}}
+ return used;
+}
+
+}
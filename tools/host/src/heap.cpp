@@ -0,0 +1,64 @@
+/* counts the heap traffic of the whole process by wrapping the allocator of glibc, operator new ends up here too,
+ * ESP.getFreeHeap() reports heapSize less the bytes that are live beyond those of its first call
+ */
+#include <Arduino.h>
+#include <host.h>
+#include <atomic>
+#include <malloc.h>
+
+extern "C" {
+ void *__libc_malloc(size_t size);
+ void *__libc_calloc(size_t n, size_t size);
+ void *__libc_realloc(void *p, size_t size);
+ void *__libc_memalign(size_t alignment, size_t size);
+ void __libc_free(void *p);
+}
+
+static std::atomic<uint64_t> allocationCount{0};
+static std::atomic<int64_t> liveBytes{0};
+
+static void *counted(void *p){
+ if (p){
+  allocationCount++;
+  liveBytes+=malloc_usable_size(p);
+ }
+ return p;
+}
+
+extern "C" {
+ void *malloc(size_t size){ return counted(__libc_malloc(size));}
+ void *calloc(size_t n, size_t size){ return counted(__libc_calloc(n, size));}
+ void *memalign(size_t alignment, size_t size){ return counted(__libc_memalign(alignment, size));}
+ void *aligned_alloc(size_t alignment, size_t size){ return counted(__libc_memalign(alignment, size));}
+ int posix_memalign(void **p, size_t alignment, size_t size){
+  *p=counted(__libc_memalign(alignment, size));
+  return *p ? 0 : ENOMEM;
+ }
+ void free(void *p){
+  if (p){ liveBytes-=malloc_usable_size(p);}
+  __libc_free(p);
+ }
+ void *realloc(void *p, size_t size){
+  if (!p){ return malloc(size);}
+  size_t before=malloc_usable_size(p);
+  void *q=__libc_realloc(p, size);
+  if (q){
+   allocationCount++;
+   liveBytes+=(int64_t)malloc_usable_size(q)-before;
+  }
+  else if (!size){ liveBytes-=before;}
+  return q;
+ }
+}
+
+namespace host {
+ uint32_t heapSize=HOST_HEAP;
+ uint64_t allocations(){ return allocationCount;}
+ size_t heapInUse(){ int64_t live=liveBytes; return live>0 ? live : 0;}
+}
+
+uint32_t EspClass::getFreeHeap(){
+ static const int64_t baseline=liveBytes;
+ int64_t used=liveBytes-baseline;
+ return used<=0 ? host::heapSize : (used>=host::heapSize ? 0 : host::heapSize-used);
+}
@@ -0,0 +1,65 @@
+// HMAC-SHA256 for the bearssl stand-in, FIPS 180-4 and RFC 2104
+#include <bearssl/bearssl.h>
+#include <cstring>
+
+const br_hash_class br_sha256_vtable={1};
+
+static const uint32_t K[64]={
+ 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+ 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+ 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+ 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+ 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+ 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+ 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+ 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static uint32_t rotate(uint32_t x, int n){ return (x>>n)|(x<<(32-n));}
+
+static void sha256(const std::string &m, uint8_t out[32]){
+ uint32_t h[8]={0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+ std::string d=m;
+ d+=(char)0x80;
+ while (d.size()%64!=56){ d+=(char)0;}
+ uint64_t bits=(uint64_t)m.size()*8;
+ for (int i=7;i>=0;i--){ d+=(char)(bits>>(i*8));}
+ const uint8_t *p=(const uint8_t*)d.data();
+ for (size_t block=0;block<d.size();block+=64){
+  uint32_t w[64];
+  for (int i=0;i<16;i++){ w[i]=((uint32_t)p[block+4*i]<<24)|(p[block+4*i+1]<<16)|(p[block+4*i+2]<<8)|p[block+4*i+3];}
+  for (int i=16;i<64;i++){
+   uint32_t s0=rotate(w[i-15], 7)^rotate(w[i-15], 18)^(w[i-15]>>3);
+   uint32_t s1=rotate(w[i-2], 17)^rotate(w[i-2], 19)^(w[i-2]>>10);
+   w[i]=w[i-16]+s0+w[i-7]+s1;
+  }
+  uint32_t a=h[0], b=h[1], c=h[2], e=h[4], f=h[5], g=h[6], dd=h[3], hh=h[7];
+  for (int i=0;i<64;i++){
+   uint32_t t1=hh+(rotate(e, 6)^rotate(e, 11)^rotate(e, 25))+((e&f)^(~e&g))+K[i]+w[i];
+   uint32_t t2=(rotate(a, 2)^rotate(a, 13)^rotate(a, 22))+((a&b)^(a&c)^(b&c));
+   hh=g; g=f; f=e; e=dd+t1; dd=c; c=b; b=a; a=t1+t2;
+  }
+  h[0]+=a; h[1]+=b; h[2]+=c; h[3]+=dd; h[4]+=e; h[5]+=f; h[6]+=g; h[7]+=hh;
+ }
+ for (int i=0;i<8;i++){ for (int j=0;j<4;j++){ out[i*4+j]=h[i]>>(24-8*j);}}
+}
+
+void br_hmac_key_init(br_hmac_key_context *kc, const br_hash_class *digest_vtable, const void *key, size_t key_len){
+ memset(kc->key, 0, sizeof(kc->key));
+ if (key_len>sizeof(kc->key)){ sha256(std::string((const char*)key, key_len), kc->key);}
+ else { memcpy(kc->key, key, key_len);}
+}
+void br_hmac_init(br_hmac_context *ctx, const br_hmac_key_context *kc, size_t out_len){
+ memcpy(ctx->key, kc->key, sizeof(ctx->key));
+ ctx->data.clear();
+ ctx->out_len=(out_len&&(out_len<32)) ? out_len : 32;
+}
+void br_hmac_update(br_hmac_context *ctx, const void *data, size_t len){ ctx->data.append((const char*)data, len);}
+size_t br_hmac_out(const br_hmac_context *ctx, void *out){
+ std::string inner(64, 0), outer(64, 0);
+ for (int i=0;i<64;i++){ inner[i]=ctx->key[i]^0x36; outer[i]=ctx->key[i]^0x5c;}
+ uint8_t digest[32];
+ sha256(inner+ctx->data, digest);
+ sha256(outer+std::string((const char*)digest, 32), digest);
+ memcpy(out, digest, ctx->out_len);
+ return ctx->out_len;
+}
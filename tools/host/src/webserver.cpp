@@ -0,0 +1,310 @@
+// request parsing, routing and the raw HTTP responses of the WebServer stand-in, and the client side the tests use
+#include <WebServer.h>
+
+static const char *methodName(HTTPMethod m){
+ static const char *names[]={"ANY", "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"};
+ return names[m];
+}
+static HTTPMethod methodOf(const std::string &name){
+ for (int m=HTTP_GET;m<=HTTP_OPTIONS;m++){ if (name==methodName((HTTPMethod)m)){ return (HTTPMethod)m;}}
+ return HTTP_ANY;
+}
+static const char *reason(int code){
+ switch (code){
+  case 200: return "OK";
+  case 204: return "No Content";
+  case 301: return "Moved Permanently";
+  case 302: return "Found";
+  case 303: return "See Other";
+  case 304: return "Not Modified";
+  case 400: return "Bad Request";
+  case 401: return "Unauthorized";
+  case 403: return "Forbidden";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 413: return "Payload Too Large";
+  case 429: return "Too Many Requests";
+  case 500: return "Internal Server Error";
+  case 503: return "Service Unavailable";
+ }
+ return "";
+}
+static bool sameName(const std::string &a, const std::string &b){ return strcasecmp(a.c_str(), b.c_str())==0;}
+static std::string urlDecode(const std::string &s){
+ std::string r;
+ for (size_t i=0;i<s.size();i++){
+  if (s[i]=='+'){ r+=' ';}
+  else if ((s[i]=='%')&&(i+2<s.size())){ r+=(char)strtol(s.substr(i+1, 2).c_str(), nullptr, 16); i+=2;}
+  else { r+=s[i];}
+ }
+ return r;
+}
+static std::string base64(const std::string &s){
+ static const char *digits="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+ std::string r;
+ for (size_t i=0;i<s.size();i+=3){
+  uint32_t v=((uint8_t)s[i]<<16)|(i+1<s.size() ? (uint8_t)s[i+1]<<8 : 0)|(i+2<s.size() ? (uint8_t)s[i+2] : 0);
+  r+=digits[(v>>18)&63];
+  r+=digits[(v>>12)&63];
+  r+=i+1<s.size() ? digits[(v>>6)&63] : '=';
+  r+=i+2<s.size() ? digits[v&63] : '=';
+ }
+ return r;
+}
+
+void WebServer::handleClient(){
+ if (_currentStatus==HC_NONE){
+  if (!_server.hasClient()){ return;}
+  _currentClient=_server.available();
+  _currentStatus=HC_WAIT_READ;
+  _statusChange=millis();
+ }
+ if (!_currentClient.connected()){
+  _endConnection();
+  return;
+ }
+ if (_currentStatus==HC_WAIT_CLOSE){
+  if (!_currentClient.available()){
+   if (millis()-_statusChange>HTTP_MAX_CLOSE_WAIT){ _endConnection();}
+   return;
+  }
+  _currentStatus=HC_WAIT_READ;
+  _statusChange=millis();
+ }
+ if (!_parseRequest()){
+  if (millis()-_statusChange>HTTP_MAX_DATA_WAIT){ _endConnection();}
+  return;
+ }
+ _handleRequest();
+ if (!_currentClient){ // taken over by the handler
+  _currentStatus=HC_NONE;
+  return;
+ }
+ if (_keepAlive&&_currentClient.connected()){
+  _currentStatus=HC_WAIT_CLOSE;
+  _statusChange=millis();
+ }
+ else { _endConnection();}
+}
+
+bool WebServer::_parseRequest(){
+ size_t pending=_currentClient.available();
+ std::string raw(pending, 0);
+ _currentClient.peekBytes((uint8_t*)&raw[0], pending);
+ size_t end=raw.find("\r\n\r\n");
+ if (end==std::string::npos){ return false;}
+ size_t lineEnd=raw.find("\r\n");
+ std::string line=raw.substr(0, lineEnd);
+ size_t a=line.find(' '), b=line.rfind(' ');
+ std::string target=line.substr(a+1, b-a-1);
+ _headers.clear();
+ size_t contentLength=0;
+ std::string contentType;
+ for (size_t p=lineEnd+2;p<end;){
+  size_t e=raw.find("\r\n", p);
+  std::string h=raw.substr(p, e-p);
+  size_t colon=h.find(':');
+  std::string name=h.substr(0, colon), value=h.substr(h.find_first_not_of(' ', colon+1));
+  _headers.push_back({String(name), String(value)});
+  if (sameName(name, "Content-Length")){ contentLength=atol(value.c_str());}
+  if (sameName(name, "Content-Type")){ contentType=value;}
+  p=e+2;
+ }
+ if (raw.size()<end+4+contentLength){ return false;}
+ std::string body=raw.substr(end+4, contentLength);
+ uint8_t skip[256];
+ for (size_t n=end+4+contentLength;n;){ n-=_currentClient.read(skip, std::min(n, sizeof(skip)));}
+ _currentMethod=methodOf(line.substr(0, a));
+ size_t query=target.find('?');
+ _currentUri=String(urlDecode(target.substr(0, query)));
+ _args.clear();
+ auto parseArgs=[this](const std::string &s){
+  for (size_t p=0;p<s.size();){
+   size_t e=s.find('&', p);
+   if (e==std::string::npos){ e=s.size();}
+   std::string pair=s.substr(p, e-p);
+   size_t eq=pair.find('=');
+   if (!pair.empty()){ _args.push_back({String(urlDecode(pair.substr(0, eq))), String(eq==std::string::npos ? "" : urlDecode(pair.substr(eq+1)))});}
+   p=e+1;
+  }
+ };
+ if (query!=std::string::npos){ parseArgs(target.substr(query+1));}
+ if (contentType.rfind("application/x-www-form-urlencoded", 0)==0){ parseArgs(body);}
+ else if (!body.empty()){ _args.push_back({String("plain"), String(body)});}
+ _currentArgs=_args.data();
+ _currentArgCount=_args.size();
+ return true;
+}
+
+void WebServer::_handleRequest(){
+ _responseHeaders.clear();
+ _contentLength=CONTENT_LENGTH_NOT_SET;
+ _chunked=false;
+ for (auto &h:_handlers){
+  if ((h.uri==_currentUri)&&((h.method==HTTP_ANY)||(h.method==_currentMethod))){
+   h.fn();
+   return;
+  }
+ }
+ if (_notFoundHandler){ _notFoundHandler();}
+ else { send(404, "text/plain", String("Not found: ")+_currentUri);}
+}
+
+#ifdef ESP8266
+const String &WebServer::arg(const String &name){
+ static const String none;
+ for (int i=0;i<_currentArgCount;i++){ if (_currentArgs[i].key==name){ return _currentArgs[i].value;}}
+ return none;
+}
+#else
+String WebServer::arg(const String &name){
+ for (int i=0;i<_currentArgCount;i++){ if (_currentArgs[i].key==name){ return _currentArgs[i].value;}}
+ return String();
+}
+#endif
+bool WebServer::hasArg(const String &name){
+ for (int i=0;i<_currentArgCount;i++){ if (_currentArgs[i].key==name){ return true;}}
+ return false;
+}
+String WebServer::header(const String &name){
+ for (auto &h:_headers){ if (sameName(h.key.s, name.s)){ return h.value;}}
+ return String();
+}
+bool WebServer::hasHeader(const String &name){
+ for (auto &h:_headers){ if (sameName(h.key.s, name.s)){ return true;}}
+ return false;
+}
+
+bool WebServer::authenticate(const char *username, const char *password){
+ String authorization=header("Authorization");
+ return authorization.startsWith("Basic ")&&(authorization.substring(6).s==base64(std::string(username)+":"+password));
+}
+void WebServer::requestAuthentication(){
+ sendHeader("WWW-Authenticate", "Basic realm=\"Login Required\"");
+ send(401);
+}
+
+void WebServer::sendHeader(const String &name, const String &value, bool first){
+ std::string line=name.s+": "+value.s+"\r\n";
+ _responseHeaders=first ? line+_responseHeaders : _responseHeaders+line;
+}
+void WebServer::send(int code, const char *content_type, const String &content){
+ std::string head="HTTP/1.1 "+std::to_string(code)+" "+reason(code)+"\r\n";
+ if (content_type){ head+=std::string("Content-Type: ")+content_type+"\r\n";}
+ if (_contentLength==CONTENT_LENGTH_UNKNOWN){
+  _chunked=true;
+  head+="Transfer-Encoding: chunked\r\n";
+ }
+ else { head+="Content-Length: "+std::to_string(_contentLength==CONTENT_LENGTH_NOT_SET ? content.length() : _contentLength)+"\r\n";}
+ head+=_keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+ head+=_responseHeaders+"\r\n";
+ _responseHeaders.clear();
+ _currentClient.write(head.data(), head.size());
+ if (content.length()){ sendContent(content);}
+ _contentLength=CONTENT_LENGTH_NOT_SET;
+}
+void WebServer::sendContent(const char *content, size_t size){
+ if (!_chunked){
+  _currentClient.write(content, size);
+  return;
+ }
+ char length[12];
+ snprintf(length, sizeof(length), "%zx\r\n", size);
+ _currentClient.write(length);
+ if (size){ _currentClient.write(content, size);}
+ _currentClient.write("\r\n");
+ if (!size){ _chunked=false;} // the empty chunk ends the body
+}
+size_t WebServer::streamFile(fs::File &file, const String &contentType, int code){
+ String name=file.name();
+ if (name.endsWith(".gz")&&(contentType!="application/x-gzip")&&(contentType!="application/octet-stream")){ sendHeader("Content-Encoding", "gzip");}
+ setContentLength(file.size());
+ send(code, contentType.c_str(), String());
+ uint8_t block[1460];
+ size_t sent=0;
+ for (size_t n;(n=file.read(block, sizeof(block)))>0;){
+  size_t k=_currentClient.write(block, n);
+  sent+=k;
+  if (k<n){ break;}
+ }
+ return sent;
+}
+
+namespace host {
+ std::string Request::text() const {
+  std::string t=std::string(methodName(method==HTTP_ANY ? HTTP_GET : method))+" "+uri+" HTTP/1.1\r\nHost: esp\r\n";
+  bool typed=false;
+  for (auto &h:headers){
+   t+=h.first+": "+h.second+"\r\n";
+   typed|=sameName(h.first, "Content-Type");
+  }
+  if (!body.empty()||(method==HTTP_POST)){
+   if (!typed){ t+="Content-Type: application/x-www-form-urlencoded\r\n";}
+   t+="Content-Length: "+std::to_string(body.size())+"\r\n";
+  }
+  return t+"\r\n"+body;
+ }
+ std::string Response::header(const std::string &name) const {
+  std::string lower=name;
+  for (auto &c:lower){ c=tolower(c);}
+  auto h=headers.find(lower);
+  return h==headers.end() ? std::string() : h->second;
+ }
+ bool parseResponse(const std::string &raw, Response &r, size_t *used, bool closed){
+  size_t end=raw.find("\r\n\r\n");
+  if (end==std::string::npos){ return false;}
+  r=Response();
+  r.code=atoi(raw.c_str()+raw.find(' ')+1);
+  for (size_t p=raw.find("\r\n")+2;p<end;){
+   size_t e=raw.find("\r\n", p);
+   std::string h=raw.substr(p, e-p);
+   size_t colon=h.find(':');
+   std::string name=h.substr(0, colon);
+   for (auto &c:name){ c=tolower(c);}
+   r.headers[name]=h.substr(h.find_first_not_of(' ', colon+1));
+   p=e+2;
+  }
+  size_t p=end+4;
+  if (r.header("transfer-encoding")=="chunked"){
+   r.chunked=true;
+   for (;;){
+    size_t e=raw.find("\r\n", p);
+    if (e==std::string::npos){ return false;}
+    size_t n=strtoul(raw.substr(p, e-p).c_str(), nullptr, 16);
+    if (raw.size()<e+2+n+2){ return false;}
+    r.body.append(raw, e+2, n);
+    p=e+2+n+2;
+    if (!n){ break;}
+   }
+  }
+  else if (!r.header("content-length").empty()){
+   size_t n=atol(r.header("content-length").c_str());
+   if (raw.size()<p+n){ return false;}
+   r.body=raw.substr(p, n);
+   p+=n;
+  }
+  else if ((r.code!=204)&&(r.code!=304)){
+   if (!closed){ return false;}
+   r.body=raw.substr(p);
+   p=raw.size();
+  }
+  if (used){ *used=p;}
+  return true;
+ }
+ bool fetch(Connection &c, const Request &q, Response &r, const std::function<void()> &step, unsigned long timeout){
+  c.in+=q.text();
+  unsigned long start=millis();
+  for (;;){
+   size_t used;
+   if (parseResponse(c.out.substr(c.responsePos), r, &used, c.closed)){
+    c.responsePos+=used;
+    return true;
+   }
+   if (millis()-start>timeout){ return false;}
+   unsigned long before=millis();
+   step();
+   if (!realTime&&(millis()==before)){ advance(1);}
+  }
+ }
+ std::string basicAuth(const std::string &user, const std::string &password){ return "Basic "+base64(user+":"+password);}
+}
@@ -0,0 +1,159 @@
+// the scripted radio and the connections, the timings are those of a station on a quiet channel
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <ArduinoOTA.h>
+#include <lwip/sockets.h>
+#include <deque>
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+ArduinoOTAClass ArduinoOTA;
+
+namespace host {
+ std::vector<AccessPoint> accessPoints;
+ unsigned long scanTime=2000;
+ unsigned long probeTime=150;
+ unsigned long searchTime=600;
+ unsigned long dhcpTime=1000;
+ int begins=0, scans=0, configs=0;
+
+ static std::vector<std::shared_ptr<Connection>> sockets; // by fd
+ static std::map<uint16_t, std::deque<std::shared_ptr<Connection>>> backlog; // by port, until accepted
+ std::shared_ptr<Connection> connect(uint16_t port){
+  auto c=std::make_shared<Connection>();
+  c->fd=sockets.size();
+  sockets.push_back(c);
+  backlog[port].push_back(c);
+  return c;
+ }
+ static std::shared_ptr<Connection> socket(int fd){ return (fd>=0)&&(fd<(int)sockets.size()) ? sockets[fd] : nullptr;}
+ static std::shared_ptr<Connection> accept(uint16_t port){
+  auto &q=backlog[port];
+  if (q.empty()){ return nullptr;}
+  auto c=q.front();
+  q.pop_front();
+  return c;
+ }
+ static bool waiting(uint16_t port){ return !backlog[port].empty();}
+}
+
+#define SEND_BUFFER 2920 // TCP_SND_BUF of lwIP, two segments
+
+size_t WiFiClient::write(const uint8_t *b, size_t n){
+ if (!c||c->closed||c->peerClosed){ return 0;}
+ size_t k=std::min(n, c->window);
+ c->out.append((const char*)b, k);
+ if (c->window!=(size_t)-1){ c->window-=k;}
+ return k;
+}
+int WiFiClient::availableForWrite(){
+ if (!c||c->closed||c->peerClosed){ return 0;}
+ return std::min(c->window, (size_t)SEND_BUFFER);
+}
+bool WiFiServer::hasClient(){ return listening&&host::waiting(port);}
+WiFiClient WiFiServer::available(){
+ if (!listening){ return WiFiClient();}
+ auto c=host::accept(port);
+ return c ? WiFiClient(c) : WiFiClient();
+}
+
+ssize_t lwip_send(int s, const void *data, size_t size, int flags){
+ auto c=host::socket(s);
+ if (!c||c->closed||c->peerClosed){ errno=ENOTCONN; return -1;}
+ size_t k=std::min(std::min(size, c->window), (size_t)SEND_BUFFER);
+ if (!k){ errno=EAGAIN; return -1;}
+ c->out.append((const char*)data, k);
+ if (c->window!=(size_t)-1){ c->window-=k;}
+ return k;
+}
+
+const host::AccessPoint *WiFiClass::linked(){
+ if (!connecting){ return nullptr;}
+ for (auto &ap:host::accessPoints){
+  if (ap.up&&(ap.ssid==target)&&(ap.password==passphrase)&&(!targetChannel||(ap.channel==targetChannel))&&(!haveBSSID||!memcmp(ap.BSSID, targetBSSID, 6))){ return &ap;}
+ }
+ return nullptr;
+}
+wl_status_t WiFiClass::begin(const char *ssid, const char *pass, int32_t channel, const uint8_t *BSSID, bool connect){
+ host::begins++;
+ target=ssid;
+ passphrase=pass ? pass : "";
+ targetChannel=channel;
+ haveBSSID=BSSID!=nullptr;
+ if (BSSID){ memcpy(targetBSSID, BSSID, 6);}
+ beginMillis=millis();
+ connecting=connect;
+ return WL_DISCONNECTED;
+}
+bool WiFiClass::config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2){
+ host::configs++;
+ staticIP=local;
+ return true;
+}
+bool WiFiClass::disconnect(bool wifioff, bool eraseap){
+ connecting=false;
+ return true;
+}
+wl_status_t WiFiClass::status(){
+ if (!connecting){ return WL_DISCONNECTED;}
+ // the probe is short when the channel and BSSID are known, the lease is skipped with a static address
+ unsigned long needed=(targetChannel&&haveBSSID ? host::probeTime : host::searchTime)+(staticIP.isSet() ? 0 : host::dhcpTime);
+ if (millis()-beginMillis<needed){ return WL_DISCONNECTED;}
+ return linked() ? WL_CONNECTED : WL_NO_SSID_AVAIL;
+}
+IPAddress WiFiClass::localIP(){ return status()!=WL_CONNECTED ? IPAddress() : (staticIP.isSet() ? staticIP : IPAddress(192, 168, 1, 50));}
+IPAddress WiFiClass::gatewayIP(){ return status()==WL_CONNECTED ? IPAddress(192, 168, 1, 1) : IPAddress();}
+IPAddress WiFiClass::subnetMask(){ return status()==WL_CONNECTED ? IPAddress(255, 255, 255, 0) : IPAddress();}
+IPAddress WiFiClass::dnsIP(uint8_t i){ return (status()==WL_CONNECTED)&&!i ? IPAddress(192, 168, 1, 1) : IPAddress();}
+String WiFiClass::SSID(){ return status()==WL_CONNECTED ? String(target) : String();}
+String WiFiClass::psk(){ return status()==WL_CONNECTED ? String(passphrase) : String();}
+uint8_t *WiFiClass::BSSID(){
+ const host::AccessPoint *ap=status()==WL_CONNECTED ? linked() : nullptr;
+ if (ap){ memcpy(bssid, ap->BSSID, 6);}
+ else { memset(bssid, 0, 6);}
+ return bssid;
+}
+int32_t WiFiClass::RSSI(){
+ const host::AccessPoint *ap=status()==WL_CONNECTED ? linked() : nullptr;
+ return ap ? ap->RSSI : 0;
+}
+int32_t WiFiClass::channel(){
+ const host::AccessPoint *ap=status()==WL_CONNECTED ? linked() : nullptr;
+ return ap ? ap->channel : 1;
+}
+int8_t WiFiClass::scanNetworks(bool async, bool show_hidden){
+ host::scans++;
+ scanStart=millis();
+ scanState=WIFI_SCAN_RUNNING;
+ if (async){ return scanState;}
+ delay(host::scanTime);
+ return scanComplete();
+}
+int8_t WiFiClass::scanComplete(){
+ if ((scanState==WIFI_SCAN_RUNNING)&&(millis()-scanStart>=host::scanTime)){
+  results.clear();
+  for (auto &ap:host::accessPoints){ if (ap.up){ results.push_back(ap);}}
+  scanState=results.size();
+ }
+ return scanState;
+}
+void WiFiClass::scanDelete(){
+ results.clear();
+ scanState=WIFI_SCAN_FAILED;
+}
+bool WiFiClass::getNetworkInfo(uint8_t i, String &ssid, uint8_t &encType, int32_t &rssi, uint8_t *&bssid, int32_t &ch, bool &isHidden){
+ if (i>=results.size()){ return false;}
+ host::AccessPoint &ap=results[i];
+ ssid=String(ap.ssid);
+ encType=encryptionType(i);
+ rssi=ap.RSSI;
+ bssid=ap.BSSID;
+ ch=ap.channel;
+ isHidden=false;
+ return true;
+}
+String WiFiClass::SSID(uint8_t i){ return i<results.size() ? String(results[i].ssid) : String();}
+int32_t WiFiClass::RSSI(uint8_t i){ return i<results.size() ? results[i].RSSI : 0;}
+uint8_t *WiFiClass::BSSID(uint8_t i){ return i<results.size() ? results[i].BSSID : nullptr;}
+int32_t WiFiClass::channel(uint8_t i){ return i<results.size() ? results[i].channel : 0;}
+uint8_t WiFiClass::encryptionType(uint8_t i){ return (i<results.size())&&results[i].password.empty() ? ENC_TYPE_NONE : ENC_TYPE_CCMP;}
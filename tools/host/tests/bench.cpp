@@ -0,0 +1,29 @@
+// the page benchmark of the ESP8266 served at /bench.html
+#include "harness.h"
+
+int main(){
+ uploadAssets();
+ sysConfig.init();
+ std::string auth=host::basicAuth(_data.userName, _data.userPass);
+
+ host::Response r=get("/bench.html?loops=3", {{"Authorization", auth}});
+ CHECK_EQ(r.code, 200);
+ CHECK(r.body.find("<th>allocs/page</th>")!=std::string::npos);
+ for (byte i=0;i<PAGE_COUNT;i++){
+  CHECK_EQ(sysConfig.pagestats[i].renders, 3u);
+  CHECK(sysConfig.pagestats[i].maxBytes>0);
+  CHECK(sysConfig.pagestats[i].maxAllocations*3>=sysConfig.pagestats[i].allocations);
+  CHECK(r.body.find(std::string("<tr><td>")+pageNames[i]+"</td>")!=std::string::npos);
+ }
+
+ CHECK(sysConfig.pagestats[PAGE_CONFIG].allocations>0); // the form fields of the config page are Strings
+ // the loops are capped so a request cannot hold up the device for long
+ r=get("/bench.html?loops=100000", {{"Authorization", auth}});
+ CHECK_EQ(r.code, 200);
+ CHECK_EQ(sysConfig.pagestats[0].renders, (uint32_t)BENCH_MAX_LOOPS);
+
+ // and it stays behind the login
+ r=get("/bench.html?loops=1");
+ CHECK_EQ(r.code, 303);
+ return failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+/* the journal of config.bin, a save appends the changed elements behind the records and the next boot replays them,
+ * a save cut short by a power loss loses only its own entries, and the config job compacts the journal once it passes
+ * CONFIG_JOURNAL_LIMIT
+ */
+#include "harness.h"
+
+// what survives a reboot is config.bin, the rest of the config state starts over
+static void reboot(){
+ sysConfig.configMigrated=false;
+ sysConfig.journalBytes=NO_JOURNAL;
+ _data=dataframe();
+ sysConfig.initConfig();
+}
+
+// the ends of the journal entries in file from offset on
+static std::vector<size_t> entryEnds(const std::string &file, size_t offset){
+ std::vector<size_t> ends;
+ while (offset+sizeof(tjournalentry)<=file.size()){
+  tjournalentry entry;
+  memcpy(&entry, file.data()+offset, sizeof(entry));
+  offset+=sizeof(entry)+entry.size+4;
+  ends.push_back(offset);
+ }
+ return ends;
+}
+
+static void save(){
+ sysConfig.commitConfig();
+ runFor(sysConfig.commitDelay+100);
+}
+
+int main(){
+ sysConfig.init();
+ CHECK_EQ(sysConfig.journalBytes, (uint32_t)NO_JOURNAL);
+ strcpy(_data.APname, "first");
+ save(); // nothing to append to, a whole file
+ CHECK_EQ(host::getFile("/config.bin").size(), (size_t)CONFIG_SIZE);
+ CHECK_EQ(sysConfig.journalBytes, 0u);
+
+ // a save appends what changed and the next boot replays it over the records
+ strcpy(_data.APname, "second");
+ save();
+ std::string one=host::getFile("/config.bin");
+ CHECK(one.size()>CONFIG_SIZE);
+ CHECK_EQ(sysConfig.journalBytes, (uint32_t)(one.size()-CONFIG_SIZE));
+ _data.APchannel=4;
+ _data.setPoint=18.5;
+ save();
+ std::string two=host::getFile("/config.bin");
+ CHECK_EQ(two.substr(0, one.size()), one);
+ short burncount=_data.burncount;
+ reboot();
+ CHECK_EQ(std::string(_data.APname), std::string("second"));
+ CHECK_EQ(_data.APchannel, 4);
+ CHECK_EQ(_data.setPoint, 18.5f);
+ CHECK_EQ(_data.burncount, burncount);
+ CHECK_EQ(sysConfig.journalBytes, (uint32_t)(two.size()-CONFIG_SIZE));
+
+ // the last save cut short at every byte, the entries it finished are kept and the one it was writing is lost
+ std::vector<size_t> ends=entryEnds(two, one.size());
+ CHECK(ends.size()>=3); // APchannel, setPoint, burncount
+ CHECK_EQ(ends.back(), two.size());
+ for (size_t cut=one.size();cut<two.size();cut++){
+  host::putFile("/config.bin", two.substr(0, cut));
+  reboot();
+  CHECK_EQ(std::string(_data.APname), std::string("second"));
+  if (cut==one.size()){
+   CHECK_EQ(sysConfig.journalBytes, (uint32_t)(one.size()-CONFIG_SIZE));
+   CHECK_EQ(_data.burncount, burncount-1);
+  }
+  bool boundary=(cut==one.size())||(std::find(ends.begin(), ends.end(), cut)!=ends.end());
+  CHECK_EQ(sysConfig.journalBytes==NO_JOURNAL, !boundary);
+  CHECK_EQ(_data.APchannel, cut>=ends[0] ? 4 : 11); // the first entry of the save, 11 is the default
+ }
+ // as is an entry the power cut left with its bytes but not its CRC right
+ std::string torn=two;
+ torn[torn.size()-5]^=0x55;
+ host::putFile("/config.bin", torn);
+ reboot();
+ CHECK_EQ(std::string(_data.APname), std::string("second"));
+ CHECK_EQ(_data.APchannel, 4);
+ CHECK_EQ(sysConfig.journalBytes, (uint32_t)NO_JOURNAL);
+ // appending behind the damaged entry would hide what follows it, so the next save writes the whole file
+ strcpy(_data.NodeName, "after");
+ save();
+ CHECK_EQ(host::getFile("/config.bin").size(), (size_t)CONFIG_SIZE);
+ reboot();
+ CHECK_EQ(std::string(_data.NodeName), std::string("after"));
+ CHECK_EQ(_data.APchannel, 4);
+
+ // the journal grows with each save until the config job compacts it
+ int saves=0;
+ uint32_t largest=0;
+ for (;saves<100;saves++){
+  snprintf(_data.APname, sizeof(_data.APname), "save %d", saves);
+  save();
+  if (sysConfig.journalBytes<largest){ break;}
+  largest=sysConfig.journalBytes;
+ }
+ CHECK(saves<100);
+ CHECK(largest>CONFIG_JOURNAL_LIMIT/2);
+ CHECK(largest<=CONFIG_JOURNAL_LIMIT+CONFIG_JOURNAL_LIMIT/4);
+ CHECK_EQ(sysConfig.journalBytes, 0u);
+ CHECK_EQ(host::getFile("/config.bin").size(), (size_t)CONFIG_SIZE);
+ std::string name=_data.APname;
+ reboot();
+ CHECK_EQ(std::string(_data.APname), name);
+ CHECK_EQ(std::string(_data.NodeName), std::string("after"));
+ CHECK_EQ(sysConfig.journalBytes, 0u);
+ return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+/* config.bin written by older firmware, a version 0 file is the raw dataframe of before the header and an older schema
+ * has records the current one lacks and lacks records it has, both are read by initConfig() and saved again in the current layout
+ */
+#include "harness.h"
+
+// what survives a reboot is config.bin, the rest of the config state starts over
+static void reboot(){
+ sysConfig.configMigrated=false;
+ sysConfig.journalBytes=NO_JOURNAL;
+ _data=dataframe();
+ sysConfig.initConfig();
+}
+
+static std::string image(const byte *p, size_t size){ return std::string((const char*)p, size);}
+
+struct record {
+ tconfigrecord head;
+ std::string data;
+};
+// the records of a file the current firmware wrote
+static std::vector<record> records(const std::string &file){
+ std::vector<record> r;
+ tconfigheader header;
+ memcpy(&header, file.data(), sizeof(header));
+ size_t p=sizeof(header);
+ for (uint16_t i=0;i<header.records;i++){
+  record k;
+  memcpy(&k.head, file.data()+p, sizeof(k.head));
+  p+=sizeof(k.head);
+  k.data=file.substr(p, k.head.count*k.head.size);
+  p+=k.data.size();
+  r.push_back(k);
+ }
+ return r;
+}
+// a file as firmware with another schema writes it
+static std::string file(const std::vector<record> &r, uint32_t schema){
+ std::string body;
+ for (auto &k:r){ body+=image((const byte*)&k.head, sizeof(k.head))+k.data;}
+ tconfigheader header={CONFIG_MAGIC, CONFIG_VERSION, (uint16_t)r.size(), schema, (uint32_t)body.size(), crc32((const byte*)body.data(), body.size())};
+ return image((const byte*)&header, sizeof(header))+body;
+}
+
+int main(){
+ reboot();
+ CHECK_EQ(_data.burncount, 0); // nothing saved yet, the defaults are in
+
+ // version 0, the dataframe as it was in memory, the IPAddress members carry the vtable pointer of the firmware that wrote it
+ strcpy(_data.APname, "legacy");
+ _data.APchannel=3;
+ strcpy(_data.BLEname, "legacy-ble");
+ _data.TZ=-300;
+ _data.timers[5].startTime=86400+7*60;
+ _data.timers[5].dow=0x3E;
+ _data.setPoint=21.5;
+ _data.gateway=IPAddress(10, 1, 2, 3);
+ _data.burncount=7;
+ std::string legacy=image((const byte*)&_data, CONFIG_LEGACY_SIZE);
+ for (IPAddress *ip:{&_data.ip, &_data.gateway, &_data.subnet}){
+  size_t offset=(byte*)ip-(byte*)&_data;
+  for (size_t i=0;i<sizeof(void*);i++){ legacy[offset+i]=(char)0xA5;}
+ }
+ host::fsClear();
+ host::putFile("/config.bin", legacy);
+ reboot();
+ CHECK_EQ(std::string(_data.APname), std::string("legacy"));
+ CHECK_EQ(_data.APchannel, 3);
+ CHECK_EQ(std::string(_data.BLEname), std::string("legacy-ble"));
+ CHECK_EQ(_data.TZ, (time_t)-300);
+ CHECK_EQ(_data.timers[5].startTime, (time_t)(86400+7*60));
+ CHECK_EQ(_data.timers[5].dow, 0x3E);
+ CHECK_EQ(_data.setPoint, 21.5f);
+ CHECK_EQ((uint32_t)_data.gateway, (uint32_t)IPAddress(10, 1, 2, 3));
+ CHECK_EQ(_data.burncount, 8); // saved again as it was read
+ CHECK_EQ(_data.lastChannel, 0); // came after version 0, so nothing is cached
+ std::string upgraded=host::getFile("/config.bin");
+ CHECK_EQ(upgraded.size(), (size_t)CONFIG_SIZE);
+ tconfigheader header;
+ memcpy(&header, upgraded.data(), sizeof(header));
+ CHECK_EQ(header.magic, (uint32_t)CONFIG_MAGIC);
+ CHECK_EQ(header.schema, schemaHash());
+ reboot();
+ CHECK(!sysConfig.configMigrated);
+ CHECK_EQ(std::string(_data.APname), std::string("legacy"));
+ CHECK_EQ((uint32_t)_data.gateway, (uint32_t)IPAddress(10, 1, 2, 3));
+ CHECK_EQ(_data.burncount, 8);
+
+ // an older schema: BLEname is not in it, a field since removed is, and APchannel was a 32 bit integer
+ std::vector<record> older;
+ for (auto &k:records(upgraded)){
+  if (k.head.name==fieldHash("BLEname", FNV_BASIS)){ continue;}
+  if (k.head.name==fieldHash("APchannel", FNV_BASIS)){
+   int32_t channel=9;
+   k.head.size=4;
+   k.data=image((const byte*)&channel, 4);
+  }
+  older.push_back(k);
+ }
+ std::swap(older[0], older[1]); // and the order was another
+ record removed={{fieldHash("meshID", FNV_BASIS), t_text, 1, 16}, std::string("mesh-0000000000", 16)};
+ older.insert(older.begin()+3, removed);
+ host::putFile("/config.bin", file(older, schemaHash()^1));
+ reboot();
+ CHECK_EQ(std::string(_data.APname), std::string("legacy"));
+ CHECK_EQ(_data.APchannel, 9);
+ CHECK_EQ(std::string(_data.BLEname), std::string("TRL_Device")); // the default of a field the file does not have
+ CHECK_EQ(_data.timers[5].dow, 0x3E);
+ CHECK_EQ((uint32_t)_data.gateway, (uint32_t)IPAddress(10, 1, 2, 3));
+ CHECK_EQ(_data.burncount, 9);
+ upgraded=host::getFile("/config.bin");
+ CHECK_EQ(upgraded.size(), (size_t)CONFIG_SIZE);
+ memcpy(&header, upgraded.data(), sizeof(header));
+ CHECK_EQ(header.records, (uint16_t)SCHEMA_FIELDS);
+ CHECK_EQ(header.schema, schemaHash());
+ reboot();
+ CHECK(!sysConfig.configMigrated);
+ CHECK_EQ(_data.APchannel, 9);
+ CHECK_EQ(std::string(_data.BLEname), std::string("TRL_Device"));
+
+ // a file of any other size is not a config
+ host::putFile("/config.bin", legacy.substr(0, CONFIG_LEGACY_SIZE-1));
+ reboot();
+ CHECK_EQ(_data.burncount, 0);
+ return failures ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+/* the A/B config slots of the ESP32, the power is cut at every byte of a save, erase included, and the next boot must
+ * find either the old or the new config, never neither, and the slots must be read even when SPIFFS does not mount
+ */
+#include "harness.h"
+
+// what survives a reboot is the flash, the rest of the config state starts over
+static bool reboot(){
+ sysConfig.configSlot=1;
+ sysConfig.slotSequence=0;
+ sysConfig.configMigrated=false;
+ _data.APname[0]=0;
+ _data.burncount=0;
+ return sysConfig.readConfig();
+}
+
+int main(){
+ host::flash.assign(2*CONFIG_SLOT, 0xFF);
+ sysConfig.initConfig();
+ CHECK(sysConfig.configPartition!=nullptr);
+ strcpy(_data.APname, "old");
+ CHECK(sysConfig.writeConfig());
+ CHECK(sysConfig.writeConfig()); // both slots hold a config
+ CHECK(reboot());
+ CHECK_EQ(std::string(_data.APname), std::string("old"));
+
+ std::vector<uint8_t> before=host::flash;
+ byte slot=sysConfig.configSlot;
+ uint32_t sequence=sysConfig.slotSequence;
+ long save=CONFIG_SLOT+sizeof(tslotheader)+CONFIG_SIZE; // the bytes a save erases and writes
+ int lost=0, olds=0, news=0;
+ for (long cut=0;cut<=save;cut++){
+  host::flash=before;
+  sysConfig.configSlot=slot;
+  sysConfig.slotSequence=sequence;
+  strcpy(_data.APname, "new");
+  host::flashBudget=cut;
+  bool saved=sysConfig.writeConfig();
+  host::flashBudget=-1;
+  CHECK_EQ(saved, cut==save);
+  if (!reboot()){ lost++; continue;}
+  if (!strcmp(_data.APname, "old")){ olds++;}
+  else if (!strcmp(_data.APname, "new")){ news++;}
+  else { lost++;}
+ }
+ CHECK_EQ(lost, 0);
+ CHECK_EQ(news, 1); // only a save that completed is read back
+ CHECK_EQ(olds, save);
+
+ // with SPIFFS down the config still comes from the slots and the assets are not looked for
+ host::fsMountable=false;
+ reboot();
+ sysConfig.initConfig();
+ CHECK(!sysConfig.fsMounted);
+ CHECK_EQ(std::string(_data.APname), std::string("new")); // the last save above was not cut
+ CHECK(_data.burncount>0);
+ host::fsMountable=true;
+ SPIFFS.begin();
+
+ // a config.bin from before the slots moves into them on the next boot
+ host::flash.assign(2*CONFIG_SLOT, 0xFF);
+ sysConfig.configPartition=nullptr;
+ strcpy(_data.APname, "fromfs");
+ CHECK(sysConfig.saveConfig());
+ reboot();
+ sysConfig.initConfig();
+ CHECK_EQ(std::string(_data.APname), std::string("fromfs"));
+ CHECK(reboot());
+ CHECK_EQ(std::string(_data.APname), std::string("fromfs"));
+ CHECK(sysConfig.slotSequence>0);
+ return failures ? 1 : 0;
+}
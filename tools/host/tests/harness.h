@@ -0,0 +1,61 @@
+/* shared by the host tests, builds the sysconfig header of the board with its internals open to the test,
+ * and adds the few helpers every test needs to run the device and talk to its web server
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#define private public
+#define protected public
+#ifdef ESP32
+#include "sysconfig32.h"
+#else
+#include "sysconfig8266.h"
+#endif
+#undef private
+#undef protected
+
+inline int failures=0;
+#define CHECK(cond) do { if (!(cond)){ failures++; fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);}} while (0)
+#define CHECK_EQ(a, b) do { auto _a=(a); auto _b=(b); if (!(_a==_b)){ failures++; fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %s != %s\n", __FILE__, __LINE__, #a, #b, show(_a).c_str(), show(_b).c_str());}} while (0)
+template<typename T> std::string show(const T &v){ std::ostringstream s; s<<v; return s.str();}
+inline std::string show(const String &v){ return v.s;}
+inline std::string show(uint8_t v){ return std::to_string(v);}
+
+// the files of the upload folder of the board go into SPIFFS, as the upload plugin puts them there
+inline void uploadAssets(){
+ for (auto &entry:std::filesystem::directory_iterator(UPLOAD_DIR)){
+  std::ifstream f(entry.path(), std::ios::binary);
+  std::stringstream s;
+  s<<f.rdbuf();
+  host::putFile("/"+entry.path().filename().string(), s.str());
+ }
+}
+
+// one pass of the sketch loop, the clock moves on by as much as run() says it may sleep
+inline void step(){ host::advance(std::max<uint32_t>(1, std::min<uint32_t>(sysConfig.run(), 100)));}
+inline void runFor(unsigned long ms){
+ unsigned long start=millis();
+ while (millis()-start<ms){ step();}
+}
+
+// a request on a connection of its own, the response is decoded
+inline host::Response request(HTTPMethod method, const std::string &uri, const std::vector<std::pair<std::string, std::string>> &headers={}, const std::string &body=""){
+ auto c=host::connect();
+ host::Request q;
+ q.method=method;
+ q.uri=uri;
+ q.headers=headers;
+ q.body=body;
+ host::Response r;
+ if (!host::fetch(*c, q, r, step)){ r.code=0;}
+ c->peerClosed=true;
+ return r;
+}
+inline host::Response get(const std::string &uri, const std::vector<std::pair<std::string, std::string>> &headers={}){ return request(HTTP_GET, uri, headers);}
@@ -0,0 +1,35 @@
+// persistent connections of the ESP8266, small assets share a connection and a file sent from a transfer slot closes it
+#include "harness.h"
+
+static host::Response fetch(host::Connection &c, const std::string &uri){
+ host::Request q;
+ q.uri=uri;
+ host::Response r;
+ if (!host::fetch(c, q, r, step)){ r.code=0;}
+ return r;
+}
+
+int main(){
+ uploadAssets();
+ sysConfig.init();
+ auto c=host::connect();
+
+ host::Response r=fetch(*c, "/no/such/page");
+ CHECK_EQ(r.code, 404);
+ CHECK_EQ(r.header("Connection"), std::string("keep-alive"));
+ r=fetch(*c, "/no/such/page");
+ CHECK_EQ(r.code, 404); // on the same connection
+ CHECK(!c->closed);
+
+ // index.html is too large for the cache, its body is sent from run() after the handler has let the connection go
+ CHECK(host::getFile("/index.html").size()>ASSET_CACHE_FILE);
+ r=fetch(*c, "/index.html");
+ CHECK_EQ(r.code, 200);
+ CHECK_EQ(r.header("Connection"), std::string("close"));
+ CHECK_EQ(r.body, host::getFile("/index.html"));
+ runFor(100);
+ CHECK(!sysConfig.server._currentClient.connected()); // the server let the connection go with the response
+ r=get("/no/such/page");
+ CHECK_EQ(r.code, 404);
+ return failures ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+/* the conversions of posted form fields, a value that does not scan in full is refused and leaves the config field as it was,
+ * and converting a field makes no heap allocation, the posted text is read where the web server keeps it
+ */
+#include "harness.h"
+
+// the arguments of a form post as the web server holds them while the handler runs
+static std::vector<WebServer::RequestArgument> posted;
+static void post(const std::vector<std::pair<const char*, const char*>> &fields){
+ posted.clear();
+ for (auto &f:fields){ posted.push_back({f.first, f.second});}
+ sysConfig.server._currentArgs=posted.data();
+ sysConfig.server._currentArgCount=posted.size();
+ sysConfig.server._currentMethod=HTTP_POST;
+}
+
+int main(){
+ uploadAssets();
+ sysConfig.init();
+ runFor(100);
+
+ // a partly valid value is refused as a whole
+ _data.setPoint=20;
+ IPAddress gateway=_data.gateway;
+ post({{"setPoint", "12.5x"}, {"gateway", "1.2.3.4x"}});
+#ifdef ESP32
+ CHECK_EQ(sysConfig.setval(_data.setPoint, String("12.5x")), NaN);
+#else
+ CHECK_EQ(sysConfig.copyval(_data.setPoint, "setPoint"), NaN);
+#endif
+ CHECK_EQ(_data.setPoint, 20.0f);
+ CHECK_EQ(sysConfig.copyIP(_data.gateway, "gateway"), BadAddress);
+ CHECK_EQ((uint32_t)_data.gateway, (uint32_t)gateway);
+ post({{"setPoint", "12.5"}, {"gateway", "1.2.3.4"}});
+ CHECK_EQ(sysConfig.copyval(_data.setPoint, "setPoint"), OK);
+ CHECK_EQ(_data.setPoint, 12.5f);
+ CHECK_EQ(sysConfig.copyIP(_data.gateway, "gateway"), OK);
+ CHECK_EQ((uint32_t)_data.gateway, (uint32_t)IPAddress(1, 2, 3, 4));
+#ifdef ESP32
+ // and through the config form the index page takes
+ byte channel=_data.APchannel;
+ std::string auth=host::basicAuth(_data.userName, _data.userPass);
+ host::Response r=request(HTTP_POST, "/", {{"Authorization", auth}, {"Content-Type", "application/x-www-form-urlencoded"}}, "APchannel=7x");
+ CHECK_EQ(r.code, 200);
+ CHECK_EQ(_data.APchannel, channel);
+#endif
+
+ // the values are longer than a String keeps without the heap, so a copy of one would be counted
+ const char *name="an-access-point-name-long-enough-to-need-the-heap";
+ const char *number="12.50000000000000000000";
+ uint64_t before;
+#ifdef ESP32
+ // the whole config form in the single pass postConfig() makes over the posted arguments
+ post({{"SSID_0", name}, {"SSID_pass_0", name}, {"APname", name}, {"APchannel", "00000000000000000006"},
+  {"NTPserver", name}, {"TZ", "01:00"}, {"st_3", "07:30"}, {"d_3", "127"}, {"Node", name}});
+ before=host::allocations();
+ sysConfig.postConfig();
+ CHECK_EQ(host::allocations()-before, 0u);
+ CHECK_EQ(std::string(_data.APname), std::string(name).substr(0, sizeof(_data.APname)-1));
+ CHECK_EQ(_data.APchannel, 6);
+ CHECK_EQ(_data.timers[3].dow, 127);
+#endif
+ // each conversion on its own
+ char text[128];
+ byte b;
+ int32_t i;
+ float f;
+ time_t t;
+ bool checked;
+ IPAddress ip;
+ post({{"text", name}, {"byte", "00000000000000000006"}, {"int", "00000000000000000042"}, {"float", number}, {"time", "23:59"}, {"check", "on"}, {"ip", "192.168.100.200"}});
+ before=host::allocations();
+#ifdef ESP32
+ // the ESP32 core hands out a copy of an argument looked up by name, setval() converts the posted text where it is
+ CHECK(sysConfig.setval(text, sysConfig.server.argValue(0), sizeof(text))>0);
+ CHECK_EQ(sysConfig.setval(b, sysConfig.server.argValue(1)), OK);
+ CHECK_EQ(sysConfig.setval(i, sysConfig.server.argValue(2)), OK);
+ CHECK_EQ(sysConfig.setval(f, sysConfig.server.argValue(3)), OK);
+ CHECK_EQ(sysConfig.setval(t, sysConfig.server.argValue(4)), OK);
+ CHECK_EQ(host::allocations()-before, 0u);
+ CHECK_EQ(t, (time_t)(23*60+59+86400));
+ CHECK_EQ(sysConfig.copyval(checked, "check"), OK);
+ CHECK_EQ(sysConfig.copyIP(ip, "ip"), OK);
+#else
+ CHECK(sysConfig.copyval(text, "text", sizeof(text))>0);
+ CHECK_EQ(sysConfig.copyval(b, "byte"), OK);
+ CHECK_EQ(sysConfig.copyval(i, "int"), OK);
+ CHECK_EQ(sysConfig.copyval(f, "float"), OK);
+ CHECK_EQ(sysConfig.copyval(t, "time"), OK);
+ CHECK_EQ(sysConfig.copyval(checked, "check"), OK);
+ CHECK_EQ(sysConfig.copyIP(ip, "ip"), OK);
+ CHECK_EQ(host::allocations()-before, 0u);
+ CHECK_EQ(t, (time_t)(23*3600+59*60)); // the Time library counts the day and month of 0 back from 1970
+#endif
+ CHECK_EQ(std::string(text), std::string(name));
+ CHECK_EQ(b, 6);
+ CHECK_EQ(i, 42);
+ CHECK_EQ(f, 12.5f);
+ CHECK(checked);
+ CHECK_EQ((uint32_t)ip, (uint32_t)IPAddress(192, 168, 100, 200));
+ return failures ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+// the route table, a path answers the methods its route takes and 405 names them for the others
+#include "harness.h"
+
+int main(){
+ uploadAssets();
+ sysConfig.init();
+
+ host::Response r=get("/metrics");
+ CHECK_EQ(r.code, 200);
+ r=request(HTTP_POST, "/metrics");
+ CHECK_EQ(r.code, 405);
+ CHECK_EQ(r.header("Allow"), std::string("GET"));
+ r=request(HTTP_DELETE, "/metrics");
+ CHECK_EQ(r.code, 405);
+ r=request(HTTP_POST, "/index.html");
+ CHECK_EQ(r.code, 200); // HTTP_ANY
+ r=request(HTTP_POST, "/no/such/page");
+ CHECK_EQ(r.code, 404);
+ CHECK(r.header("Allow").empty());
+ return failures ? 1 : 0;
+}
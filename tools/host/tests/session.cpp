@@ -0,0 +1,51 @@
+// the login cookie of the ESP8266, only the cookie named ESPSESSION counts, only a POST to /logout ends the sessions
+// and a cookie expires after SESSION_LIFE however long the device has been up
+#include "harness.h"
+
+static std::string session;
+static int page(const std::string &cookie){ return get("/config.html", {{"Cookie", cookie}}).code;}
+static std::string login(){
+ host::Response r=request(HTTP_POST, "/login.html?page=/config.html", {}, std::string("userName=")+_data.userName+"&userPass="+_data.userPass);
+ std::string cookie=r.header("Set-Cookie");
+ return cookie.substr(0, cookie.find(';'));
+}
+
+int main(){
+ uploadAssets();
+ sysConfig.init();
+
+ host::Response r=request(HTTP_POST, "/login.html?page=/config.html", {}, std::string("userName=")+_data.userName+"&userPass="+_data.userPass);
+ CHECK_EQ(r.code, 303);
+ CHECK_EQ(r.header("Location"), std::string("/config.html"));
+ session=r.header("Set-Cookie");
+ session=session.substr(0, session.find(';'));
+ CHECK(session.rfind(SESSION_COOKIE "=", 0)==0);
+
+ CHECK_EQ(page(session), 200);
+ CHECK_EQ(page("theme=dark; "+session), 200);
+ CHECK_EQ(page(session+"; theme=dark"), 200);
+ CHECK_EQ(page("X"+session), 303); // another cookie whose name ends in ESPSESSION
+ CHECK_EQ(page("theme=dark; X"+session), 303);
+ CHECK_EQ(page("theme=dark"+session), 303);
+ CHECK_EQ(page("X"+session+"; "+session), 200); // the real one after it still counts
+
+ r=get("/logout", {{"Cookie", session}});
+ CHECK_EQ(r.code, 405);
+ CHECK_EQ(r.header("Allow"), std::string("POST"));
+ CHECK_EQ(page(session), 200);
+ r=request(HTTP_POST, "/logout", {{"Cookie", session}});
+ CHECK_EQ(r.code, 303);
+ CHECK_EQ(page(session), 303);
+
+ session=login();
+ CHECK_EQ(page(session), 200);
+ host::advance((SESSION_LIFE-10)*1000UL);
+ CHECK_EQ(page(session), 200);
+ host::advance(20*1000UL);
+ CHECK_EQ(page(session), 303);
+ // once millis() has wrapped it reads what it read at the login again, the cookie stays expired
+ session=login();
+ host::advance(0x100000000UL);
+ CHECK_EQ(page(session), 303);
+ return failures ? 1 : 0;
+}
@@ -0,0 +1,29 @@
+// boots the device on an empty radio and serves the pages of the upload folder
+#include "harness.h"
+
+int main(){
+ uploadAssets();
+ sysConfig.init();
+ runFor(1000);
+ CHECK(strlen(_data.APname)>0); // the defaults were loaded
+
+ host::Response r=get("/");
+ CHECK_EQ(r.code, 200);
+ CHECK_EQ(r.header("Content-Type"), std::string("text/html"));
+ CHECK_EQ(r.body, host::getFile("/index.html"));
+ r=get("/index.html", {{"If-None-Match", r.header("ETag")}});
+ CHECK_EQ(r.code, 304);
+ r=get("/no/such/page");
+ CHECK_EQ(r.code, 404);
+ CHECK_EQ(r.body, host::getFile("/404.html"));
+ r=get("/metrics");
+ CHECK_EQ(r.code, 200);
+ CHECK(r.body.find("esp_heap_free_bytes ")!=std::string::npos);
+ CHECK(r.body.find("esp_wifi_connected 0")!=std::string::npos);
+
+ // without an access point configured the station stays down and the soft AP serves alone
+ runFor(30000);
+ CHECK(!sysConfig.STAconnected);
+ CHECK_EQ(host::begins, 0);
+ return failures ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+/* the station state machine against scripted access points, the device boots with home configured, connects to its
+ * strongest radio in the background, moves to the other radio when that one goes, backs off while both are gone, and
+ * goes straight back to the cached radio and lease on the next boot
+ */
+#include "harness.h"
+#include <type_traits>
+
+#ifdef ESP8266
+// the config is written to flash as raw bytes, the cached lease must hold no vtable pointer
+static_assert(std::is_trivially_copyable<decltype(dataframe::lastIP)>::value&&std::is_trivially_copyable<decltype(dataframe::lastDNS)>::value,
+ "the cached lease is written raw");
+#endif
+
+static bool connectWithin(unsigned long ms){
+ unsigned long start=millis();
+ while (!sysConfig.STAconnected&&(millis()-start<ms)){ step();}
+ return sysConfig.STAconnected;
+}
+
+int main(){
+ host::accessPoints={
+  {"home", "secret", -70, 6, {2, 0, 0, 0, 0, 6}, true},
+  {"home", "secret", -50, 11, {2, 0, 0, 0, 0, 11}, true},
+  {"other", "x", -40, 1, {2, 0, 0, 0, 0, 1}, true}};
+ // home was configured on an earlier boot
+ sysConfig.initConfig();
+ strcpy(_data.AccessPoints[0].WiFiname, "home");
+ strcpy(_data.AccessPoints[0].WiFipassword, "secret");
+ sysConfig.writeConfig();
+
+ unsigned long start=millis();
+ sysConfig.init();
+ CHECK(millis()-start<100); // init does not wait for the radio
+ CHECK(!sysConfig.STAconnected);
+ CHECK((sysConfig.wifiState==w_scan)||(sysConfig.wifiState==w_scanning));
+
+ // the scan takes 2 s, then the strongest radio of home is joined on its channel
+ CHECK(connectWithin(10000));
+ CHECK(millis()-start<host::scanTime+host::probeTime+host::dhcpTime+500);
+ CHECK_EQ(WiFi.channel(), 11);
+ CHECK_EQ(sysConfig.wifiState, w_connected);
+ CHECK_EQ(sysConfig.jobs[sysConfig.wifiJob].period, (uint32_t)WIFI_PERIOD);
+ CHECK_EQ(sysConfig.wifiReconnects, 0u);
+
+ // the radio on channel 11 goes, the station moves to channel 6
+ host::accessPoints[1].up=false;
+ runFor(WIFI_PERIOD+100);
+ CHECK(!sysConfig.STAconnected);
+ CHECK(connectWithin(30000));
+ CHECK_EQ(WiFi.channel(), 6);
+ CHECK_EQ(sysConfig.wifiReconnects, 1u);
+
+ // with both gone the soft AP comes up and the scans back off
+ host::accessPoints[0].up=false;
+ runFor(60000);
+ CHECK(!sysConfig.STAconnected);
+ CHECK(sysConfig.softAPup);
+ CHECK(sysConfig.wifiBackoff>WIFI_BACKOFF);
+ int scans=host::scans;
+ runFor(WIFI_BACKOFF);
+ CHECK(host::scans-scans<=1);
+ host::accessPoints[0].up=true;
+ CHECK(connectWithin(WIFI_BACKOFF_MAX+10000));
+ CHECK_EQ(sysConfig.wifiBackoff, (uint32_t)WIFI_BACKOFF);
+ CHECK_EQ(_data.lastChannel, 6);
+ runFor(sysConfig.commitDelay+100);
+ CHECK(!sysConfig.commitPending);
+
+ // a reboot with the connection cached joins the radio on its channel with the old lease, no scan and no DHCP
+ sysConfig.STAconnected=false;
+ scans=host::scans;
+ int configs=host::configs;
+ start=millis();
+ sysConfig.initWiFi();
+ CHECK_EQ(sysConfig.wifiState, w_resume);
+ CHECK(connectWithin(5000));
+ CHECK(millis()-start<host::probeTime+WIFI_STEP+50);
+ CHECK_EQ(host::scans, scans);
+ CHECK_EQ(host::configs, configs+1);
+ CHECK_EQ(WiFi.channel(), 6);
+ CHECK_EQ((uint32_t)WiFi.localIP(), (uint32_t)IPAddress(_data.lastIP));
+
+ // the jobs are set up again while a connection is under way, it keeps its timing and its pace
+ sysConfig.setWiFiState(w_connecting);
+ uint32_t stateMillis=sysConfig.wifiStateMillis, connectStart=sysConfig.connectStart;
+ runFor(50);
+ for (int i=0;i<JOBS;i++){ sysConfig.cancel(i);}
+ // and a commit made before they exist, as by the WPS connect in initWiFi(), is not lost
+ sysConfig.commitJob=NO_JOB;
+ strcpy(_data.NodeName, "early");
+ short burncount=_data.burncount;
+ sysConfig.commitConfig();
+ sysConfig.initJobs();
+ CHECK_EQ(sysConfig.wifiState, w_connecting);
+ CHECK_EQ(sysConfig.wifiStateMillis, stateMillis);
+ CHECK_EQ(sysConfig.connectStart, connectStart);
+ CHECK_EQ(sysConfig.jobs[sysConfig.wifiJob].period, (uint32_t)WIFI_STEP);
+ runFor(sysConfig.commitDelay+100);
+ CHECK(!sysConfig.commitPending);
+ CHECK_EQ(_data.burncount, burncount+1);
+#ifdef ESP8266
+ // a config file is the whole dataframe, or the part of it written before the connection was cached, any other size is refused
+ std::string file=host::getFile("/config.bin");
+ CHECK_EQ(file.size(), sizeof(dataframe));
+ host::putFile("/config.bin", file.substr(0, CONFIG_SHORT_SIZE));
+ CHECK(sysConfig.readConfig());
+ CHECK_EQ(std::string(_data.NodeName), std::string("early"));
+ CHECK_EQ(_data.lastChannel, 0);
+ host::putFile("/config.bin", file+std::string(4, 0));
+ CHECK(!sysConfig.readConfig());
+ host::putFile("/config.bin", file.substr(0, CONFIG_SHORT_SIZE+4));
+ CHECK(!sysConfig.readConfig());
+#endif
+ return failures ? 1 : 0;
+}
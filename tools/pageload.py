@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Page load benchmark for an ESPconfig device, run from a PC on the same network.
+
+A page load fetches a page and its assets one after the other, the way a browser does on a single
+connection. Each load is timed twice, once opening a new connection for every file (how the device
+served pages before keep-alive) and once reusing one persistent connection.
+
+usage: pageload.py [--loads N] [--paths / /w3.css /sc.js /favicon.ico] 192.168.4.1
+"""
+import argparse
+import http.client
+import statistics
+import time
+
+
+def fetch(conn, path, close):
+    headers = {"Connection": "close"} if close else {}
+    conn.request("GET", path, headers=headers)
+    response = conn.getresponse()
+    body = response.read()
+    return response.status, len(body), response.getheader("Connection", "")
+
+
+def load_closed(host, port, paths, timeout):
+    size = 0
+    for path in paths:
+        conn = http.client.HTTPConnection(host, port, timeout=timeout)
+        size += fetch(conn, path, True)[1]
+        conn.close()
+    return size
+
+
+def load_kept(host, port, paths, timeout):
+    size = 0
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    for path in paths:
+        status, length, connection = fetch(conn, path, False)
+        size += length
+        if connection.lower() == "close":
+            # the device ended the connection, its request limit was reached
+            conn.close()
+            conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    conn.close()
+    return size
+
+
+def measure(load, args):
+    times = []
+    size = 0
+    for _ in range(args.loads):
+        start = time.perf_counter()
+        size = load(args.host, args.port, args.paths, args.timeout)
+        times.append((time.perf_counter() - start) * 1000)
+    times.sort()
+    return {
+        "mean": statistics.mean(times),
+        "median": statistics.median(times),
+        "p95": times[min(len(times) - 1, int(len(times) * 0.95))],
+        "bytes": size,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--loads", type=int, default=20, help="page loads timed in each mode")
+    parser.add_argument("--timeout", type=float, default=10)
+    parser.add_argument("--paths", nargs="+", default=["/", "/w3.css", "/sc.js", "/favicon.ico"])
+    args = parser.parse_args()
+
+    print("%d loads of %s" % (args.loads, " ".join(args.paths)))
+    print("%-22s %9s %9s %9s %9s" % ("", "mean ms", "median ms", "p95 ms", "bytes"))
+    results = {}
+    for name, load in (("connection per file", load_closed), ("persistent connection", load_kept)):
+        results[name] = r = measure(load, args)
+        print("%-22s %9.1f %9.1f %9.1f %9d" % (name, r["mean"], r["median"], r["p95"], r["bytes"]))
+    before = results["connection per file"]["median"]
+    after = results["persistent connection"]["median"]
+    if after > 0:
+        print("persistent connections load the page %.1fx faster" % (before / after))
+
+
+if __name__ == "__main__":
+    main()